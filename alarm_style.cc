@@ -0,0 +1,96 @@
+
+#include "alarm_style.hh"
+
+// The styles for each level, plus the off phase of a blinking critical alarm.
+#define NSTATES 4
+#define BLINK_OFF_STATE 3
+
+static lv_style_t *state_style(AlarmIndicator::Kind kind, int state) {
+  static lv_style_t text_styles[NSTATES];
+  static lv_style_t image_styles[NSTATES];
+  static bool initialized = false;
+  if (!initialized) {
+    const lv_color_t text_colors[NSTATES] =
+      { LV_COLOR_WHITE, LV_COLOR_YELLOW, LV_COLOR_RED, LV_COLOR_RED };
+    const lv_color_t image_colors[NSTATES] =
+      { LV_COLOR_GREEN, LV_COLOR_YELLOW, LV_COLOR_RED, LV_COLOR_WHITE };
+    for (int i = 0; i < NSTATES; ++i) {
+      lv_style_init(&text_styles[i]);
+      lv_style_set_text_color(&text_styles[i], LV_STATE_DEFAULT, text_colors[i]);
+      lv_style_init(&image_styles[i]);
+      lv_style_set_image_recolor_opa(&image_styles[i], LV_STATE_DEFAULT, LV_OPA_COVER);
+      lv_style_set_image_recolor(&image_styles[i], LV_STATE_DEFAULT, image_colors[i]);
+    }
+    initialized = true;
+  }
+
+  switch (kind) {
+  case AlarmIndicator::TEXT:
+    return &text_styles[state];
+  case AlarmIndicator::IMAGE:
+    return &image_styles[state];
+  default:
+    return NULL;
+  }
+}
+
+void AlarmIndicator::add(lv_obj_t *obj) {
+  m_objs.push_back(obj);
+  if (m_style) {
+    lv_obj_add_style(obj, LV_OBJ_PART_MAIN, m_style);
+  }
+  // Only a blinking indicator hides its widgets, so leave any that the layout hid alone.
+  if ((m_kind == BLINK) && m_hidden) {
+    lv_obj_set_hidden(obj, true);
+  }
+}
+
+void AlarmIndicator::set_level(Level level) {
+  if (m_initialized && (level == m_level)) {
+    return;
+  }
+  m_level = level;
+  m_initialized = true;
+  apply();
+}
+
+void AlarmIndicator::blink(bool on) {
+  if (!on == m_blink_off) {
+    return;
+  }
+  m_blink_off = !on;
+  if (m_level == CRITICAL) {
+    apply();
+  }
+}
+
+void AlarmIndicator::apply() {
+  int state = m_level;
+  if ((m_level == CRITICAL) && m_blink_off) {
+    state = BLINK_OFF_STATE;
+  }
+
+  if (m_kind == BLINK) {
+    bool hidden = (state == BLINK_OFF_STATE);
+    if (hidden != m_hidden) {
+      for (lv_obj_t *obj : m_objs) {
+        lv_obj_set_hidden(obj, hidden);
+      }
+      m_hidden = hidden;
+    }
+    return;
+  }
+
+  // Swap the style of the previous state for the new one.
+  lv_style_t *style = state_style(m_kind, state);
+  if (style == m_style) {
+    return;
+  }
+  for (lv_obj_t *obj : m_objs) {
+    if (m_style) {
+      lv_obj_remove_style(obj, LV_OBJ_PART_MAIN, m_style);
+    }
+    lv_obj_add_style(obj, LV_OBJ_PART_MAIN, style);
+  }
+  m_style = style;
+}
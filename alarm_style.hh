@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+
+#include "lvgl/lvgl.h"
+
+// Shows the alarm level of a value on one or more widgets.
+// The styles for each level are created once and shared by all of the indicators. A widget's
+// style is only swapped when the level (or the blink phase of a critical alarm) changes, so an
+// indicator that stays at the same level doesn't touch LVGL at all.
+class AlarmIndicator {
+public:
+
+  enum Level { NORMAL, WARN, CRITICAL };
+
+  enum Kind {
+    // White, yellow or red text
+    TEXT,
+    // Green, yellow or red image that blinks white when critical
+    IMAGE,
+    // Blinks (hides) the widget when critical
+    BLINK
+  };
+
+  AlarmIndicator(Kind kind) : m_kind(kind), m_level(NORMAL), m_blink_off(false),
+                              m_style(NULL), m_hidden(false), m_initialized(false) {}
+
+  void add(lv_obj_t *obj);
+
+  void set_level(Level level);
+  Level level() const { return m_level; }
+
+  // Set the blink phase, which only affects critical alarms.
+  void blink(bool on);
+
+private:
+
+  void apply();
+
+  Kind m_kind;
+  Level m_level;
+  bool m_blink_off;
+  lv_style_t *m_style;
+  bool m_hidden;
+  bool m_initialized;
+  std::vector<lv_obj_t*> m_objs;
+};
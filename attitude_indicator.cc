@@ -0,0 +1,181 @@
+
+#include <math.h>
+#include <stdio.h>
+
+#include "attitude_indicator.hh"
+
+// The ladder has a rung every 10 degrees of pitch.
+#define LADDER_STEP 10
+#define LADDER_MAX 90
+
+// The horizontal layout as fractions of the widget width.
+#define HORIZON_INNER 0.25f
+#define HORIZON_OUTER 0.45f
+#define RUNG_INNER 0.10f
+#define RUNG_OUTER 0.22f
+#define RUNG_TICK 0.02f
+#define LABEL_X 0.27f
+#define AIRCRAFT_WING 0.20f
+#define AIRCRAFT_CENTER 0.06f
+
+AttitudeIndicator::AttitudeIndicator(lv_obj_t *obj, float pixels_per_degree) :
+  m_obj(obj), m_pixels_per_degree(pixels_per_degree), m_roll(0), m_pitch(0), m_dirty(true) {
+  float w = lv_obj_get_width(obj);
+  float h = lv_obj_get_height(obj);
+
+  // Only the rungs that can be inside the widget (at any roll) are transformed.
+  m_visible_pitch = sqrt(w * w + h * h) / 2 / pixels_per_degree;
+
+  // The horizon, with a gap around the aircraft symbol
+  for (float side : { -1.0f, 1.0f }) {
+    m_ladder.push_back({ side * HORIZON_INNER * w, 0, side * HORIZON_OUTER * w, 0, 0 });
+  }
+
+  // The rungs have ticks pointing at the horizon, and the rungs below the horizon are dashed.
+  for (int pitch = -LADDER_MAX; pitch <= LADDER_MAX; pitch += LADDER_STEP) {
+    if (pitch == 0) {
+      continue;
+    }
+    float y = -pitch * pixels_per_degree;
+    float tick = ((pitch > 0) ? 1 : -1) * RUNG_TICK * w;
+    for (float side : { -1.0f, 1.0f }) {
+      float inner = side * RUNG_INNER * w;
+      float outer = side * RUNG_OUTER * w;
+      if (pitch > 0) {
+        m_ladder.push_back({ inner, y, outer, y, float(pitch) });
+      } else {
+        float dash = (outer - inner) / 3;
+        m_ladder.push_back({ inner, y, inner + dash, y, float(pitch) });
+        m_ladder.push_back({ outer - dash, y, outer, y, float(pitch) });
+      }
+      m_ladder.push_back({ outer, y, outer, y + tick, float(pitch) });
+
+      Label label;
+      label.x = side * LABEL_X * w;
+      label.y = y;
+      label.pitch = pitch;
+      snprintf(label.text, sizeof(label.text), "%d", abs(pitch));
+      m_labels.push_back(label);
+    }
+  }
+  m_points.reserve(m_ladder.size() * 2);
+  m_label_points.reserve(m_labels.size());
+  m_label_text.reserve(m_labels.size());
+
+  // The aircraft symbol at the center
+  lv_coord_t wing = AIRCRAFT_WING * w;
+  lv_coord_t center = AIRCRAFT_CENTER * w;
+  m_aircraft = { { lv_coord_t(-wing), 0 }, { lv_coord_t(-center), 0 }, { 0, center },
+                 { center, 0 }, { wing, 0 } };
+
+  // Replace the drawing of the object.
+  *static_cast<AttitudeIndicator**>(lv_obj_allocate_ext_attr(obj, sizeof(AttitudeIndicator*))) =
+    this;
+  lv_obj_set_design_cb(obj, design_cb);
+  lv_obj_set_click(obj, false);
+}
+
+void AttitudeIndicator::set_roll(float radians) {
+  if (radians == m_roll) {
+    return;
+  }
+  m_roll = radians;
+  m_dirty = true;
+  lv_obj_invalidate(m_obj);
+}
+
+void AttitudeIndicator::set_pitch(float radians) {
+  if (radians == m_pitch) {
+    return;
+  }
+  m_pitch = radians;
+  m_dirty = true;
+  lv_obj_invalidate(m_obj);
+}
+
+void AttitudeIndicator::transform() {
+  // Rolling right turns the horizon counter-clockwise, and pitching up moves it down.
+  float c = cos(m_roll);
+  float s = sin(m_roll);
+  float pitch = m_pitch * 180.0 / M_PI;
+  float offset = pitch * m_pixels_per_degree;
+  auto point = [c, s, offset](float x, float y) {
+    y += offset;
+    lv_point_t p;
+    p.x = lrintf(x * c + y * s);
+    p.y = lrintf(y * c - x * s);
+    return p;
+  };
+
+  m_points.clear();
+  for (const Segment &seg : m_ladder) {
+    if (fabs(seg.pitch - pitch) <= m_visible_pitch) {
+      m_points.push_back(point(seg.x1, seg.y1));
+      m_points.push_back(point(seg.x2, seg.y2));
+    }
+  }
+  m_label_points.clear();
+  m_label_text.clear();
+  for (const Label &label : m_labels) {
+    if (fabs(label.pitch - pitch) <= m_visible_pitch) {
+      m_label_points.push_back(point(label.x, label.y));
+      m_label_text.push_back(label.text);
+    }
+  }
+  m_dirty = false;
+}
+
+lv_design_res_t AttitudeIndicator::design_cb(lv_obj_t *obj, const lv_area_t *clip_area,
+                                             lv_design_mode_t mode) {
+  if (mode == LV_DESIGN_COVER_CHK) {
+    return LV_DESIGN_RES_NOT_COVER;
+  }
+  if (mode == LV_DESIGN_DRAW_MAIN) {
+    (*static_cast<AttitudeIndicator**>(lv_obj_get_ext_attr(obj)))->draw(clip_area);
+  }
+  return LV_DESIGN_RES_OK;
+}
+
+void AttitudeIndicator::draw(const lv_area_t *clip_area) {
+  // The refresh can draw the widget in several parts, but it only moves once per refresh.
+  if (m_dirty) {
+    transform();
+  }
+  lv_area_t coords;
+  lv_area_t clip;
+  lv_obj_get_coords(m_obj, &coords);
+  if (!_lv_area_intersect(&clip, clip_area, &coords)) {
+    return;
+  }
+  lv_coord_t cx = (coords.x1 + coords.x2) / 2;
+  lv_coord_t cy = (coords.y1 + coords.y2) / 2;
+
+  lv_draw_line_dsc_t line_dsc;
+  lv_draw_line_dsc_init(&line_dsc);
+  lv_obj_init_draw_line_dsc(m_obj, LV_OBJ_PART_MAIN, &line_dsc);
+  auto line = [&](const lv_point_t &a, const lv_point_t &b) {
+    lv_point_t p1 = { lv_coord_t(a.x + cx), lv_coord_t(a.y + cy) };
+    lv_point_t p2 = { lv_coord_t(b.x + cx), lv_coord_t(b.y + cy) };
+    lv_draw_line(&p1, &p2, &clip, &line_dsc);
+  };
+  for (size_t i = 0; i + 1 < m_points.size(); i += 2) {
+    line(m_points[i], m_points[i + 1]);
+  }
+  for (size_t i = 0; i + 1 < m_aircraft.size(); ++i) {
+    line(m_aircraft[i], m_aircraft[i + 1]);
+  }
+
+  lv_draw_label_dsc_t label_dsc;
+  lv_draw_label_dsc_init(&label_dsc);
+  lv_obj_init_draw_label_dsc(m_obj, LV_OBJ_PART_MAIN, &label_dsc);
+  label_dsc.flag = LV_TXT_FLAG_CENTER;
+  lv_coord_t half_height = lv_font_get_line_height(label_dsc.font) / 2;
+  for (size_t i = 0; i < m_label_points.size(); ++i) {
+    lv_area_t area;
+    area.x1 = cx + m_label_points[i].x - 20;
+    area.x2 = cx + m_label_points[i].x + 20;
+    area.y1 = cy + m_label_points[i].y - half_height;
+    area.y2 = cy + m_label_points[i].y + half_height;
+    lv_draw_label(&area, &clip, &label_dsc, m_label_text[i], NULL);
+  }
+}
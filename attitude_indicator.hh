@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+
+#include "lvgl/lvgl.h"
+
+// An artificial horizon with a pitch ladder, drawn directly with lines.
+// The ladder is laid out once, and a roll or pitch change only transforms its end points and
+// invalidates the widget, so redrawing it costs about the same at any attitude. The lines and
+// pitch labels use the line and text properties of the widget's style.
+class AttitudeIndicator {
+public:
+
+  // Draw the indicator in place of a (plain) object, which sets the area that it covers.
+  AttitudeIndicator(lv_obj_t *obj, float pixels_per_degree = 8);
+
+  // Roll and pitch in radians, as they are received from the flight controller.
+  void set_roll(float radians);
+  void set_pitch(float radians);
+
+private:
+
+  struct Segment {
+    float x1, y1, x2, y2;
+    float pitch;
+  };
+
+  struct Label {
+    float x, y;
+    float pitch;
+    char text[4];
+  };
+
+  static lv_design_res_t design_cb(lv_obj_t *obj, const lv_area_t *clip_area,
+                                   lv_design_mode_t mode);
+  void transform();
+  void draw(const lv_area_t *clip_area);
+
+  lv_obj_t *m_obj;
+  float m_pixels_per_degree;
+  float m_visible_pitch;
+  float m_roll;
+  float m_pitch;
+  bool m_dirty;
+  // The ladder with the horizon at the center, and its position at the current attitude.
+  std::vector<Segment> m_ladder;
+  std::vector<Label> m_labels;
+  std::vector<lv_point_t> m_points;
+  std::vector<lv_point_t> m_label_points;
+  std::vector<const char*> m_label_text;
+  // The aircraft symbol, which doesn't move.
+  std::vector<lv_point_t> m_aircraft;
+};
@@ -0,0 +1,93 @@
+
+// Compares the per pixel cost of LVGL's fill and blend loops (the portable C callbacks, which
+// do the same as LVGL's software renderer) with the SIMD callbacks.
+//
+//   blend_bench [width height [rounds]]
+//
+// Each round fills and blends a width x height area row by row, the way LVGL calls the
+// callbacks: an opaque fill, a blend with opacity onto an opaque screen, and the same onto a
+// transparent screen (like the OSD, which is mostly transparent with opaque labels).
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <vector>
+
+#include "simd_blend.h"
+
+static const simd_isa_t g_isas[] = { SIMD_ISA_NONE, SIMD_ISA_SSE2, SIMD_ISA_AVX2, SIMD_ISA_NEON };
+
+// The screen, with a transparent background and opaque stripes
+static void make_screen(std::vector<lv_color_t> &screen, int32_t width, bool transparent) {
+  for (size_t i = 0; i < screen.size(); ++i) {
+    bool opaque = !transparent || (((i % width) / 16) % 4 == 0);
+    screen[i].full = opaque ? (0xff000000 | (i * 2654435761u >> 8)) : 0;
+  }
+}
+
+int main(int argc, char **argv) {
+  int32_t width = (argc > 2) ? atoi(argv[1]) : 400;
+  int32_t height = (argc > 2) ? atoi(argv[2]) : 40;
+  int rounds = (argc > 3) ? atoi(argv[3]) : 2000;
+
+  std::vector<lv_color_t> screen(width * height);
+  std::vector<lv_color_t> image(width * height);
+  for (size_t i = 0; i < image.size(); ++i) {
+    image[i].full = 0xff000000 | (i * 40503u);
+  }
+  lv_area_t area = { 0, 0, lv_coord_t(width - 1), lv_coord_t(height - 1) };
+  lv_color_t color;
+  color.full = 0xff20c040;
+  double pixels = double(width) * height * rounds;
+
+  printf("%dx%d area, %d rounds, best: %s\n\n", width, height, rounds,
+         simd_isa_name(simd_best_isa()));
+  printf("%-6s %15s %15s %15s %15s\n", "", "fill", "blend", "blend transp", "copy");
+  double base[4] = { 0, 0, 0, 0 };
+  for (simd_isa_t isa : g_isas) {
+    lv_disp_drv_t drv = {};
+    if (!simd_set_callbacks(&drv, isa)) {
+      continue;
+    }
+    double ns[4];
+    for (int test = 0; test < 4; ++test) {
+      bool transparent = (test == 2);
+      lv_opa_t opa = (test == 3) ? LV_OPA_COVER : LV_OPA_50;
+#if LV_COLOR_SCREEN_TRANSP
+      drv.screen_transp = transparent;
+#endif
+      make_screen(screen, width, transparent);
+      double elapsed = 0;
+      for (int r = 0; r < rounds; ++r) {
+        // Blending changes the transparent pixels, so every round starts from the same screen
+        if (transparent) {
+          make_screen(screen, width, transparent);
+        }
+        auto start = std::chrono::steady_clock::now();
+        if (test == 0) {
+          drv.gpu_fill_cb(&drv, screen.data(), width, &area, color);
+        } else {
+          for (int32_t y = 0; y < height; ++y) {
+            drv.gpu_blend_cb(&drv, &screen[y * width], &image[y * width], width, opa);
+          }
+        }
+        auto end = std::chrono::steady_clock::now();
+        elapsed += std::chrono::duration<double, std::nano>(end - start).count();
+      }
+      ns[test] = elapsed / pixels;
+    }
+    if (isa == SIMD_ISA_NONE) {
+      for (int test = 0; test < 4; ++test) {
+        base[test] = ns[test];
+      }
+    }
+    printf("%-6s", simd_isa_name(isa));
+    for (int test = 0; test < 4; ++test) {
+      printf(" %6.3fns %4.1fx", ns[test], base[test] / ns[test]);
+    }
+    printf("\n");
+  }
+  printf("\n(ns per pixel, and the speedup over C)\n");
+  return 0;
+}
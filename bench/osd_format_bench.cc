@@ -0,0 +1,145 @@
+
+// Compares the OSD surface formats: the time LVGL's flush spends converting into each format,
+// and the memory and upload size of each.
+//
+//   osd_format_bench [width height [frames]]
+//
+// The OSD is synthetic, but like a real one: mostly transparent, with antialiased labels in a
+// few colors. A full frame is flushed in 120 line strips like the ffmpeg monitor does, and a
+// partial update redraws a few labels (a typical telemetry refresh).
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "osd_surface.hh"
+
+#if USE_FFMPEG_MONITOR
+
+// Normally looked up by egl_video.cc, and not needed without a GL context.
+PFNGLTEXSTORAGE2DPROC glTexStorage2D;
+PFNGLBUFFERSTORAGEPROC glBufferStorage;
+PFNGLMAPBUFFERRANGEPROC glMapBufferRange;
+PFNGLUNMAPBUFFERPROC glUnmapBuffer;
+PFNGLFENCESYNCPROC glFenceSync;
+PFNGLCLIENTWAITSYNCPROC glClientWaitSync;
+PFNGLDELETESYNCPROC glDeleteSync;
+
+#define STRIP_LINES 120
+
+static const struct {
+  OSDSurface::Format format;
+  const char *name;
+} g_formats[] = {
+  { OSDSurface::RGBA8888, "RGBA8888" },
+  { OSDSurface::ARGB4444, "ARGB4444" },
+  { OSDSurface::RGB565_A8, "RGB565+A8" },
+  { OSDSurface::PALETTE8, "palette" }
+};
+
+// The areas of the labels
+static std::vector<lv_area_t> make_labels(int32_t width, int32_t height) {
+  std::vector<lv_area_t> labels;
+  for (int32_t y = 20; y + 40 < height; y += 90) {
+    for (int32_t x = 20; x + 160 < width; x += 400) {
+      lv_area_t a = { lv_coord_t(x), lv_coord_t(y), lv_coord_t(x + 159), lv_coord_t(y + 39) };
+      labels.push_back(a);
+    }
+  }
+  return labels;
+}
+
+// Render the OSD in LVGL's format
+static std::vector<lv_color_t> make_osd(int32_t width, int32_t height,
+                                        const std::vector<lv_area_t> &labels) {
+  static const uint32_t colors[] = { 0xffffffff, 0xff00ff00, 0xffff0000, 0xffffff00 };
+  std::vector<lv_color_t> osd(width * height);
+  for (auto &c : osd) {
+    c.full = 0;
+  }
+  uint32_t n = 0;
+  for (const lv_area_t &a : labels) {
+    uint32_t color = colors[n++ % 4];
+    for (int32_t y = a.y1; y <= a.y2; ++y) {
+      for (int32_t x = a.x1; x <= a.x2; ++x) {
+        // stripes of glyphs with antialiased edges
+        uint32_t alpha = (((x / 3) % 4) == 0) ? 0 : (((x % 3) == 0) ? 0x80 : 0xff);
+        osd[y * width + x].full = alpha ? ((alpha << 24) | (color & 0xffffff)) : 0;
+      }
+    }
+  }
+  return osd;
+}
+
+// Flush an area of the OSD, the way LVGL hands it over (packed rows)
+static void flush(OSDSurface &surface, const std::vector<lv_color_t> &osd, int32_t width,
+                  const lv_area_t &area, std::vector<lv_color_t> &buf) {
+  int32_t w = lv_area_get_width(&area);
+  buf.resize(w * lv_area_get_height(&area));
+  for (int32_t y = area.y1; y <= area.y2; ++y) {
+    for (int32_t x = 0; x < w; ++x) {
+      buf[(y - area.y1) * w + x] = osd[y * width + area.x1 + x];
+    }
+  }
+  surface.write(&area, buf.data());
+}
+
+int main(int argc, char **argv) {
+  int32_t width = (argc > 2) ? atoi(argv[1]) : 1280;
+  int32_t height = (argc > 2) ? atoi(argv[2]) : 720;
+  int frames = (argc > 3) ? atoi(argv[3]) : 200;
+
+  std::vector<lv_area_t> labels = make_labels(width, height);
+  std::vector<lv_color_t> osd = make_osd(width, height, labels);
+  std::vector<lv_color_t> buf;
+  uint64_t label_pixels = 0;
+  for (const lv_area_t &a : labels) {
+    label_pixels += lv_area_get_width(&a) * lv_area_get_height(&a);
+  }
+
+  printf("%dx%d OSD, %zu labels, %d frames\n\n", width, height, labels.size(), frames);
+  printf("%-10s %8s %10s %12s %12s %12s %12s\n", "format", "bytes/px", "buffers", "full upload",
+         "full flush", "label upload", "label flush");
+  for (const auto &f : g_formats) {
+    OSDSurface surface(width, height, f.format);
+    double full_time = 0;
+    double label_time = 0;
+    for (int i = 0; i < frames; ++i) {
+      auto start = std::chrono::steady_clock::now();
+      for (int32_t y = 0; y < height; y += STRIP_LINES) {
+        lv_area_t strip = { 0, lv_coord_t(y), lv_coord_t(width - 1),
+                            lv_coord_t(std::min(y + STRIP_LINES, height) - 1) };
+        flush(surface, osd, width, strip, buf);
+      }
+      surface.publish();
+      auto middle = std::chrono::steady_clock::now();
+      for (const lv_area_t &a : labels) {
+        flush(surface, osd, width, a, buf);
+      }
+      surface.publish();
+      auto end = std::chrono::steady_clock::now();
+      full_time += std::chrono::duration<double>(middle - start).count();
+      label_time += std::chrono::duration<double>(end - middle).count();
+    }
+
+    // The time includes copying into the flush buffer, which is the same for every format
+    // (LVGL renders into it).
+    uint32_t bytes = surface.bytes_per_pixel();
+    printf("%-10s %8u %8.1fMB %10.2fMB %10.3fms %10.1fKB %10.3fms\n", f.name, bytes,
+           3.0 * width * height * bytes / 1e6, double(width) * height * bytes / 1e6,
+           full_time * 1e3 / frames, label_pixels * bytes / 1e3, label_time * 1e3 / frames);
+  }
+  return 0;
+}
+
+#else
+
+int main() {
+  fprintf(stderr, "The OSD surface is only built with USE_FFMPEG_MONITOR\n");
+  return 1;
+}
+
+#endif /* USE_FFMPEG_MONITOR */
@@ -0,0 +1,169 @@
+
+#include <string.h>
+
+#include "color_convert.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#if defined(__ARM_NEON)
+#define SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+// Only RGB565 has vector versions. They expand the channels like lv_color_to32() does
+// (r * 263 + 7) >> 5, which is exact in 16 bit lanes, and turn the chroma key into 0.
+#if LV_COLOR_DEPTH == 16 && LV_COLOR_16_SWAP == 0
+#define CONVERT_RGB565 1
+#endif
+
+typedef void (*convert_row_fn)(uint32_t *dst, const lv_color_t *src, uint32_t length);
+
+static void convert_row_c(uint32_t *dst, const lv_color_t *src, uint32_t length) {
+  for (uint32_t i = 0; i < length; ++i) {
+    dst[i] = color_convert_pixel(src[i]);
+  }
+}
+
+static convert_row_fn g_convert_row = convert_row_c;
+
+/**********************
+ *   SSE2 and AVX2
+ **********************/
+
+#if CONVERT_RGB565 && SIMD_X86
+
+// Expand 8 (or 16) RGB565 pixels into the low and high halves of the 32 bit pixels:
+// 0xGGBB and 0xAARR, with both 0 for the chroma key.
+TARGET_SSE2 static inline void expand_sse2(__m128i p, __m128i &lo, __m128i &hi) {
+  const __m128i mask5 = _mm_set1_epi16(0x1f);
+  __m128i r = _mm_srli_epi16(p, 11);
+  __m128i g = _mm_and_si128(_mm_srli_epi16(p, 5), _mm_set1_epi16(0x3f));
+  __m128i b = _mm_and_si128(p, mask5);
+  r = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(263)), _mm_set1_epi16(7)), 5);
+  g = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(g, _mm_set1_epi16(259)), _mm_set1_epi16(3)), 6);
+  b = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(263)), _mm_set1_epi16(7)), 5);
+  __m128i key = _mm_cmpeq_epi16(p, _mm_set1_epi16(short(LV_COLOR_TRANSP.full)));
+  lo = _mm_andnot_si128(key, _mm_or_si128(_mm_slli_epi16(g, 8), b));
+  hi = _mm_andnot_si128(key, _mm_or_si128(r, _mm_set1_epi16(short(0xff00))));
+}
+
+TARGET_SSE2 static void convert_row_sse2(uint32_t *dst, const lv_color_t *src,
+                                         uint32_t length) {
+  uint32_t i = 0;
+  for (; i + 8 <= length; i += 8) {
+    __m128i lo, hi;
+    expand_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)), lo, hi);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_unpacklo_epi16(lo, hi));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 4), _mm_unpackhi_epi16(lo, hi));
+  }
+  convert_row_c(dst + i, src + i, length - i);
+}
+
+TARGET_AVX2 static void convert_row_avx2(uint32_t *dst, const lv_color_t *src,
+                                         uint32_t length) {
+  const __m256i mask5 = _mm256_set1_epi16(0x1f);
+  const __m256i key = _mm256_set1_epi16(short(LV_COLOR_TRANSP.full));
+  uint32_t i = 0;
+  for (; i + 16 <= length; i += 16) {
+    __m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    __m256i r = _mm256_srli_epi16(p, 11);
+    __m256i g = _mm256_and_si256(_mm256_srli_epi16(p, 5), _mm256_set1_epi16(0x3f));
+    __m256i b = _mm256_and_si256(p, mask5);
+    r = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(263)),
+                                           _mm256_set1_epi16(7)), 5);
+    g = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(g, _mm256_set1_epi16(259)),
+                                           _mm256_set1_epi16(3)), 6);
+    b = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(b, _mm256_set1_epi16(263)),
+                                           _mm256_set1_epi16(7)), 5);
+    __m256i is_key = _mm256_cmpeq_epi16(p, key);
+    __m256i lo = _mm256_andnot_si256(is_key, _mm256_or_si256(_mm256_slli_epi16(g, 8), b));
+    __m256i hi = _mm256_andnot_si256(is_key,
+                                     _mm256_or_si256(r, _mm256_set1_epi16(short(0xff00))));
+    // The unpacks work within 128 bit lanes: pixels 0-3 and 8-11, then 4-7 and 12-15
+    __m256i a = _mm256_unpacklo_epi16(lo, hi);
+    __m256i c = _mm256_unpackhi_epi16(lo, hi);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_permute2x128_si256(a, c, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 8),
+                        _mm256_permute2x128_si256(a, c, 0x31));
+  }
+  convert_row_sse2(dst + i, src + i, length - i);
+}
+
+#endif /* CONVERT_RGB565 && SIMD_X86 */
+
+/**********************
+ *   NEON
+ **********************/
+
+#if CONVERT_RGB565 && SIMD_NEON
+
+static void convert_row_neon(uint32_t *dst, const lv_color_t *src, uint32_t length) {
+  uint32_t i = 0;
+  for (; i + 8 <= length; i += 8) {
+    uint16x8_t p = vld1q_u16(reinterpret_cast<const uint16_t*>(src + i));
+    uint16x8_t r = vshrq_n_u16(p, 11);
+    uint16x8_t g = vandq_u16(vshrq_n_u16(p, 5), vdupq_n_u16(0x3f));
+    uint16x8_t b = vandq_u16(p, vdupq_n_u16(0x1f));
+    r = vshrq_n_u16(vmlaq_n_u16(vdupq_n_u16(7), r, 263), 5);
+    g = vshrq_n_u16(vmlaq_n_u16(vdupq_n_u16(3), g, 259), 6);
+    b = vshrq_n_u16(vmlaq_n_u16(vdupq_n_u16(7), b, 263), 5);
+    uint16x8_t is_key = vceqq_u16(p, vdupq_n_u16(LV_COLOR_TRANSP.full));
+    uint16x8x2_t out;
+    out.val[0] = vbicq_u16(vorrq_u16(vshlq_n_u16(g, 8), b), is_key);
+    out.val[1] = vbicq_u16(vorrq_u16(r, vdupq_n_u16(0xff00)), is_key);
+    // Interleaving the halves makes the 32 bit pixels
+    vst2q_u16(reinterpret_cast<uint16_t*>(dst + i), out);
+  }
+  convert_row_c(dst + i, src + i, length - i);
+}
+
+#endif /* CONVERT_RGB565 && SIMD_NEON */
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+bool color_convert_set_isa(simd_isa_t isa) {
+  if (!simd_isa_supported(isa)) {
+    return false;
+  }
+  switch (isa) {
+#if CONVERT_RGB565 && SIMD_X86
+  case SIMD_ISA_SSE2:
+    g_convert_row = convert_row_sse2;
+    break;
+  case SIMD_ISA_AVX2:
+    g_convert_row = convert_row_avx2;
+    break;
+#endif
+#if CONVERT_RGB565 && SIMD_NEON
+  case SIMD_ISA_NEON:
+    g_convert_row = convert_row_neon;
+    break;
+#endif
+  default:
+    g_convert_row = convert_row_c;
+    break;
+  }
+  return true;
+}
+
+void color_convert_rows(uint32_t *dst, uint32_t dst_stride, const lv_color_t *src,
+                        uint32_t src_stride, uint32_t width, uint32_t height) {
+  if ((width == dst_stride) && (width == src_stride)) {
+    width *= height;
+    height = 1;
+  }
+  for (uint32_t y = 0; y < height; ++y, dst += dst_stride, src += src_stride) {
+#if LV_COLOR_DEPTH == 32 || LV_COLOR_DEPTH == 24
+    memcpy(dst, src, width * sizeof(uint32_t));
+#else
+    g_convert_row(dst, src, width);
+#endif
+  }
+}
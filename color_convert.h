@@ -0,0 +1,50 @@
+/**
+ * @file color_convert.h
+ *
+ */
+
+#ifndef COLOR_CONVERT_H
+#define COLOR_CONVERT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "lvgl/lvgl.h"
+#include "simd_blend.h"
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+/* Convert an LVGL color to a 32 bit one (0xAARRGGBB, like lv_color32_t). Below 32 bits
+ * there's no alpha channel, so the chroma key color (LV_COLOR_TRANSP) becomes transparent. */
+static inline uint32_t color_convert_pixel(lv_color_t c) {
+#if LV_COLOR_DEPTH == 32 || LV_COLOR_DEPTH == 24
+  return c.full;
+#else
+  return (c.full == LV_COLOR_TRANSP.full) ? 0 : lv_color_to32(c);
+#endif
+}
+
+/* Choose the instruction set of color_convert_rows() (portable C until it's called).
+ * Returns false if it isn't supported. */
+bool color_convert_set_isa(simd_isa_t isa);
+
+/* Convert `height` rows of `width` colors with color_convert_pixel(). The strides are in
+ * pixels. When both buffers' rows are contiguous (an area that spans the full width), they're
+ * converted in a single pass. 32 bit colors are only copied. */
+void color_convert_rows(uint32_t *dst, uint32_t dst_stride, const lv_color_t *src,
+                        uint32_t src_stride, uint32_t width, uint32_t height);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* COLOR_CONVERT_H */
@@ -0,0 +1,129 @@
+
+#include <string.h>
+
+#include <algorithm>
+
+#include <crsf_decoder.hh>
+
+// The frame addresses that precede telemetry frames.
+#define CRSF_ADDRESS_FLIGHT_CONTROLLER  0xC8
+#define CRSF_ADDRESS_RADIO_TRANSMITTER  0xEA
+#define CRSF_ADDRESS_RECEIVER           0xEC
+#define CRSF_ADDRESS_TRANSMITTER_MODULE 0xEE
+
+// The telemetry frame types.
+#define CRSF_FRAMETYPE_GPS              0x02
+#define CRSF_FRAMETYPE_VARIO            0x07
+#define CRSF_FRAMETYPE_BATTERY_SENSOR   0x08
+#define CRSF_FRAMETYPE_LINK_STATISTICS  0x14
+#define CRSF_FRAMETYPE_ATTITUDE         0x1E
+#define CRSF_FRAMETYPE_FLIGHT_MODE      0x21
+
+// The longest flight mode name that is shown (Betaflight and iNav use 4 or 5 characters)
+#define CRSF_MODE_LEN 16
+
+bool CRSFDecoder::parse(uint8_t c) {
+  switch (m_state) {
+  case ADDRESS:
+    if ((c == CRSF_ADDRESS_FLIGHT_CONTROLLER) || (c == CRSF_ADDRESS_RADIO_TRANSMITTER) ||
+        (c == CRSF_ADDRESS_RECEIVER) || (c == CRSF_ADDRESS_TRANSMITTER_MODULE)) {
+      m_state = LENGTH;
+    }
+    break;
+  case LENGTH:
+    // The length covers the type, payload and CRC.
+    if ((c >= 2) && (c <= sizeof(m_buf) - 2)) {
+      m_len = c;
+      m_idx = 0;
+      m_state = DATA;
+    } else {
+      m_state = ADDRESS;
+    }
+    break;
+  case DATA:
+    m_buf[m_idx++] = c;
+    if (m_idx == m_len) {
+      m_state = ADDRESS;
+      uint8_t crc = 0;
+      for (uint8_t i = 0; i < m_len - 1; ++i) {
+        crc = crc8_dvb_s2(crc, m_buf[i]);
+      }
+      if (crc == m_buf[m_len - 1]) {
+        handle_frame();
+        return true;
+      }
+    }
+    break;
+  }
+  return false;
+}
+
+void CRSFDecoder::reset() {
+  m_state = ADDRESS;
+  m_len = 0;
+  m_idx = 0;
+}
+
+void CRSFDecoder::handle_frame() {
+  uint8_t type = m_buf[0];
+  const uint8_t *p = m_buf + 1;
+  uint8_t len = m_len - 2;
+  switch (type) {
+  case CRSF_FRAMETYPE_GPS:
+    if (len >= 15) {
+      set_value("latitude", static_cast<int32_t>(read_be32(p)) * 1e-7);
+      set_value("longitude", static_cast<int32_t>(read_be32(p + 4)) * 1e-7);
+      // Ground speed is in 0.1 km/h
+      set_value("speed", read_be16(p + 8) / 36.0);
+      set_value("heading", read_be16(p + 10) / 100.0);
+      // Altitude has a 1000m offset.
+      set_value("altitude", static_cast<float>(read_be16(p + 12)) - 1000.0);
+      set_value("gps_num_sats", p[14]);
+    }
+    break;
+  case CRSF_FRAMETYPE_BATTERY_SENSOR:
+    if (len >= 8) {
+      set_value("voltage_battery", read_be16(p) / 10.0);
+      set_value("current_battery", read_be16(p + 2) / 10.0);
+      set_value("battery_remaining", p[7]);
+    }
+    break;
+  case CRSF_FRAMETYPE_LINK_STATISTICS:
+    if (len >= 10) {
+      // The uplink RSSI is sent as a positive number for the active antenna.
+      uint8_t rssi = (p[4] == 0) ? p[0] : p[1];
+      set_value("rc_rssi", -static_cast<float>(rssi));
+      set_value("rc_link_quality", p[2]);
+      set_value("tx_rssi", -static_cast<float>(p[7]));
+    }
+    break;
+  case CRSF_FRAMETYPE_ATTITUDE:
+    if (len >= 6) {
+      // Angles are in radians * 10000
+      set_value("pitch", static_cast<int16_t>(read_be16(p)) / 10000.0);
+      set_value("roll", static_cast<int16_t>(read_be16(p + 2)) / 10000.0);
+      set_value("yaw", static_cast<int16_t>(read_be16(p + 4)) / 10000.0);
+    }
+    break;
+  case CRSF_FRAMETYPE_FLIGHT_MODE: {
+    // The mode is a null terminated string, which Betaflight and iNav suffix with '*'
+    // while disarmed.
+    size_t mode_len = strnlen(reinterpret_cast<const char*>(p), len);
+    if (mode_len > 0) {
+      bool armed = (p[mode_len - 1] != '*');
+      set_value("armed", armed ? 1.0 : 0.0);
+      if (!armed) {
+        --mode_len;
+      }
+      char mode[CRSF_MODE_LEN];
+      mode_len = std::min(mode_len, sizeof(mode) - 1);
+      memcpy(mode, p, mode_len);
+      mode[mode_len] = '\0';
+      set_text("mode_name", mode);
+    }
+    break;
+  }
+  default:
+    break;
+  }
+}
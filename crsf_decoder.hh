@@ -0,0 +1,27 @@
+#pragma once
+
+#include <protocol_decoder.hh>
+
+// Decodes the Crossfire (CRSF) telemetry frames sent by Betaflight, iNav and ELRS receivers.
+// Frames are an address byte, a length byte, a type byte, the payload and a CRC8 (DVB-S2)
+// over the type and payload. Multi-byte values are big endian.
+class CRSFDecoder : public ProtocolDecoder {
+public:
+
+  CRSFDecoder(Telemetry &telem) : ProtocolDecoder(telem) { reset(); }
+
+  const char *name() const { return "CRSF"; }
+  bool parse(uint8_t c);
+  void reset();
+
+private:
+
+  enum State { ADDRESS, LENGTH, DATA };
+
+  void handle_frame();
+
+  State m_state;
+  uint8_t m_len;
+  uint8_t m_idx;
+  uint8_t m_buf[64];
+};
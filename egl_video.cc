@@ -1,5 +1,11 @@
 
+#include <algorithm>
+#include <string>
+
 #include "egl_video.hh"
+#include "logger.hh"
+#include "osd_tick.h"
+#include "frame_stats.h"
 
 #if USE_FFMPEG_MONITOR
 
@@ -16,18 +22,28 @@
 #define COMP_PROFILE_MAJOR_VERSION 3
 #define COMP_PROFILE_MINOR_VERSION 0
 
+// the OSD textures use this texture unit and the next two (after the video planes)
+#define OSD_TEXTURE_UNIT 2
+
 PFNEGLCREATEIMAGEKHRPROC eglCreateImageKHR;
 PFNEGLDESTROYIMAGEKHRPROC eglDestroyImageKHR;
 PFNGLEGLIMAGETARGETTEXTURE2DOESPROC glEGLImageTargetTexture2DOES;
 PFNGLGENVERTEXARRAYSPROC glGenVertexArrays;
 PFNGLBINDVERTEXARRAYPROC  glBindVertexArray;
+PFNGLTEXSTORAGE2DPROC glTexStorage2D;
+PFNGLBUFFERSTORAGEPROC glBufferStorage;
+PFNGLMAPBUFFERRANGEPROC glMapBufferRange;
+PFNGLUNMAPBUFFERPROC glUnmapBuffer;
+PFNGLFENCESYNCPROC glFenceSync;
+PFNGLCLIENTWAITSYNCPROC glClientWaitSync;
+PFNGLDELETESYNCPROC glDeleteSync;
 
 EGLVideo::EGLVideo(uint32_t width, uint32_t height,
-                   const uint32_t *osd_fb, uint32_t osd_width, int32_t osd_height,
+                   OSDSurface *osd,
                    std::function<void(uint32_t, uint32_t)> resize_cb) :
   m_good(false), m_width(width), m_height(height), m_resize_cb(resize_cb), m_running(true),
   m_texture_size_valid(false), m_texcoord_x1(1.0f), m_texcoord_y1(1.0f),
-  m_osd_fb(osd_fb), m_osd_width(osd_width), m_osd_height(osd_height) {
+  m_osd(osd) {
 
   // Connect to X11
   m_x_display = XOpenDisplay(NULL);
@@ -100,9 +116,9 @@ EGLVideo::EGLVideo(uint32_t width, uint32_t height,
   eglSwapInterval(m_egl_display, SWAP_INTERVAL);
 
   // dump OpenGL configuration (for reference)
-  printf("OpenGL vendor:   %s\n", glGetString(GL_VENDOR));
-  printf("OpenGL renderer: %s\n", glGetString(GL_RENDERER));
-  printf("OpenGL version:  %s\n", glGetString(GL_VERSION));
+  LOG_INFO("OpenGL vendor:   %s", reinterpret_cast<const char*>(glGetString(GL_VENDOR)));
+  LOG_INFO("OpenGL renderer: %s", reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+  LOG_INFO("OpenGL version:  %s", reinterpret_cast<const char*>(glGetString(GL_VERSION)));
 
   // look up required EGL and OpenGL extension functions
 #define LOOKUP_FUNCTION(type, func)                     \
@@ -113,6 +129,15 @@ EGLVideo::EGLVideo(uint32_t width, uint32_t height,
   LOOKUP_FUNCTION(PFNGLEGLIMAGETARGETTEXTURE2DOESPROC, glEGLImageTargetTexture2DOES);
   LOOKUP_FUNCTION(PFNGLGENVERTEXARRAYSPROC, glGenVertexArrays);
   LOOKUP_FUNCTION(PFNGLBINDVERTEXARRAYPROC, glBindVertexArray);
+  // optional (GL 4.2), otherwise the OSD texture is allocated with glTexImage2D
+  glTexStorage2D = (PFNGLTEXSTORAGE2DPROC)eglGetProcAddress("glTexStorage2D");
+  // optional (GL 4.4), for rendering the OSD directly into a mapped pixel buffer
+  glBufferStorage = (PFNGLBUFFERSTORAGEPROC)eglGetProcAddress("glBufferStorage");
+  glMapBufferRange = (PFNGLMAPBUFFERRANGEPROC)eglGetProcAddress("glMapBufferRange");
+  glUnmapBuffer = (PFNGLUNMAPBUFFERPROC)eglGetProcAddress("glUnmapBuffer");
+  glFenceSync = (PFNGLFENCESYNCPROC)eglGetProcAddress("glFenceSync");
+  glClientWaitSync = (PFNGLCLIENTWAITSYNCPROC)eglGetProcAddress("glClientWaitSync");
+  glDeleteSync = (PFNGLDELETESYNCPROC)eglGetProcAddress("glDeleteSync");
 
   // OpenGL shader setup
 #define DECLARE_YUV2RGB_MATRIX_GLSL                     \
@@ -121,9 +146,9 @@ EGLVideo::EGLVideo(uint32_t width, uint32_t height,
     "    vec4(  0.0000, -0.2132,  2.1124,  0.0000 ),\n" \
     "    vec4(  1.7927, -0.5329,  0.0000,  0.0000 ),\n" \
     "    vec4( -0.9729,  0.3015, -1.1334,  1.0000 ));"
-  GLuint vao;                   // OpenGL Core Profile requires
-  glGenVertexArrays(1, &vao);   // using VAOs even in trivial cases,
-  glBindVertexArray(vao);       // so let's set up a dummy VAO
+  glGenVertexArrays(1, &m_vao);   // OpenGL Core Profile requires
+  glBindVertexArray(m_vao);       // using VAOs even in trivial cases,
+                                  // so let's set up a dummy VAO
   const char *vs_src =
     "#version 130"
     "\n" "const vec2 coords[4] = vec2[]( vec2(0.,0.), vec2(1.,0.), vec2(0.,1.), vec2(1.,1.) );"
@@ -134,15 +159,39 @@ EGLVideo::EGLVideo(uint32_t width, uint32_t height,
     "\n" "  vTexCoord = c * uTexCoordScale;"
     "\n" "  gl_Position = vec4(c * vec2(2.,-2.) + vec2(-1.,1.), 0., 1.);"
     "\n" "}";
-  const char *fs_src =
+  // the OSD color comes from a function that expands the OSD surface's format
+  std::string fs_str =
     "#version 130"
     "\n" "in vec2 vTexCoord;"
-    "\n" "uniform sampler2D uTexY, uTexC, uTexO;"
+    "\n" "uniform sampler2D uTexY, uTexC, uTexO, uTexA, uPalette;"
     "\n" DECLARE_YUV2RGB_MATRIX_GLSL
+    "\n";
+  fs_str += OSDSurface::shader(m_osd ? m_osd->format() : OSDSurface::RGBA8888);
+  // When the OSD is scaled up, an unsharp mask restores the edges that the bilinear filter
+  // blurs. It works on premultiplied colors, so the transparent pixels around the text don't
+  // darken it.
+  fs_str +=
+    "\n" "uniform vec2 uOsdTexel;"
+    "\n" "uniform float uSharpen;"
+    "\n" "vec4 osd_premul(vec2 c) {"
+    "\n" "  vec4 o = osd_color(c);"
+    "\n" "  return vec4(o.rgb * o.a, o.a);"
+    "\n" "}"
+    "\n" "vec4 osd_sharp(vec2 c) {"
+    "\n" "  if (uSharpen <= 0.) {"
+    "\n" "    return osd_color(c);"
+    "\n" "  }"
+    "\n" "  vec4 o = osd_premul(c);"
+    "\n" "  vec4 blur = (osd_premul(c - uOsdTexel) + osd_premul(c + uOsdTexel) +"
+    "\n" "              osd_premul(c + vec2(uOsdTexel.x, -uOsdTexel.y)) +"
+    "\n" "              osd_premul(c + vec2(-uOsdTexel.x, uOsdTexel.y))) * 0.25;"
+    "\n" "  o = clamp(o + (o - blur) * uSharpen, 0., 1.);"
+    "\n" "  return (o.a > 0.) ? vec4(min(o.rgb / o.a, 1.), o.a) : vec4(0.);"
+    "\n" "}"
     "\n" "out vec4 oColor;"
     "\n" "vec4 ovColor, vColor;"
     "\n" "void main() {"
-    "\n" "  ovColor = texture(uTexO, vTexCoord).zyxw;"
+    "\n" "  ovColor = osd_sharp(vTexCoord);"
     "\n" "  vColor = yuv2rgb * vec4(texture(uTexY, vTexCoord).x, texture(uTexC, vTexCoord).xy, 1);"
     "\n" "  if (ovColor.w > 0) {"
     "\n" "    oColor = ovColor;"
@@ -160,6 +209,7 @@ EGLVideo::EGLVideo(uint32_t width, uint32_t height,
     return; // Fail!
   }
   glShaderSource(m_vs, 1, &vs_src, NULL);
+  const char *fs_src = fs_str.c_str();
   glShaderSource(m_fs, 1, &fs_src, NULL);
   GLint ok;
   while (glGetError()) {}
@@ -183,7 +233,10 @@ EGLVideo::EGLVideo(uint32_t width, uint32_t height,
   glUseProgram(m_prog);
   glUniform1i(glGetUniformLocation(m_prog, "uTexY"), 0);
   glUniform1i(glGetUniformLocation(m_prog, "uTexC"), 1);
-  glUniform1i(glGetUniformLocation(m_prog, "uTexO"), 2);
+  glUniform1i(glGetUniformLocation(m_prog, "uTexO"), OSD_TEXTURE_UNIT);
+  glUniform1i(glGetUniformLocation(m_prog, "uTexA"), OSD_TEXTURE_UNIT + 1);
+  glUniform1i(glGetUniformLocation(m_prog, "uPalette"), OSD_TEXTURE_UNIT + 2);
+  update_sharpening();
 
   // OpenGL texture setup
   glGenTextures(3, m_textures);
@@ -194,7 +247,30 @@ EGLVideo::EGLVideo(uint32_t width, uint32_t height,
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
   }
-  glBindTexture(GL_TEXTURE_2D, 0);
+
+  // the OSD surface has its own textures (otherwise the third texture stays transparent)
+  if (m_osd && !m_osd->create_textures(OSD_TEXTURE_UNIT)) {
+    return; // Fail!
+  } else if (!m_osd) {
+    const uint32_t transparent = 0;
+    glBindTexture(GL_TEXTURE_2D, m_textures[2]);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, &transparent);
+    glBindTexture(GL_TEXTURE_2D, 0);
+  }
+#if MONITOR_DIRECT_RENDER
+  if (m_osd && !m_osd->map_buffers()) {
+    LOG_INFO("Direct rendering isn't available, the OSD will be copied");
+  }
+#endif
+
+  // the HUD pass draws the fast moving OSD elements over the video
+  if (!m_osd || !m_hud.init(m_osd->width(), m_osd->height())) {
+    LOG_WARN("The GPU HUD is disabled, the OSD draws the attitude and compass");
+  } else {
+    hud_state().set_active(true);
+  }
+  glUseProgram(m_prog);
+  glBindVertexArray(m_vao);
 
   // initial window size setup
   GLint vp[4];
@@ -204,6 +280,10 @@ EGLVideo::EGLVideo(uint32_t width, uint32_t height,
 }
 
 EGLVideo::~EGLVideo() {
+  hud_state().set_active(false);
+  if (m_osd) {
+    m_osd->unmap_buffers();
+  }
   eglMakeCurrent(m_egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
   eglDestroyContext(m_egl_display, m_egl_context);
   eglDestroySurface(m_egl_display, m_egl_surface);
@@ -234,9 +314,10 @@ bool EGLVideo::poll_events() {
       }
       break;
     case ConfigureNotify:
+      m_width = ((XConfigureEvent*)&ev)->width;
+      m_height = ((XConfigureEvent*)&ev)->height;
+      update_sharpening();
       if (m_resize_cb) {
-        m_width = ((XConfigureEvent*)&ev)->width;
-        m_height = ((XConfigureEvent*)&ev)->height;
         m_resize_cb(m_width, m_height);
       }
       break;
@@ -248,6 +329,21 @@ bool EGLVideo::poll_events() {
   return m_running;
 }
 
+void EGLVideo::update_sharpening() {
+  // Sharpen more the more the OSD is scaled up. The palette indices aren't filtered, so there's
+  // nothing to restore.
+  float upscale = m_osd ? float(m_width) / m_osd->width() : 1;
+  float sharpen = std::min(std::max((upscale - 1) * 0.5f, 0.0f), 1.0f);
+  if (!m_osd || (m_osd->format() == OSDSurface::PALETTE8)) {
+    sharpen = 0;
+  }
+  glUniform1f(glGetUniformLocation(m_prog, "uSharpen"), sharpen);
+  if (m_osd) {
+    glUniform2f(glGetUniformLocation(m_prog, "uOsdTexel"), 1.0 / m_osd->width(),
+                1.0 / m_osd->height());
+  }
+}
+
 void EGLVideo::resize_texture(float x, float y) {
   if (!m_texture_size_valid) {
     m_texcoord_x1 = x;
@@ -258,6 +354,7 @@ void EGLVideo::resize_texture(float x, float y) {
 }
 
 bool EGLVideo::draw_frame(EGLint img_attrs[2][13]) {
+  uint64_t start_us = osd_time_us();
 
   EGLImage images[2];
   for (uint8_t i = 0; i < 2; i++) {
@@ -276,11 +373,13 @@ bool EGLVideo::draw_frame(EGLint img_attrs[2][13]) {
     }
   }
 
-  glActiveTexture(GL_TEXTURE0 + 2);
-  glBindTexture(GL_TEXTURE_2D, m_textures[2]);
   while (glGetError()) {}
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_osd_width, m_osd_height, 0, GL_RGBA,
-               GL_UNSIGNED_BYTE, m_osd_fb);
+  if (m_osd) {
+    m_osd->upload();
+  } else {
+    glActiveTexture(GL_TEXTURE0 + OSD_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, m_textures[2]);
+  }
   if (glGetError()) {
     m_good = false;
     return false;
@@ -294,12 +393,16 @@ bool EGLVideo::draw_frame(EGLint img_attrs[2][13]) {
     m_good = false;
     return false;
   }
+  m_hud.draw();
+  glUseProgram(m_prog);
+  glBindVertexArray(m_vao);
 
   // display the frame
   eglSwapBuffers(m_egl_display, m_egl_surface);
+  frame_stats_present(start_us, osd_time_us());
 
   // clean up the interop images
-  for (int i = 0;  i < 3;  ++i) {
+  for (int i = 0;  i < OSD_TEXTURE_UNIT + 3;  ++i) {
     glActiveTexture(GL_TEXTURE0 + i);
     glBindTexture(GL_TEXTURE_2D, 0);
   }
@@ -17,11 +17,14 @@
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
 
+#include "gpu_hud.hh"
+#include "osd_surface.hh"
+
 class EGLVideo {
 public:
 
   EGLVideo(uint32_t width, uint32_t height,
-           const uint32_t *osd_fb=0, uint32_t osd_width=0, int32_t osd_height=0,
+           OSDSurface *osd=0,
            std::function<void(uint32_t, uint32_t)> resize_cb = 0);
   ~EGLVideo();
   bool good() { return m_good; }
@@ -30,6 +33,10 @@ public:
   bool draw_frame(EGLint img_attrs[2][13]);
 
 private:
+
+  // Set the OSD sharpening for the current window size
+  void update_sharpening();
+
   bool m_good;
   uint32_t m_width;
   uint32_t m_height;
@@ -43,14 +50,14 @@ private:
   float m_texcoord_x1;
   float m_texcoord_y1;
   GLuint m_prog;
+  GLuint m_vao;
   GLuint m_vs;
   GLuint m_fs;
   GLuint m_textures[3];
   EGLContext m_egl_context;
   EGLSurface m_egl_surface;
-  const uint32_t *m_osd_fb;
-  uint32_t m_osd_width;
-  int32_t m_osd_height;
+  OSDSurface *m_osd;
+  GPUHud m_hud;
 };
 
 #endif /* USE_FFMPEG_MONITOR */
@@ -0,0 +1,67 @@
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "event_loop.hh"
+#include "logger.hh"
+
+EventLoop::EventLoop() {
+  m_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  m_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if ((m_event_fd < 0) || (m_timer_fd < 0)) {
+    LOG_ERROR("Error creating the main loop event descriptors: %s", strerror(errno));
+  }
+}
+
+EventLoop::~EventLoop() {
+  if (m_event_fd >= 0) {
+    close(m_event_fd);
+  }
+  if (m_timer_fd >= 0) {
+    close(m_timer_fd);
+  }
+}
+
+void EventLoop::notify() {
+  uint64_t val = 1;
+  if (write(m_event_fd, &val, sizeof(val)) < 0) {
+    LOG_WARN("Error waking up the main loop: %s", strerror(errno));
+  }
+}
+
+void EventLoop::wait(uint32_t timeout_ms) {
+  if (timeout_ms == 0) {
+    return;
+  }
+
+  // Arm (or disarm) the timer for the next deadline.
+  struct itimerspec ts;
+  memset(&ts, 0, sizeof(ts));
+  if (timeout_ms != UINT32_MAX) {
+    ts.it_value.tv_sec = timeout_ms / 1000;
+    ts.it_value.tv_nsec = (timeout_ms % 1000) * 1000000L;
+  }
+  timerfd_settime(m_timer_fd, 0, &ts, NULL);
+
+  struct pollfd fds[2];
+  fds[0].fd = m_event_fd;
+  fds[0].events = POLLIN;
+  fds[1].fd = m_timer_fd;
+  fds[1].events = POLLIN;
+  if (poll(fds, 2, -1) < 0) {
+    return;
+  }
+
+  // Reset whichever descriptors fired.
+  uint64_t val;
+  if ((fds[0].revents & POLLIN) && (read(m_event_fd, &val, sizeof(val)) < 0)) {
+    return;
+  }
+  if ((fds[1].revents & POLLIN) && (read(m_timer_fd, &val, sizeof(val)) < 0)) {
+    return;
+  }
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+
+// Blocks the main loop until there is something to do: either another thread calls notify()
+// (e.g. a telemetry value changed), or the timeout expires (the next LVGL task is due).
+// The wakeups come from an eventfd and a timerfd, so an idle OSD doesn't poll.
+class EventLoop {
+public:
+
+  EventLoop();
+  ~EventLoop();
+
+  // Wake up the loop. Safe to call from any thread.
+  void notify();
+
+  // Wait for a notification, or until timeout_ms milliseconds have passed.
+  // A timeout of UINT32_MAX waits for a notification only.
+  void wait(uint32_t timeout_ms);
+
+private:
+  int m_event_fd;
+  int m_timer_fd;
+};
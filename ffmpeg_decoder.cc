@@ -2,6 +2,7 @@
 
 #include "egl_video.hh"
 #include "ffmpeg_decoder.hh"
+#include "logger.hh"
 #if USE_FFMPEG_MONITOR
 
 #include <stdbool.h>
@@ -80,7 +81,7 @@ FFMPEGDecoder::FFMPEGDecoder(const char *url, const char *drm_node) :
   if (avcodec_open2(m_decoder_ctx, m_decoder, NULL) < 0) {
     return; // Fail!
   }
-  printf("Opened input video stream: %dx%d\n", m_decoder_ctx->width, m_decoder_ctx->height);
+  LOG_INFO("Opened input video stream: %dx%d", m_decoder_ctx->width, m_decoder_ctx->height);
 
   // allocate AVFrame for display
   m_frame = av_frame_alloc();
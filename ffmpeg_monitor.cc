@@ -12,8 +12,16 @@
 
 #include "egl_video.hh"
 #include "ffmpeg_decoder.hh"
+#include "osd_surface.hh"
+#include "color_convert.h"
+#include "simd_blend.h"
+#include "logger.hh"
 
+#include <math.h>
+
+#include <algorithm>
 #include <iostream>
+#include <memory>
 #include <thread>
 #include <vector>
 
@@ -33,24 +41,40 @@
 #define MONITOR_VER_RES        LV_VER_RES
 #endif
 
+#ifndef MONITOR_OSD_FORMAT
+#define MONITOR_OSD_FORMAT     0
+#endif
+
+#ifndef MONITOR_OSD_SCALE
+#define MONITOR_OSD_SCALE      1.0
+#endif
+
+// The OSD resolution if the video can't be opened
+#define MONITOR_DEFAULT_HOR_RES 1280
+#define MONITOR_DEFAULT_VER_RES 720
+
+// The lines in LVGL's own draw buffer, when it isn't rendering directly into the pixel buffer
+#define MONITOR_DRAW_LINES     120
+
 /**********************
  *      TYPEDEFS
  **********************/
 
 typedef struct {
-  std::shared_ptr<std::thread> tick_thread;
+  std::shared_ptr<FFMPEGDecoder> decoder;
   std::shared_ptr<std::thread> decode_thread;
-  volatile bool sdl_refr_qry;
-#if MONITOR_DOUBLE_BUFFERED
-  uint32_t * tft_fb_act;
-#else
-  uint32_t tft_fb[LV_HOR_RES_MAX * LV_VER_RES_MAX];
-#endif
+  std::shared_ptr<OSDSurface> osd;
+  std::vector<lv_color_t> draw_buf;
+  lv_disp_buf_t disp_buf;
+  lv_disp_t *disp;
 } monitor_t;
 
 /**********************
  *  STATIC PROTOTYPES
  **********************/
+#if MONITOR_DIRECT_RENDER
+static void monitor_direct_task(lv_task_t *task);
+#endif
 
 /***********************
  *   GLOBAL PROTOTYPES
@@ -74,36 +98,59 @@ static monitor_t monitor;
  */
 void monitor_init(const char *url) {
 
+  // Open the video first, since the OSD resolution follows it
+  monitor.decoder = std::make_shared<FFMPEGDecoder>(url);
+  float width = monitor.decoder->width();
+  float height = monitor.decoder->height();
+  if ((width == 0) || (height == 0)) {
+    LOG_ERROR("Error opening the video, using the default OSD resolution");
+    width = MONITOR_DEFAULT_HOR_RES;
+    height = MONITOR_DEFAULT_VER_RES;
+  }
+
+  // LVGL renders at the reduced OSD resolution (keeping the aspect ratio within LVGL's
+  // maximum), and the video thread scales it up
+  float scale = std::min<float>({ MONITOR_OSD_SCALE, LV_HOR_RES_MAX / width,
+                                  LV_VER_RES_MAX / height });
+  lv_coord_t hor_res = static_cast<lv_coord_t>(lroundf(width * scale));
+  lv_coord_t ver_res = static_cast<lv_coord_t>(lroundf(height * scale));
+  LOG_INFO("OSD resolution: %dx%d", hor_res, ver_res);
+
   // Create a display buffer
-  static lv_disp_buf_t disp_buf1;
-  static lv_color_t buf1_1[LV_HOR_RES_MAX * 120];
-  lv_disp_buf_init(&disp_buf1, buf1_1, NULL, LV_HOR_RES_MAX * 120);
+  monitor.draw_buf.resize(hor_res * MONITOR_DRAW_LINES);
+  lv_disp_buf_init(&monitor.disp_buf, monitor.draw_buf.data(), NULL, monitor.draw_buf.size());
 
   // Create a display
   lv_disp_drv_t disp_drv;
   // Basic initialization
   lv_disp_drv_init(&disp_drv);
-  disp_drv.buffer = &disp_buf1;
+  disp_drv.buffer = &monitor.disp_buf;
   disp_drv.flush_cb = monitor_flush;
-  lv_disp_drv_register(&disp_drv);
+  disp_drv.hor_res = hor_res;
+  disp_drv.ver_res = ver_res;
+  // LVGL's fills and blends, with the fastest instruction set that the CPU has
+  simd_isa_t isa = simd_best_isa();
+  if (simd_set_callbacks(&disp_drv, isa)) {
+    LOG_INFO("Blending the OSD with %s", simd_isa_name(isa));
+  }
+  // and the conversion of its colors in the flush (below 32 bit colors)
+  color_convert_set_isa(isa);
+  monitor.disp = lv_disp_drv_register(&disp_drv);
+
+  // The framebuffer that LVGL draws into, and the video thread uploads from
+  monitor.osd = std::make_shared<OSDSurface>(MONITOR_HOR_RES, MONITOR_VER_RES,
+                                             OSDSurface::Format(MONITOR_OSD_FORMAT));
+#if MONITOR_DIRECT_RENDER
+  // Switches to direct rendering once the video thread has mapped the pixel buffer
+  lv_task_create(monitor_direct_task, 100, LV_TASK_PRIO_LOW, NULL);
+#endif
 
   // video display loop
   monitor.decode_thread = std::make_shared<std::thread>
-    ([url] () {
-       FFMPEGDecoder decoder(url);
-       EGLVideo win(decoder.width(), decoder.height(),
-                    monitor.tft_fb, MONITOR_HOR_RES, MONITOR_VER_RES);
-       decoder.decode(win);
-     });
-
-  // The LVGL tick thread
-  monitor.tick_thread = std::make_shared<std::thread>
     ([] () {
-       while (1) {
-         // Sleep for 5ms, and tell LittelvGL that 5ms were elapsed
-         std::this_thread::sleep_for(std::chrono::milliseconds(5));
-         lv_tick_inc(5);
-       }
+       FFMPEGDecoder &decoder = *monitor.decoder;
+       EGLVideo win(decoder.width(), decoder.height(), monitor.osd.get());
+       decoder.decode(win);
      });
 }
 
@@ -114,63 +161,36 @@ void monitor_init(const char *url) {
  * @param color_p an array of pixel to copy to the `area` part of the screen
  */
 void monitor_flush(lv_disp_drv_t * disp_drv, const lv_area_t * area, lv_color_t * color_p) {
-  lv_coord_t hres = disp_drv->rotated == 0 ? disp_drv->hor_res : disp_drv->ver_res;
-  lv_coord_t vres = disp_drv->rotated == 0 ? disp_drv->ver_res : disp_drv->hor_res;
-
-  //    printf("x1:%d,y1:%d,x2:%d,y2:%d\n", area->x1, area->y1, area->x2, area->y2);
-
-  /*Return if the area is out the screen*/
-  if(area->x2 < 0 || area->y2 < 0 || area->x1 > hres - 1 || area->y1 > vres - 1) {
-    lv_disp_flush_ready(disp_drv);
-    return;
-  }
 
-#if MONITOR_DOUBLE_BUFFERED
-  monitor.tft_fb_act = (uint32_t *)color_p;
-
-  monitor.sdl_refr_qry = true;
-
-  /*IMPORTANT! It must be called to tell the system the flush is ready*/
-  lv_disp_flush_ready(disp_drv);
-#else
-
-  int32_t y;
-#if LV_COLOR_DEPTH != 24 && LV_COLOR_DEPTH != 32    /*32 is valid but support 24 for backward compatibility too*/
-  int32_t x;
-  for(y = area->y1; y <= area->y2 && y < disp_drv->ver_res; y++) {
-    for(x = area->x1; x <= area->x2; x++) {
-      monitor.tft_fb[y * disp_drv->hor_res + x] = lv_color_to32(*color_p);
-      color_p++;
+  if (monitor.osd->direct()) {
+    // LVGL rendered the whole frame into the back buffer, so hand over the areas it redrew.
+    for (uint16_t i = 0; i < monitor.disp->inv_p; ++i) {
+      if (!monitor.disp->inv_area_joined[i]) {
+        monitor.osd->add_area(&monitor.disp->inv_areas[i]);
+      }
+    }
+    monitor.osd->publish();
+
+    // LVGL switches to buf2 after the flush, and copies the redrawn areas into it.
+    disp_drv->buffer->buf1 = color_p;
+    disp_drv->buffer->buf2 = monitor.osd->back_buffer();
+  } else {
+    // Copy the area into the back buffer, and hand the frame to the video thread once LVGL
+    // has drawn all of it
+    monitor.osd->write(area, color_p);
+    if (lv_disp_flush_is_last(disp_drv)) {
+      monitor.osd->publish();
     }
-
-  }
-#else
-  uint32_t w = lv_area_get_width(area);
-  for(y = area->y1; y <= area->y2 && y < disp_drv->ver_res; y++) {
-    memcpy(&monitor.tft_fb[y * MONITOR_HOR_RES + area->x1], color_p, w * sizeof(lv_color_t));
-    color_p += w;
-  }
-#endif
-
-  monitor.sdl_refr_qry = true;
-
-  /* TYPICALLY YOU DO NOT NEED THIS
-   * If it was the last part to refresh update the texture of the window.*/
-/*
-  if(lv_disp_flush_is_last(disp_drv)) {
-    monitor_sdl_refr(NULL);
   }
-*/
 
   /*IMPORTANT! It must be called to tell the system the flush is ready*/
   lv_disp_flush_ready(disp_drv);
-#endif
 }
 
 
 // exit with a simple error message
 void fail(const char *msg) {
-  fprintf(stderr, "\nERROR: %s failed\n", msg);
+  LOG_ERROR("%s failed", msg);
   exit(1);
 }
 
@@ -179,4 +199,28 @@ void fail(const char *msg) {
  *   STATIC FUNCTIONS
  **********************/
 
+#if MONITOR_DIRECT_RENDER
+/**
+ * Switch LVGL between its own draw buffer and the mapped pixel buffer
+ * @param task pointer to the task
+ */
+static void monitor_direct_task(lv_task_t *task) {
+  if (!monitor.osd->update_direct()) {
+    return;
+  }
+  if (monitor.osd->direct()) {
+    // Two screen sized buffers make LVGL render in place ("true double buffering").
+    // buf2 is replaced by the next back buffer at every flush.
+    lv_color_t *buf = monitor.osd->back_buffer();
+    lv_disp_buf_init(&monitor.disp_buf, buf, buf, MONITOR_HOR_RES * MONITOR_VER_RES);
+    LOG_INFO("Rendering the OSD directly into the pixel buffer");
+  } else {
+    lv_disp_buf_init(&monitor.disp_buf, monitor.draw_buf.data(), NULL, monitor.draw_buf.size());
+  }
+
+  // Neither buffer has the current OSD
+  lv_obj_invalidate(lv_scr_act());
+}
+#endif
+
 #endif
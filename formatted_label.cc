@@ -0,0 +1,87 @@
+
+#include <math.h>
+#include <string.h>
+
+#include "formatted_label.hh"
+
+LabelText &LabelText::str(const char *s) {
+  while (*s && (m_len < LABEL_TEXT_LEN - 1)) {
+    m_buf[m_len++] = *s++;
+  }
+  m_buf[m_len] = '\0';
+  return *this;
+}
+
+LabelText &LabelText::ch(char c) {
+  if (m_len < LABEL_TEXT_LEN - 1) {
+    m_buf[m_len++] = c;
+    m_buf[m_len] = '\0';
+  }
+  return *this;
+}
+
+LabelText &LabelText::num(int32_t value, int width) {
+  char tmp[12];
+  int n = 0;
+  uint32_t v = (value < 0) ? -static_cast<uint32_t>(value) : value;
+  do {
+    tmp[n++] = '0' + (v % 10);
+    v /= 10;
+  } while (v);
+  if (value < 0) {
+    tmp[n++] = '-';
+  }
+  append_reversed(tmp, n, width);
+  return *this;
+}
+
+LabelText &LabelText::fixed(float value, int decimals, int width) {
+  static const double scale[] = { 1, 10, 100, 1000, 10000 };
+  decimals = (decimals < 0) ? 0 : (decimals > 4) ? 4 : decimals;
+
+  // Anything that can't be represented is shown as dashes.
+  double scaled = fabs(static_cast<double>(value)) * scale[decimals];
+  if (!isfinite(scaled) || (scaled >= 1e15)) {
+    append_reversed("---", 3, width);
+    return *this;
+  }
+
+  char tmp[24];
+  int n = 0;
+  uint64_t v = static_cast<uint64_t>(scaled + 0.5);
+  for (int i = 0; i < decimals; ++i) {
+    tmp[n++] = '0' + (v % 10);
+    v /= 10;
+  }
+  if (decimals) {
+    tmp[n++] = '.';
+  }
+  do {
+    tmp[n++] = '0' + (v % 10);
+    v /= 10;
+  } while (v);
+  if ((value < 0) && (scaled >= 0.5)) {
+    tmp[n++] = '-';
+  }
+  append_reversed(tmp, n, width);
+  return *this;
+}
+
+void LabelText::append_reversed(const char *tmp, int len, int width) {
+  for (int i = len; (i < width) && (m_len < LABEL_TEXT_LEN - 1); ++i) {
+    m_buf[m_len++] = ' ';
+  }
+  while ((len > 0) && (m_len < LABEL_TEXT_LEN - 1)) {
+    m_buf[m_len++] = tmp[--len];
+  }
+  m_buf[m_len] = '\0';
+}
+
+bool FormattedLabel::set(const LabelText &text) {
+  if (strcmp(text.c_str(), m_text) == 0) {
+    return false;
+  }
+  strcpy(m_text, text.c_str());
+  lv_label_set_text_static(m_label, m_text);
+  return true;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "lvgl/lvgl.h"
+
+// The maximum length of the text of a formatted label.
+#define LABEL_TEXT_LEN 32
+
+// Builds the text of a label in a fixed size buffer, without printf or any allocation.
+// Text that doesn't fit is truncated.
+class LabelText {
+public:
+
+  LabelText() : m_len(0) { m_buf[0] = '\0'; }
+
+  LabelText &str(const char *s);
+  LabelText &ch(char c);
+
+  // An integer, right aligned in a field of the given width.
+  LabelText &num(int32_t value, int width = 0);
+
+  // A fixed point number with the given number of decimal places (at most 4),
+  // right aligned in a field of the given width (like "%<width>.<decimals>f").
+  LabelText &fixed(float value, int decimals, int width = 0);
+
+  const char *c_str() const { return m_buf; }
+
+private:
+
+  // Append the digits in tmp (least significant first), padded to the width.
+  void append_reversed(const char *tmp, int len, int width);
+
+  char m_buf[LABEL_TEXT_LEN];
+  int m_len;
+};
+
+// A label that keeps its own copy of its text and only passes the text to LVGL when it
+// changes. The text is set with lv_label_set_text_static, so LVGL doesn't allocate a copy.
+class FormattedLabel {
+public:
+
+  FormattedLabel(lv_obj_t *label) : m_label(label) { m_text[0] = '\0'; }
+
+  // Returns true if the text changed.
+  bool set(const LabelText &text);
+
+  lv_obj_t *obj() const { return m_label; }
+
+private:
+  lv_obj_t *m_label;
+  char m_text[LABEL_TEXT_LEN];
+};
@@ -0,0 +1,139 @@
+
+#include <math.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include "frame_governor.hh"
+#include "osd_tick.h"
+#include "logger.hh"
+
+// The time over which the measurements are collected before the rates are adjusted (seconds).
+#define GOVERNOR_WINDOW 0.5
+// A video frame is late if the time since the previous frame is this much longer than average.
+#define LATE_FRAME_FACTOR 1.5
+// Longer gaps between frames (microseconds) are stream stalls rather than late frames.
+#define MAX_FRAME_GAP_US 1000000
+// The fraction of late frames in a window that slows the OSD down.
+#define LATE_FRAME_LIMIT 0.05
+// The number of windows without late frames before the OSD is sped up again.
+#define RECOVERY_WINDOWS 4
+// The OSD isn't refreshed faster than the video frame rate, unless the video is slower than
+// this (milliseconds).
+#define MAX_VIDEO_INTERVAL 100
+
+// The OSD refresh period (milliseconds) and widget update budget (seconds) for each level.
+static const uint32_t g_refresh_periods[] = { LV_DISP_DEF_REFR_PERIOD, 40, 60, 100, 150 };
+static const double g_update_budgets[] = { 0.004, 0.003, 0.002, 0.0015, 0.001 };
+static const int g_nlevels = sizeof(g_refresh_periods) / sizeof(g_refresh_periods[0]);
+
+// Written by the video thread, and collected by the governor.
+static std::atomic<uint32_t> g_present_frames(0);
+static std::atomic<uint32_t> g_present_late(0);
+static std::atomic<uint64_t> g_present_time_us(0);
+static std::atomic<uint32_t> g_frame_interval_us(0);
+
+// Written by the display driver callbacks, which run on the main thread like the governor.
+static void (*g_flush_cb)(lv_disp_drv_t*, const lv_area_t*, lv_color_t*) = NULL;
+static uint32_t g_refreshes = 0;
+static uint32_t g_render_ms = 0;
+static uint64_t g_flush_us = 0;
+
+void frame_stats_present(uint64_t start_us, uint64_t end_us) {
+  // Only used by the video thread.
+  static uint64_t last_end_us = 0;
+  static double interval_avg = 0;
+
+  if (last_end_us) {
+    uint64_t interval = end_us - last_end_us;
+    if (interval < MAX_FRAME_GAP_US) {
+      if ((interval_avg > 0) && (interval > LATE_FRAME_FACTOR * interval_avg)) {
+        ++g_present_late;
+      }
+      interval_avg = (interval_avg > 0) ? (0.95 * interval_avg + 0.05 * interval) : interval;
+      g_frame_interval_us = static_cast<uint32_t>(interval_avg);
+    }
+  }
+  last_end_us = end_us;
+  g_present_time_us += end_us - start_us;
+  ++g_present_frames;
+}
+
+static float round_ms(double ms) {
+  return roundf(ms * 10.0) / 10.0;
+}
+
+FrameGovernor::FrameGovernor(lv_disp_t *disp, BindingTable &bindings, Telemetry &telem) :
+  m_disp(disp), m_bindings(bindings), m_telem(telem), m_window_start(-1), m_level(0),
+  m_calm_windows(0), m_period_ms(0) {
+  g_flush_cb = disp->driver.flush_cb;
+  disp->driver.flush_cb = flush_cb;
+  disp->driver.monitor_cb = monitor_cb;
+  apply(0);
+}
+
+void FrameGovernor::monitor_cb(lv_disp_drv_t *, uint32_t time, uint32_t) {
+  ++g_refreshes;
+  g_render_ms += time;
+}
+
+void FrameGovernor::flush_cb(lv_disp_drv_t *drv, const lv_area_t *area, lv_color_t *color_p) {
+  uint64_t start = osd_time_us();
+  g_flush_cb(drv, area, color_p);
+  g_flush_us += osd_time_us() - start;
+}
+
+void FrameGovernor::update(double time) {
+  if (m_window_start < 0) {
+    m_window_start = time;
+    return;
+  }
+  if ((time - m_window_start) < GOVERNOR_WINDOW) {
+    return;
+  }
+  m_window_start = time;
+
+  uint32_t frames = g_present_frames.exchange(0);
+  uint32_t late = g_present_late.exchange(0);
+  uint64_t present_us = g_present_time_us.exchange(0);
+  uint32_t interval_us = g_frame_interval_us;
+  uint32_t refreshes = g_refreshes;
+  uint32_t render_ms = g_render_ms;
+  uint64_t flush_us = g_flush_us;
+  g_refreshes = 0;
+  g_render_ms = 0;
+  g_flush_us = 0;
+
+  // Slowing the OSD down only helps the video if the OSD is actually rendering.
+  if ((refreshes > 0) && (late > LATE_FRAME_LIMIT * frames)) {
+    m_calm_windows = 0;
+    m_level = std::min(m_level + 1, g_nlevels - 1);
+  } else if ((m_level > 0) && (++m_calm_windows >= RECOVERY_WINDOWS)) {
+    m_calm_windows = 0;
+    --m_level;
+  }
+  apply(interval_us / 1000);
+
+  m_telem.set_metric("osd_refresh_period", m_period_ms);
+  m_telem.set_metric("osd_update_budget", round_ms(g_update_budgets[m_level] * 1e3));
+  m_telem.set_metric("osd_render_time", round_ms(refreshes ? double(render_ms) / refreshes : 0));
+  m_telem.set_metric("osd_flush_time", round_ms(refreshes ? flush_us * 1e-3 / refreshes : 0));
+  m_telem.set_metric("video_present_time", round_ms(frames ? present_us * 1e-3 / frames : 0));
+  m_telem.set_metric("video_frame_interval", round_ms(interval_us * 1e-3));
+  m_telem.set_metric("video_late_frames", late);
+}
+
+void FrameGovernor::apply(uint32_t video_interval_ms) {
+  m_bindings.set_frame_budget(g_update_budgets[m_level]);
+
+  // Refreshing the OSD more often than the video frames are presented is wasted effort.
+  uint32_t period = std::max(g_refresh_periods[m_level],
+                             std::min(video_interval_ms, static_cast<uint32_t>(MAX_VIDEO_INTERVAL)));
+  if (period == m_period_ms) {
+    return;
+  }
+  LOG_DEBUG("OSD refresh period %u ms (level %d)", period, m_level);
+  m_period_ms = period;
+  lv_task_set_period(m_disp->refr_task, period);
+  m_bindings.set_frame_period(period * 1e-3);
+}
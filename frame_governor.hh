@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "lvgl/lvgl.h"
+#include "osd_bindings.hh"
+#include "telemetry.hh"
+#include "frame_stats.h"
+
+// Keeps the OSD from delaying the video.
+// The LVGL render and flush times are measured through the display driver callbacks, and the
+// video present times are reported by the monitor through frame_stats_present(). When video
+// frames are presented late while the OSD is rendering, the OSD refresh period is lengthened
+// and the widget update budget is reduced, one level at a time, and they are restored again
+// once the video has been on time for a while.
+//
+// The chosen rates and the measured times are published as telemetry metrics
+// (osd_refresh_period, osd_update_budget, osd_render_time, osd_flush_time,
+// video_present_time, video_frame_interval, video_late_frames).
+//
+// There can only be one governor, as it hooks the callbacks of the display driver.
+class FrameGovernor {
+public:
+
+  FrameGovernor(lv_disp_t *disp, BindingTable &bindings, Telemetry &telem);
+
+  // Called from the main loop; the measurements are evaluated once per window.
+  void update(double time);
+
+  // The current OSD refresh period (milliseconds).
+  uint32_t refresh_period() const { return m_period_ms; }
+
+  // How far the OSD has been slowed down (0 = full rate).
+  int level() const { return m_level; }
+
+private:
+
+  static void monitor_cb(lv_disp_drv_t *drv, uint32_t time, uint32_t px);
+  static void flush_cb(lv_disp_drv_t *drv, const lv_area_t *area, lv_color_t *color_p);
+
+  void apply(uint32_t video_interval_ms);
+
+  lv_disp_t *m_disp;
+  BindingTable &m_bindings;
+  Telemetry &m_telem;
+  double m_window_start;
+  int m_level;
+  int m_calm_windows;
+  uint32_t m_period_ms;
+};
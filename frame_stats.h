@@ -0,0 +1,23 @@
+/**
+ * @file frame_stats.h
+ *
+ */
+
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Report a presented video frame: start_us and end_us (from osd_time_us()) bracket the
+ * texture upload, draw and swap. Called from the video thread, read by the FrameGovernor. */
+void frame_stats_present(uint64_t start_us, uint64_t end_us);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* FRAME_STATS_H */
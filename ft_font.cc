@@ -0,0 +1,153 @@
+
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+
+#include "ft_font.hh"
+#include "logger.hh"
+
+#if USE_FFMPEG_MONITOR
+
+// The memory for the rendered glyphs of each font (a digit at 40 pixels is about 800 bytes).
+#ifndef FT_FONT_CACHE_BYTES
+#define FT_FONT_CACHE_BYTES (64 * 1024)
+#endif
+
+#define FT_FONT_PREWARM "0123456789.-+ "
+
+static FT_Library library() {
+  static FT_Library lib = NULL;
+  if (!lib && FT_Init_FreeType(&lib)) {
+    LOG_ERROR("Error initializing FreeType");
+    lib = NULL;
+  }
+  return lib;
+}
+
+const lv_font_t *FTFont::get(const std::string &path, uint32_t size) {
+  static std::map<std::pair<std::string, uint32_t>, std::unique_ptr<FTFont>> fonts;
+  auto key = std::make_pair(path, size);
+  auto fi = fonts.find(key);
+  if (fi != fonts.end()) {
+    return &fi->second->m_font;
+  }
+
+  FT_Library lib = library();
+  FT_Face face;
+  if (!lib || FT_New_Face(lib, path.c_str(), 0, &face)) {
+    LOG_ERROR("Error loading the font: %s", path.c_str());
+    return NULL;
+  }
+  if (FT_Set_Pixel_Sizes(face, 0, size)) {
+    LOG_ERROR("The font %s can't be used at %u pixels", path.c_str(), size);
+    FT_Done_Face(face);
+    return NULL;
+  }
+  FTFont *font = new FTFont(face, size);
+  fonts[key].reset(font);
+  font->prewarm(FT_FONT_PREWARM);
+  LOG_INFO("Loaded the font %s at %u pixels", path.c_str(), size);
+  return &font->m_font;
+}
+
+FTFont::FTFont(FT_Face face, uint32_t size) : m_face(face), m_cache_bytes(0) {
+  memset(&m_font, 0, sizeof(m_font));
+  m_font.get_glyph_dsc = get_glyph_dsc;
+  m_font.get_glyph_bitmap = get_glyph_bitmap;
+  // The line height and the base line (from the bottom of the line) in whole pixels
+  lv_coord_t ascender = (face->size->metrics.ascender + 63) >> 6;
+  lv_coord_t descender = (-face->size->metrics.descender + 63) >> 6;
+  m_font.line_height = ascender + descender;
+  m_font.base_line = descender;
+  if (m_font.line_height <= 0) {
+    m_font.line_height = size;
+  }
+  m_font.underline_position = face->underline_position * int32_t(size) / face->units_per_EM;
+  m_font.underline_thickness = std::max(1, face->underline_thickness * int32_t(size) /
+                                        face->units_per_EM);
+  m_font.dsc = this;
+}
+
+FTFont::~FTFont() {
+  FT_Done_Face(m_face);
+}
+
+void FTFont::prewarm(const char *text) {
+  uint32_t i = 0;
+  while (text[i] != '\0') {
+    glyph(_lv_txt_encoded_next(text, &i));
+  }
+}
+
+bool FTFont::get_glyph_dsc(const lv_font_t *font, lv_font_glyph_dsc_t *dsc, uint32_t letter,
+                           uint32_t letter_next) {
+  FTFont *ft = static_cast<FTFont*>(font->dsc);
+  const Glyph *g = ft->glyph(letter);
+  if (!g) {
+    return false;
+  }
+  *dsc = g->dsc;
+  if (letter_next && FT_HAS_KERNING(ft->m_face)) {
+    FT_Vector kerning;
+    if (!FT_Get_Kerning(ft->m_face, FT_Get_Char_Index(ft->m_face, letter),
+                        FT_Get_Char_Index(ft->m_face, letter_next), FT_KERNING_DEFAULT,
+                        &kerning)) {
+      dsc->adv_w += kerning.x >> 6;
+    }
+  }
+  return true;
+}
+
+const uint8_t *FTFont::get_glyph_bitmap(const lv_font_t *font, uint32_t letter) {
+  // LVGL asks for the bitmap right after the descriptor, so it's at the front of the cache.
+  const Glyph *g = static_cast<FTFont*>(font->dsc)->glyph(letter);
+  return (g && !g->bitmap.empty()) ? g->bitmap.data() : NULL;
+}
+
+const FTFont::Glyph *FTFont::glyph(uint32_t letter) {
+  auto gi = m_index.find(letter);
+  if (gi != m_index.end()) {
+    m_lru.splice(m_lru.begin(), m_lru, gi->second);
+    return &m_lru.front();
+  }
+
+  FT_UInt index = FT_Get_Char_Index(m_face, letter);
+  if (!index || FT_Load_Glyph(m_face, index, FT_LOAD_RENDER | FT_LOAD_TARGET_NORMAL)) {
+    return NULL;
+  }
+  FT_GlyphSlot slot = m_face->glyph;
+  const FT_Bitmap &bm = slot->bitmap;
+  if (bm.pixel_mode != FT_PIXEL_MODE_GRAY) {
+    return NULL;
+  }
+
+  Glyph g;
+  g.letter = letter;
+  memset(&g.dsc, 0, sizeof(g.dsc));
+  g.dsc.adv_w = (slot->advance.x + 32) >> 6;
+  g.dsc.box_w = bm.width;
+  g.dsc.box_h = bm.rows;
+  g.dsc.ofs_x = slot->bitmap_left;
+  g.dsc.ofs_y = slot->bitmap_top - int32_t(bm.rows);
+  g.dsc.bpp = 8;
+  // LVGL expects the rows without padding
+  g.bitmap.resize(bm.width * bm.rows);
+  for (uint32_t y = 0; y < bm.rows; ++y) {
+    memcpy(&g.bitmap[y * bm.width], bm.buffer + y * bm.pitch, bm.width);
+  }
+
+  // Make room in the cache, but always keep the new glyph
+  m_cache_bytes += sizeof(Glyph) + g.bitmap.size();
+  while (!m_lru.empty() && (m_cache_bytes > FT_FONT_CACHE_BYTES)) {
+    m_cache_bytes -= sizeof(Glyph) + m_lru.back().bitmap.size();
+    m_index.erase(m_lru.back().letter);
+    m_lru.pop_back();
+  }
+  m_lru.push_front(std::move(g));
+  m_index[letter] = m_lru.begin();
+  return &m_lru.front();
+}
+
+#endif /* USE_FFMPEG_MONITOR */
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "ffmpeg_monitor.h"
+#if USE_FFMPEG_MONITOR
+
+#include <stdint.h>
+
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include "lvgl/lvgl.h"
+
+// An LVGL font that FreeType renders at runtime, so any font file can be used at any size
+// without compiling it in. The glyphs are rendered on first use into an LRU cache with a
+// fixed memory budget (outside of LVGL's heap). The digits are rendered when the font is
+// loaded, since the telemetry labels need them on the first refresh.
+class FTFont {
+public:
+
+  // A font file at a pixel size, loaded on first use and shared after that.
+  // Returns NULL if the file can't be loaded.
+  static const lv_font_t *get(const std::string &path, uint32_t size);
+
+  ~FTFont();
+
+  // Render the glyphs of a (UTF-8) text into the cache.
+  void prewarm(const char *text);
+
+private:
+
+  struct Glyph {
+    uint32_t letter;
+    lv_font_glyph_dsc_t dsc;
+    std::vector<uint8_t> bitmap;
+  };
+
+  FTFont(FT_Face face, uint32_t size);
+
+  static bool get_glyph_dsc(const lv_font_t *font, lv_font_glyph_dsc_t *dsc, uint32_t letter,
+                            uint32_t letter_next);
+  static const uint8_t *get_glyph_bitmap(const lv_font_t *font, uint32_t letter);
+
+  // The cached glyph, rendering it (and evicting the least recently used) if needed.
+  const Glyph *glyph(uint32_t letter);
+
+  FT_Face m_face;
+  lv_font_t m_font;
+  size_t m_cache_bytes;
+  // Most recently used first
+  std::list<Glyph> m_lru;
+  std::unordered_map<uint32_t, std::list<Glyph>::iterator> m_index;
+};
+
+#endif /* USE_FFMPEG_MONITOR */
@@ -0,0 +1,322 @@
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+
+#include "gpu_hud.hh"
+#include "logger.hh"
+
+#if USE_FFMPEG_MONITOR
+
+// Looked up from EGL in egl_video.cc
+extern PFNGLGENVERTEXARRAYSPROC glGenVertexArrays;
+extern PFNGLBINDVERTEXARRAYPROC glBindVertexArray;
+
+// The width of the lines and their dark outline (layout pixels, see HudState::scale())
+#define LINE_HALF_WIDTH 1.5f
+// The number of floats per vertex: segment end points, quad corner, group
+#define VERTEX_SIZE 7
+
+// The ladder has a rung every 10 degrees of pitch, and the heading tape shows 100 degrees with
+// a tick every 5 degrees and a number every 30.
+#define LADDER_STEP 10
+#define LADDER_MAX 90
+#define TAPE_RANGE 100.0f
+#define TAPE_TICK 5
+#define TAPE_LABEL 30
+
+// The seven segment digits (bits a to g), and the end points of each segment as
+// (column, row) in a 2x3 grid.
+static const uint8_t g_digit_segments[10] =
+  { 0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07, 0x7F, 0x6F };
+static const uint8_t g_segment_points[7][4] = {
+  { 0, 0, 1, 0 }, { 1, 0, 1, 1 }, { 1, 1, 1, 2 }, { 0, 2, 1, 2 },
+  { 0, 1, 0, 2 }, { 0, 0, 0, 1 }, { 0, 1, 1, 1 }
+};
+
+// Each segment is drawn as a quad around the line, which is shaded from the distance to the line.
+static const char *g_vs_src =
+  "#version 130"
+  "\n" "in vec4 aSeg;"
+  "\n" "in vec2 aCorner;"
+  "\n" "in float aGroup;"
+  "\n" "uniform vec2 uScreen;"
+  "\n" "uniform vec4 uXform[5];"
+  "\n" "uniform vec2 uPre[5];"
+  "\n" "uniform float uHalfWidth;"
+  "\n" "out vec2 vPos;"
+  "\n" "flat out vec4 vSeg;"
+  "\n" "flat out int vGroup;"
+  "\n" "void main() {"
+  "\n" "  int g = int(aGroup);"
+  "\n" "  vec4 x = uXform[g];"
+  "\n" "  mat2 r = mat2(x.x, -x.y, x.y, x.x);"
+  "\n" "  vec2 a = r * (aSeg.xy + uPre[g]) + x.zw;"
+  "\n" "  vec2 b = r * (aSeg.zw + uPre[g]) + x.zw;"
+  "\n" "  vec2 d = b - a;"
+  "\n" "  float len = length(d);"
+  "\n" "  vec2 dir = (len > 0.) ? d / len : vec2(1., 0.);"
+  "\n" "  vec2 n = vec2(-dir.y, dir.x);"
+  "\n" "  float e = uHalfWidth * 2. + 2.;"
+  "\n" "  vec2 p = ((aCorner.x < 0.) ? (a - dir * e) : (b + dir * e)) + n * aCorner.y * e;"
+  "\n" "  vPos = p;"
+  "\n" "  vSeg = vec4(a, b);"
+  "\n" "  vGroup = g;"
+  "\n" "  gl_Position = vec4(p / uScreen * vec2(2., -2.) + vec2(-1., 1.), 0., 1.);"
+  "\n" "}";
+static const char *g_fs_src =
+  "#version 130"
+  "\n" "in vec2 vPos;"
+  "\n" "flat in vec4 vSeg;"
+  "\n" "flat in int vGroup;"
+  "\n" "uniform vec4 uClip[5];"
+  "\n" "uniform vec4 uColor;"
+  "\n" "uniform float uHalfWidth;"
+  "\n" "out vec4 oColor;"
+  "\n" "void main() {"
+  "\n" "  vec4 c = uClip[vGroup];"
+  "\n" "  if ((vPos.x < c.x) || (vPos.y < c.y) || (vPos.x > c.z) || (vPos.y > c.w)) discard;"
+  "\n" "  vec2 pa = vPos - vSeg.xy;"
+  "\n" "  vec2 ba = vSeg.zw - vSeg.xy;"
+  "\n" "  float h = clamp(dot(pa, ba) / max(dot(ba, ba), 1e-6), 0., 1.);"
+  "\n" "  float d = length(pa - ba * h) - uHalfWidth;"
+  "\n" "  float px = max(fwidth(vPos.x), 1e-3);"
+  "\n" "  float line = clamp(0.5 - d / px, 0., 1.);"
+  "\n" "  float outline = clamp(0.5 - (d - uHalfWidth) / px, 0., 1.);"
+  "\n" "  if (outline <= 0.) discard;"
+  "\n" "  oColor = vec4(uColor.rgb * line, outline) * uColor.a;"
+  "\n" "}";
+
+static GLuint compile_shader(GLenum type, const char *src) {
+  GLuint shader = glCreateShader(type);
+  if (!shader) {
+    return 0;
+  }
+  glShaderSource(shader, 1, &src, NULL);
+  glCompileShader(shader);
+  GLint ok;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+  if (ok != GL_TRUE) {
+    char log[512];
+    glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+    LOG_ERROR("Error compiling the HUD shader: %s", log);
+    glDeleteShader(shader);
+    return 0;
+  }
+  return shader;
+}
+
+GPUHud::GPUHud() :
+  m_good(false), m_built(false), m_osd_width(0), m_osd_height(0), m_prog(0), m_vao(0),
+  m_vbo(0), m_ibo(0), m_screen_loc(-1), m_xform_loc(-1), m_pre_loc(-1), m_clip_loc(-1),
+  m_color_loc(-1), m_width_loc(-1) {}
+
+bool GPUHud::init(float osd_width, float osd_height) {
+  m_osd_width = osd_width;
+  m_osd_height = osd_height;
+
+  GLuint vs = compile_shader(GL_VERTEX_SHADER, g_vs_src);
+  GLuint fs = compile_shader(GL_FRAGMENT_SHADER, g_fs_src);
+  if (!vs || !fs) {
+    return false;
+  }
+  m_prog = glCreateProgram();
+  glAttachShader(m_prog, vs);
+  glAttachShader(m_prog, fs);
+  glBindAttribLocation(m_prog, 0, "aSeg");
+  glBindAttribLocation(m_prog, 1, "aCorner");
+  glBindAttribLocation(m_prog, 2, "aGroup");
+  glLinkProgram(m_prog);
+  glDeleteShader(vs);
+  glDeleteShader(fs);
+  GLint ok;
+  glGetProgramiv(m_prog, GL_LINK_STATUS, &ok);
+  if (ok != GL_TRUE) {
+    LOG_ERROR("Error linking the HUD shaders");
+    return false;
+  }
+  m_screen_loc = glGetUniformLocation(m_prog, "uScreen");
+  m_xform_loc = glGetUniformLocation(m_prog, "uXform");
+  m_pre_loc = glGetUniformLocation(m_prog, "uPre");
+  m_clip_loc = glGetUniformLocation(m_prog, "uClip");
+  m_color_loc = glGetUniformLocation(m_prog, "uColor");
+  m_width_loc = glGetUniformLocation(m_prog, "uHalfWidth");
+
+  glGenVertexArrays(1, &m_vao);
+  glGenBuffers(1, &m_vbo);
+  glGenBuffers(1, &m_ibo);
+  m_good = true;
+  return true;
+}
+
+void GPUHud::add_segment(Group group, float x0, float y0, float x1, float y1) {
+  static const float corners[4][2] = { { -1, -1 }, { 1, -1 }, { -1, 1 }, { 1, 1 } };
+  GLushort base = m_vertices.size() / VERTEX_SIZE;
+  for (int i = 0; i < 4; ++i) {
+    m_vertices.insert(m_vertices.end(),
+                      { x0, y0, x1, y1, corners[i][0], corners[i][1], float(group) });
+  }
+  m_indices.insert(m_indices.end(), { base, GLushort(base + 1), GLushort(base + 2),
+                                      GLushort(base + 2), GLushort(base + 1),
+                                      GLushort(base + 3) });
+}
+
+void GPUHud::add_number(Group group, int value, float x, float y, float height) {
+  char digits[12];
+  int n = snprintf(digits, sizeof(digits), "%d", abs(value));
+  float w = height * 0.5;
+  float advance = w + height * 0.3;
+  float left = x - (n * advance - height * 0.3) / 2;
+  float top = y - height / 2;
+  float half = height / 2;
+  for (int i = 0; i < n; ++i, left += advance) {
+    uint8_t segs = g_digit_segments[digits[i] - '0'];
+    for (int j = 0; j < 7; ++j) {
+      if (segs & (1 << j)) {
+        const uint8_t *p = g_segment_points[j];
+        add_segment(group, left + p[0] * w, top + p[1] * half, left + p[2] * w, top + p[3] * half);
+      }
+    }
+  }
+}
+
+void GPUHud::build(const HudState &state) {
+  // The attitude indicator, centered on its area with the horizon at the center
+  float w = state.attitude_area().width;
+  float ppd = state.pixels_per_degree();
+  float px = state.scale();
+  for (float side : { -1.0f, 1.0f }) {
+    add_segment(ATTITUDE, side * 0.25f * w, 0, side * 0.45f * w, 0);
+  }
+  for (int pitch = -LADDER_MAX; pitch <= LADDER_MAX; pitch += LADDER_STEP) {
+    if (pitch == 0) {
+      continue;
+    }
+    float y = -pitch * ppd;
+    float tick = ((pitch > 0) ? 1 : -1) * 0.02f * w;
+    for (float side : { -1.0f, 1.0f }) {
+      float inner = side * 0.10f * w;
+      float outer = side * 0.22f * w;
+      if (pitch > 0) {
+        add_segment(ATTITUDE, inner, y, outer, y);
+      } else {
+        float dash = (outer - inner) / 3;
+        add_segment(ATTITUDE, inner, y, inner + dash, y);
+        add_segment(ATTITUDE, outer - dash, y, outer, y);
+      }
+      add_segment(ATTITUDE, outer, y, outer, y + tick);
+      add_number(ATTITUDE, pitch, side * 0.29f * w, y, 12 * px);
+    }
+  }
+  float wing = 0.20f * w;
+  float center = 0.06f * w;
+  add_segment(AIRCRAFT, -wing, 0, -center, 0);
+  add_segment(AIRCRAFT, -center, 0, 0, center);
+  add_segment(AIRCRAFT, 0, center, center, 0);
+  add_segment(AIRCRAFT, center, 0, wing, 0);
+
+  // The heading tape, from the top center of its area. It covers one and a half turns, so
+  // the tape is full at any heading.
+  const HudRect &tape = state.heading_area();
+  float hppd = tape.width / TAPE_RANGE;
+  for (int h = -180; h < 540; h += TAPE_TICK) {
+    float x = h * hppd;
+    float len = ((h % 10) == 0) ? 0.35f : 0.2f;
+    add_segment(HEADING, x, tape.height, x, tape.height * (1 - len));
+    if ((h % TAPE_LABEL) == 0) {
+      add_number(HEADING, (h + 360) % 360, x, tape.height * 0.3f, tape.height * 0.35f);
+    }
+  }
+  add_segment(HEADING_POINTER, -6 * px, tape.height + 10 * px, 0, tape.height + 2 * px);
+  add_segment(HEADING_POINTER, 0, tape.height + 2 * px, 6 * px, tape.height + 10 * px);
+
+  // The home arrow, pointing up at the center of its area
+  float s = 0.25f * std::min(state.home_area().width, state.home_area().height);
+  add_segment(HOME, 0, -s, 0.6f * s, 0.6f * s);
+  add_segment(HOME, 0.6f * s, 0.6f * s, 0, 0.25f * s);
+  add_segment(HOME, 0, 0.25f * s, -0.6f * s, 0.6f * s);
+  add_segment(HOME, -0.6f * s, 0.6f * s, 0, -s);
+
+  glBindVertexArray(m_vao);
+  glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+  glBufferData(GL_ARRAY_BUFFER, m_vertices.size() * sizeof(GLfloat), m_vertices.data(),
+               GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_indices.size() * sizeof(GLushort), m_indices.data(),
+               GL_STATIC_DRAW);
+  const GLsizei stride = VERTEX_SIZE * sizeof(GLfloat);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, stride, (const void*)0);
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (const void*)(4 * sizeof(GLfloat)));
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, stride, (const void*)(6 * sizeof(GLfloat)));
+  LOG_DEBUG("Built the HUD from %d segments", static_cast<int>(m_indices.size() / 6));
+  m_built = true;
+}
+
+void GPUHud::draw() {
+  const HudState &state = hud_state();
+  if (!m_good || !state.enabled()) {
+    return;
+  }
+  if (!m_built) {
+    build(state);
+  }
+
+  GLfloat xform[NGROUPS][4];
+  GLfloat pre[NGROUPS][2] = {};
+  GLfloat clip[NGROUPS][4];
+  auto set = [&](Group g, float angle, float x, float y, const HudRect &area, float below) {
+    xform[g][0] = cos(angle);
+    xform[g][1] = sin(angle);
+    xform[g][2] = x;
+    xform[g][3] = y;
+    clip[g][0] = area.x;
+    clip[g][1] = area.y;
+    clip[g][2] = area.x + area.width;
+    clip[g][3] = area.y + area.height + below;
+  };
+
+  // Rolling right turns the horizon counter-clockwise, and pitching up moves it down.
+  const HudRect &att = state.attitude_area();
+  float att_x = att.x + att.width / 2;
+  float att_y = att.y + att.height / 2;
+  set(ATTITUDE, state.roll(), att_x, att_y, att, 0);
+  pre[ATTITUDE][1] = state.pitch() * 180.0 / M_PI * state.pixels_per_degree();
+  set(AIRCRAFT, 0, att_x, att_y, att, 0);
+
+  const HudRect &tape = state.heading_area();
+  float heading = fmod(state.heading(), 360.0f);
+  if (heading < 0) {
+    heading += 360.0;
+  }
+  set(HEADING, 0, tape.x + tape.width / 2, tape.y, tape, 0);
+  pre[HEADING][0] = -heading * tape.width / TAPE_RANGE;
+  set(HEADING_POINTER, 0, tape.x + tape.width / 2, tape.y, tape, 12 * state.scale());
+
+  // The home arrow turns clockwise, and is hidden until the direction is known.
+  const HudRect &home = state.home_area();
+  set(HOME, -state.home_direction() * M_PI / 180.0, home.x + home.width / 2,
+      home.y + home.height / 2, home, 0);
+  if (!state.home_valid()) {
+    clip[HOME][2] = clip[HOME][0];
+  }
+
+  glUseProgram(m_prog);
+  glBindVertexArray(m_vao);
+  glUniform2f(m_screen_loc, m_osd_width, m_osd_height);
+  glUniform4fv(m_xform_loc, NGROUPS, &xform[0][0]);
+  glUniform2fv(m_pre_loc, NGROUPS, &pre[0][0]);
+  glUniform4fv(m_clip_loc, NGROUPS, &clip[0][0]);
+  glUniform4f(m_color_loc, 1, 1, 1, 1);
+  glUniform1f(m_width_loc, LINE_HALF_WIDTH * state.scale());
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+  glDrawElements(GL_TRIANGLES, m_indices.size(), GL_UNSIGNED_SHORT, 0);
+  glDisable(GL_BLEND);
+}
+
+#endif /* USE_FFMPEG_MONITOR */
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "ffmpeg_monitor.h"
+#if USE_FFMPEG_MONITOR
+
+#include <vector>
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
+#include "hud_state.hh"
+
+// Draws the fast moving parts of the OSD (the horizon and pitch ladder, heading tape and home
+// arrow) directly in GL, over the video and the LVGL layer.
+// All of the geometry is built once as line segments (including the numbers, which are seven
+// segment digits) in a static vertex buffer. Each frame only sets a transform per group of
+// segments from the HudState, and the fragment shader draws each segment from its distance
+// field, so the lines stay sharp and antialiased at any window size.
+class GPUHud {
+public:
+
+  GPUHud();
+
+  // Compile the shaders (needs a current GL context). The HUD is drawn in OSD coordinates,
+  // scaled to the window.
+  bool init(float osd_width, float osd_height);
+
+  // Draw the HUD over the current frame, if it's enabled.
+  void draw();
+
+private:
+
+  // The segments that move together
+  enum Group { ATTITUDE, AIRCRAFT, HEADING, HEADING_POINTER, HOME, NGROUPS };
+
+  void build(const HudState &state);
+  void add_segment(Group group, float x0, float y0, float x1, float y1);
+  void add_number(Group group, int value, float x, float y, float height);
+
+  bool m_good;
+  bool m_built;
+  float m_osd_width;
+  float m_osd_height;
+  GLuint m_prog;
+  GLuint m_vao;
+  GLuint m_vbo;
+  GLuint m_ibo;
+  GLint m_screen_loc;
+  GLint m_xform_loc;
+  GLint m_pre_loc;
+  GLint m_clip_loc;
+  GLint m_color_loc;
+  GLint m_width_loc;
+  std::vector<GLfloat> m_vertices;
+  std::vector<GLushort> m_indices;
+};
+
+#endif /* USE_FFMPEG_MONITOR */
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+
+// A rectangle in OSD coordinates.
+struct HudRect {
+  float x;
+  float y;
+  float width;
+  float height;
+};
+
+// The values that the GPU HUD pass (GPUHud) draws over the video.
+// The values are written from the OSD thread and read by the video thread once per frame, so
+// they are plain atomics rather than LVGL widgets. The layout is set once, before enable().
+class HudState {
+public:
+
+  HudState() : m_attitude(), m_heading_area(), m_home(), m_pixels_per_degree(8),
+               m_scale(1), m_enabled(false), m_active(false), m_roll(0), m_pitch(0),
+               m_heading(0), m_home_direction(0), m_home_valid(false) {}
+
+  // The areas of the attitude indicator, heading tape and home arrow. The scale is the size of
+  // a layout pixel in OSD pixels, for the line widths and markers.
+  void set_layout(const HudRect &attitude, const HudRect &heading, const HudRect &home,
+                  float pixels_per_degree, float scale = 1) {
+    m_attitude = attitude;
+    m_heading_area = heading;
+    m_home = home;
+    m_pixels_per_degree = pixels_per_degree;
+    m_scale = scale;
+  }
+  const HudRect &attitude_area() const { return m_attitude; }
+  const HudRect &heading_area() const { return m_heading_area; }
+  const HudRect &home_area() const { return m_home; }
+  float pixels_per_degree() const { return m_pixels_per_degree; }
+  float scale() const { return m_scale; }
+
+  // Start drawing the HUD (the layout can't be changed after this).
+  void enable() { m_enabled.store(true, std::memory_order_release); }
+  bool enabled() const { return m_enabled.load(std::memory_order_acquire); }
+
+  // Set by the video thread while the HUD pass is initialized. The OSD draws the widgets itself
+  // while it isn't.
+  void set_active(bool val) {
+    if (m_active.exchange(val, std::memory_order_acq_rel) == val) {
+      return;
+    }
+    std::function<void()> cb;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      cb = m_active_cb;
+    }
+    if (cb) {
+      cb();
+    }
+  }
+  bool active() const { return m_active.load(std::memory_order_acquire); }
+
+  // Called (from the video thread) when the HUD becomes active or inactive.
+  void set_active_callback(std::function<void()> cb) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_active_cb = cb;
+  }
+
+  // Radians, like the telemetry values
+  void set_roll(float v) { m_roll.store(v, std::memory_order_relaxed); }
+  void set_pitch(float v) { m_pitch.store(v, std::memory_order_relaxed); }
+  float roll() const { return m_roll.load(std::memory_order_relaxed); }
+  float pitch() const { return m_pitch.load(std::memory_order_relaxed); }
+
+  // Degrees
+  void set_heading(float v) { m_heading.store(v, std::memory_order_relaxed); }
+  void set_home_direction(float v) {
+    m_home_direction.store(v, std::memory_order_relaxed);
+    m_home_valid.store(true, std::memory_order_relaxed);
+  }
+  float heading() const { return m_heading.load(std::memory_order_relaxed); }
+  float home_direction() const { return m_home_direction.load(std::memory_order_relaxed); }
+  bool home_valid() const { return m_home_valid.load(std::memory_order_relaxed); }
+
+private:
+  HudRect m_attitude;
+  HudRect m_heading_area;
+  HudRect m_home;
+  float m_pixels_per_degree;
+  float m_scale;
+  std::atomic<bool> m_enabled;
+  std::atomic<bool> m_active;
+  std::mutex m_mutex;
+  std::function<void()> m_active_cb;
+  std::atomic<float> m_roll;
+  std::atomic<float> m_pitch;
+  std::atomic<float> m_heading;
+  std::atomic<float> m_home_direction;
+  std::atomic<bool> m_home_valid;
+};
+
+// The HUD state shared by the OSD and the video thread
+inline HudState &hud_state() {
+  static HudState state;
+  return state;
+}
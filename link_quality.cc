@@ -0,0 +1,164 @@
+
+#include <math.h>
+
+#include <algorithm>
+
+#include <link_quality.hh>
+
+// Gaps larger than this are treated as a restarted sender or reordering rather than loss.
+#define MAX_SEQ_GAP 128
+
+void LinkQuality::add(uint8_t sysid, uint8_t compid, uint8_t seq, bool heartbeat, double time) {
+  Link &link = m_links[(static_cast<uint16_t>(sysid) << 8) | compid];
+  Bucket &bucket = link.buckets[m_cur_second % WINDOW_SECONDS];
+
+  // Count the messages missing between the previous sequence number and this one.
+  if (link.have_seq) {
+    uint8_t gap = seq - static_cast<uint8_t>(link.last_seq + 1);
+    if ((gap > 0) && (gap < MAX_SEQ_GAP)) {
+      bucket.lost += gap;
+      bucket.bursts[burst_bin(gap)]++;
+      bucket.max_burst = std::max(bucket.max_burst, static_cast<uint32_t>(gap));
+    }
+  }
+  link.last_seq = seq;
+  link.have_seq = true;
+  bucket.received++;
+
+  // Heartbeats are sent at a fixed rate, so the variation of their inter-arrival time is
+  // a measure of the link jitter (smoothed as in RFC 3550).
+  if (heartbeat) {
+    if (link.last_heartbeat > 0) {
+      double interval = time - link.last_heartbeat;
+      if (link.hb_interval == 0) {
+        link.hb_interval = interval;
+      }
+      link.hb_interval += (interval - link.hb_interval) / 16.0;
+      link.jitter += (fabs(interval - link.hb_interval) - link.jitter) / 16.0;
+    }
+    link.last_heartbeat = time;
+  }
+}
+
+void LinkQuality::add_dropped(uint32_t count) {
+  m_dropped[m_cur_second % WINDOW_SECONDS] += count;
+}
+
+bool LinkQuality::update(double time) {
+  int64_t second = static_cast<int64_t>(floor(time));
+  if (second <= m_cur_second) {
+    return false;
+  }
+
+  // Clear the buckets that are being reused for the new second(s).
+  int64_t nclear = std::min(second - m_cur_second, static_cast<int64_t>(WINDOW_SECONDS));
+  for (int64_t s = second - nclear + 1; s <= second; ++s) {
+    int idx = s % WINDOW_SECONDS;
+    m_dropped[idx] = 0;
+    for (auto &l : m_links) {
+      clear(l.second.buckets[idx]);
+    }
+  }
+  m_cur_second = second;
+  return true;
+}
+
+uint32_t LinkQuality::received() const {
+  return sum(&Bucket::received);
+}
+
+uint32_t LinkQuality::lost() const {
+  return sum(&Bucket::lost);
+}
+
+uint32_t LinkQuality::dropped() const {
+  uint32_t total = 0;
+  for (int i = 0; i < WINDOW_SECONDS; ++i) {
+    total += m_dropped[i];
+  }
+  return total;
+}
+
+float LinkQuality::loss_percent() const {
+  uint32_t nlost = lost();
+  uint32_t total = received() + nlost;
+  return (total == 0) ? 0.0 : 100.0 * nlost / total;
+}
+
+uint32_t LinkQuality::burst_count(int bin) const {
+  uint32_t total = 0;
+  for (const auto &l : m_links) {
+    for (int i = 0; i < WINDOW_SECONDS; ++i) {
+      total += l.second.buckets[i].bursts[bin];
+    }
+  }
+  return total;
+}
+
+uint32_t LinkQuality::max_burst() const {
+  uint32_t max = 0;
+  for (const auto &l : m_links) {
+    for (int i = 0; i < WINDOW_SECONDS; ++i) {
+      max = std::max(max, l.second.buckets[i].max_burst);
+    }
+  }
+  return max;
+}
+
+float LinkQuality::jitter() const {
+  const Link *busiest = 0;
+  uint32_t busiest_count = 0;
+  for (const auto &l : m_links) {
+    uint32_t count = 0;
+    for (int i = 0; i < WINDOW_SECONDS; ++i) {
+      count += l.second.buckets[i].received;
+    }
+    if (!busiest || (count > busiest_count)) {
+      busiest = &l.second;
+      busiest_count = count;
+    }
+  }
+  return busiest ? busiest->jitter : 0.0;
+}
+
+float LinkQuality::loss_percent(uint8_t sysid, uint8_t compid) const {
+  auto li = m_links.find((static_cast<uint16_t>(sysid) << 8) | compid);
+  if (li == m_links.end()) {
+    return 0.0;
+  }
+  uint32_t nreceived = 0;
+  uint32_t nlost = 0;
+  for (int i = 0; i < WINDOW_SECONDS; ++i) {
+    nreceived += li->second.buckets[i].received;
+    nlost += li->second.buckets[i].lost;
+  }
+  uint32_t total = nreceived + nlost;
+  return (total == 0) ? 0.0 : 100.0 * nlost / total;
+}
+
+void LinkQuality::clear(Bucket &b) {
+  b.received = 0;
+  b.lost = 0;
+  b.max_burst = 0;
+  for (int i = 0; i < BURST_BINS; ++i) {
+    b.bursts[i] = 0;
+  }
+}
+
+int LinkQuality::burst_bin(uint32_t len) {
+  int bin = 0;
+  for (uint32_t l = len - 1; (l > 0) && (bin < BURST_BINS - 1); l >>= 1) {
+    ++bin;
+  }
+  return bin;
+}
+
+uint32_t LinkQuality::sum(uint32_t Bucket::*field) const {
+  uint32_t total = 0;
+  for (const auto &l : m_links) {
+    for (int i = 0; i < WINDOW_SECONDS; ++i) {
+      total += l.second.buckets[i].*field;
+    }
+  }
+  return total;
+}
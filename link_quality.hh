@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <map>
+
+// Estimates the quality of the telemetry link from the MAVLink sequence numbers.
+// Every (sysid, compid) pair has its own sequence counter, so gaps are tracked per source.
+// The statistics are kept in one second buckets over a sliding window, so the reported
+// loss reacts to a degrading link within a few seconds.
+class LinkQuality {
+public:
+
+  // Burst loss lengths are histogrammed into bins of 1, 2, 3-4, 5-8, 9-16 and 17+ packets.
+  static const int BURST_BINS = 6;
+  static const int WINDOW_SECONDS = 10;
+
+  LinkQuality() : m_cur_second(0) {}
+
+  // Record a received message.
+  void add(uint8_t sysid, uint8_t compid, uint8_t seq, bool heartbeat, double time);
+
+  // Record messages that were dropped by the parser (bad CRC, etc).
+  void add_dropped(uint32_t count);
+
+  // Advance the sliding window to the given time.
+  // Returns true when a new second has started and the statistics should be exported.
+  bool update(double time);
+
+  // The statistics over the current window, aggregated over all sources.
+  uint32_t received() const;
+  uint32_t lost() const;
+  uint32_t dropped() const;
+  float loss_percent() const;
+  uint32_t burst_count(int bin) const;
+  uint32_t max_burst() const;
+  // The heartbeat inter-arrival jitter (seconds) of the source with the most traffic.
+  float jitter() const;
+
+  // The loss over the current window for a single source.
+  float loss_percent(uint8_t sysid, uint8_t compid) const;
+
+  template <typename Func>
+  void for_each_source(Func f) const {
+    for (const auto &l : m_links) {
+      f(static_cast<uint8_t>(l.first >> 8), static_cast<uint8_t>(l.first & 0xff));
+    }
+  }
+
+private:
+
+  struct Bucket {
+    uint32_t received;
+    uint32_t lost;
+    uint32_t max_burst;
+    uint32_t bursts[BURST_BINS];
+  };
+
+  struct Link {
+    Link() : last_seq(0), have_seq(false), last_heartbeat(0), hb_interval(0), jitter(0) {
+      for (int i = 0; i < WINDOW_SECONDS; ++i) {
+        clear(buckets[i]);
+      }
+    }
+    uint8_t last_seq;
+    bool have_seq;
+    double last_heartbeat;
+    double hb_interval;
+    double jitter;
+    Bucket buckets[WINDOW_SECONDS];
+  };
+
+  static void clear(Bucket &b);
+  static int burst_bin(uint32_t len);
+  uint32_t sum(uint32_t Bucket::*field) const;
+
+  std::map<uint16_t, Link> m_links;
+  int64_t m_cur_second;
+  uint32_t m_dropped[WINDOW_SECONDS] = {};
+};
@@ -0,0 +1,204 @@
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <logger.hh>
+
+// The number of messages that can be queued by each thread.
+#define LOG_RING_SIZE 256
+// The maximum length of a message (longer messages are truncated).
+#define LOG_MSG_LEN 200
+// How often the background thread writes out the queued messages (milliseconds).
+#define LOG_FLUSH_INTERVAL_MS 50
+
+namespace {
+
+struct LogRecord {
+  double time;
+  int level;
+  char text[LOG_MSG_LEN];
+};
+
+// A ring that is written by one thread and read by the flush thread.
+struct LogRing {
+  LogRing() : head(0), tail(0), dropped(0) {}
+  LogRecord records[LOG_RING_SIZE];
+  std::atomic<uint32_t> head;
+  std::atomic<uint32_t> tail;
+  std::atomic<uint32_t> dropped;
+};
+
+double monotonic_time() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+class LogWriter {
+public:
+
+  static LogWriter &instance() {
+    static LogWriter writer;
+    return writer;
+  }
+
+  // Get the ring of the calling thread, which is created on the first call from each thread.
+  LogRing &ring() {
+    thread_local LogRing *ring = 0;
+    if (!ring) {
+      std::shared_ptr<LogRing> r(new LogRing());
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_rings.push_back(r);
+      ring = r.get();
+      if (!m_thread) {
+        m_thread.reset(new std::thread([this]() { this->flush_thread(); }));
+        atexit([]() { LogWriter::instance().stop(); });
+      }
+    }
+    return *ring;
+  }
+
+  void flush() {
+    // Only one thread drains the rings at a time, but the threads that log are never blocked
+    // while the messages are written.
+    std::lock_guard<std::mutex> lock(m_drain_mutex);
+    {
+      std::lock_guard<std::mutex> rings_lock(m_mutex);
+      m_drain_rings = m_rings;
+    }
+    drain();
+  }
+
+private:
+
+  LogWriter() : m_stop(false) {}
+
+  void flush_thread() {
+    while (!m_stop) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(LOG_FLUSH_INTERVAL_MS));
+      flush();
+    }
+  }
+
+  void stop() {
+    m_stop = true;
+    if (m_thread && m_thread->joinable()) {
+      m_thread->join();
+    }
+    flush();
+  }
+
+  // Write out the queued messages of all of the threads in time order.
+  // Must be called with the drain mutex held.
+  void drain() {
+    m_pending.clear();
+    std::vector<uint32_t> heads(m_drain_rings.size());
+    for (size_t i = 0; i < m_drain_rings.size(); ++i) {
+      LogRing &r = *m_drain_rings[i];
+      heads[i] = r.head.load(std::memory_order_acquire);
+      for (uint32_t t = r.tail.load(std::memory_order_relaxed); t != heads[i]; ++t) {
+        m_pending.push_back(&r.records[t % LOG_RING_SIZE]);
+      }
+    }
+    std::stable_sort(m_pending.begin(), m_pending.end(),
+                     [](const LogRecord *a, const LogRecord *b) { return a->time < b->time; });
+
+    static const char *level_names[] = { "D", "I", "W", "E" };
+    m_buf.clear();
+    char line[LOG_MSG_LEN + 32];
+    for (const LogRecord *rec : m_pending) {
+      int len = snprintf(line, sizeof(line), "[%10.3f] %s: %s\n", rec->time,
+                         level_names[rec->level], rec->text);
+      m_buf.insert(m_buf.end(), line, line + std::min(len, static_cast<int>(sizeof(line)) - 1));
+    }
+    for (size_t i = 0; i < m_drain_rings.size(); ++i) {
+      LogRing &r = *m_drain_rings[i];
+      r.tail.store(heads[i], std::memory_order_release);
+      uint32_t dropped = r.dropped.exchange(0);
+      if (dropped) {
+        int len = snprintf(line, sizeof(line), "[%10.3f] W: %u log messages dropped\n",
+                           monotonic_time(), dropped);
+        m_buf.insert(m_buf.end(), line, line + std::min(len, static_cast<int>(sizeof(line)) - 1));
+      }
+    }
+
+    for (size_t off = 0; off < m_buf.size(); ) {
+      ssize_t n = write(STDERR_FILENO, m_buf.data() + off, m_buf.size() - off);
+      if (n <= 0) {
+        break;
+      }
+      off += n;
+    }
+  }
+
+  // Guards the list of rings
+  std::mutex m_mutex;
+  std::vector<std::shared_ptr<LogRing> > m_rings;
+  // Guards the draining, and the copy of the list of rings that it uses
+  std::mutex m_drain_mutex;
+  std::vector<std::shared_ptr<LogRing> > m_drain_rings;
+  std::vector<const LogRecord *> m_pending;
+  std::vector<char> m_buf;
+  std::shared_ptr<std::thread> m_thread;
+  std::atomic<bool> m_stop;
+};
+
+}
+
+bool LogRateLimit::allow(uint32_t &suppressed) {
+  suppressed = 0;
+  if (m_interval == 0) {
+    return true;
+  }
+  uint64_t now = static_cast<uint64_t>(monotonic_time() * 1000.0);
+  uint64_t next = m_next.load(std::memory_order_relaxed);
+  if ((now < next) ||
+      !m_next.compare_exchange_strong(next, now + m_interval, std::memory_order_relaxed)) {
+    m_suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  suppressed = m_suppressed.exchange(0, std::memory_order_relaxed);
+  return true;
+}
+
+void Logger::log(int level, uint32_t suppressed, const char *fmt, ...) {
+  LogRing &r = LogWriter::instance().ring();
+  uint32_t head = r.head.load(std::memory_order_relaxed);
+  if ((head - r.tail.load(std::memory_order_acquire)) >= LOG_RING_SIZE) {
+    r.dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  LogRecord &rec = r.records[head % LOG_RING_SIZE];
+  rec.time = monotonic_time();
+  rec.level = std::max(LOG_LEVEL_DEBUG, std::min(LOG_LEVEL_ERROR, level));
+  va_list args;
+  va_start(args, fmt);
+  int len = vsnprintf(rec.text, sizeof(rec.text), fmt, args);
+  va_end(args);
+
+  // Strip the trailing newline, which is added when the message is written.
+  len = std::min(len, static_cast<int>(sizeof(rec.text)) - 1);
+  if ((len > 0) && (rec.text[len - 1] == '\n')) {
+    rec.text[--len] = '\0';
+  }
+  if (suppressed && (len >= 0)) {
+    snprintf(rec.text + len, sizeof(rec.text) - len, " (%u similar messages suppressed)",
+             suppressed);
+  }
+  r.head.store(head + 1, std::memory_order_release);
+}
+
+void Logger::flush() {
+  LogWriter::instance().flush();
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO  1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_ERROR 3
+
+// Messages below this level are compiled out.
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_LEVEL_INFO
+#endif
+
+// The minimum time between two messages from the same call site (milliseconds).
+#ifndef LOG_RATE_LIMIT_MS
+#define LOG_RATE_LIMIT_MS 100
+#endif
+
+// Limits the rate of the messages from one call site.
+class LogRateLimit {
+public:
+
+  LogRateLimit(uint32_t interval_ms) : m_interval(interval_ms), m_next(0), m_suppressed(0) {}
+
+  // Returns true if the message should be logged, and the number of messages
+  // that have been suppressed since the last one.
+  bool allow(uint32_t &suppressed);
+
+private:
+  const uint32_t m_interval;
+  std::atomic<uint64_t> m_next;
+  std::atomic<uint32_t> m_suppressed;
+};
+
+// Asynchronous logger.
+// Each thread formats its messages into its own single producer / single consumer ring,
+// and a background thread writes them out, so the threads that log never block on a lock
+// or a write to the terminal. Messages are dropped (and counted) if a ring fills up.
+class Logger {
+public:
+
+  static void log(int level, uint32_t suppressed, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+  // Write out all of the queued messages.
+  static void flush();
+};
+
+#define LOG_AT(level, interval_ms, ...)                                 \
+  do {                                                                  \
+    if ((level) >= LOG_MIN_LEVEL) {                                     \
+      static LogRateLimit log_rate_limit_(interval_ms);                 \
+      uint32_t log_suppressed_;                                         \
+      if (log_rate_limit_.allow(log_suppressed_)) {                     \
+        Logger::log((level), log_suppressed_, __VA_ARGS__);             \
+      }                                                                 \
+    }                                                                   \
+  } while (0)
+
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, LOG_RATE_LIMIT_MS, __VA_ARGS__)
+#define LOG_INFO(...)  LOG_AT(LOG_LEVEL_INFO, LOG_RATE_LIMIT_MS, __VA_ARGS__)
+#define LOG_WARN(...)  LOG_AT(LOG_LEVEL_WARN, LOG_RATE_LIMIT_MS, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, LOG_RATE_LIMIT_MS, __VA_ARGS__)
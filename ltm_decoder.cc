@@ -0,0 +1,127 @@
+
+#include <math.h>
+
+#include <ltm_decoder.hh>
+
+// The flight mode names of the LTM status frame (iNav's LTM mode numbers)
+static const char *g_ltm_mode_strings[] = {
+  "Manual",
+  "Rate",
+  "Angle",
+  "Horizon",
+  "Acro",
+  "Stabilized 1",
+  "Stabilized 2",
+  "Stabilized 3",
+  "Alt Hold",
+  "GPS Hold",
+  "Waypoints",
+  "Head Free",
+  "Circle",
+  "RTH",
+  "Follow Me",
+  "Land",
+  "Fly By Wire A",
+  "Fly By Wire B",
+  "Cruise",
+  "Unknown",
+  "Launch",
+  "Autotune"
+};
+
+bool LTMDecoder::parse(uint8_t c) {
+  switch (m_state) {
+  case SYNC1:
+    if (c == '$') {
+      m_state = SYNC2;
+    }
+    break;
+  case SYNC2:
+    m_state = (c == 'T') ? FUNCTION : SYNC1;
+    break;
+  case FUNCTION:
+    m_function = c;
+    m_len = payload_length(c);
+    m_idx = 0;
+    m_crc = 0;
+    m_state = (m_len == 0) ? SYNC1 : PAYLOAD;
+    break;
+  case PAYLOAD:
+    m_buf[m_idx++] = c;
+    m_crc ^= c;
+    if (m_idx == m_len) {
+      m_state = CHECKSUM;
+    }
+    break;
+  case CHECKSUM:
+    m_state = SYNC1;
+    if (c == m_crc) {
+      handle_frame();
+      return true;
+    }
+    break;
+  }
+  return false;
+}
+
+void LTMDecoder::reset() {
+  m_state = SYNC1;
+  m_function = 0;
+  m_len = 0;
+  m_idx = 0;
+  m_crc = 0;
+}
+
+uint8_t LTMDecoder::payload_length(uint8_t function) {
+  switch (function) {
+  case 'G': // GPS
+  case 'O': // Origin
+    return 14;
+  case 'S': // Status
+    return 7;
+  case 'A': // Attitude
+  case 'N': // Navigation
+  case 'X': // GPS extended
+    return 6;
+  default:
+    return 0;
+  }
+}
+
+void LTMDecoder::handle_frame() {
+  const uint8_t *p = m_buf;
+  switch (m_function) {
+  case 'G': {
+    set_value("latitude", static_cast<int32_t>(read_le32(p)) * 1e-7);
+    set_value("longitude", static_cast<int32_t>(read_le32(p + 4)) * 1e-7);
+    set_value("speed", p[8]);
+    set_value("altitude", static_cast<int32_t>(read_le32(p + 9)) / 100.0);
+    set_value("gps_num_sats", p[13] >> 2);
+    set_value("gps_fix_type", p[13] & 0x3);
+    break;
+  }
+  case 'A':
+    // LTM sends degrees, while the rest of the OSD expects radians for the attitude.
+    set_value("pitch", static_cast<int16_t>(read_le16(p)) * M_PI / 180.0);
+    set_value("roll", static_cast<int16_t>(read_le16(p + 2)) * M_PI / 180.0);
+    set_value("heading", static_cast<int16_t>(read_le16(p + 4)));
+    break;
+  case 'S':
+    set_value("voltage_battery", read_le16(p) / 1000.0);
+    set_value("rc_rssi", 70.0 * static_cast<float>(p[4]) / 255.0 - 90.0);
+    set_value("armed", (p[6] & 0x1) ? 1.0 : 0.0);
+    set_mode(p[6] >> 2, g_ltm_mode_strings,
+             sizeof(g_ltm_mode_strings) / sizeof(g_ltm_mode_strings[0]));
+    break;
+  case 'O':
+    set_value("home_latitude", static_cast<int32_t>(read_le32(p)) * 1e-7);
+    set_value("home_longitude", static_cast<int32_t>(read_le32(p + 4)) * 1e-7);
+    set_value("home_altitude", static_cast<int32_t>(read_le32(p + 8)) / 100.0);
+    break;
+  case 'X':
+    set_value("gps_HDOP", read_le16(p) / 100.0);
+    break;
+  default:
+    break;
+  }
+}
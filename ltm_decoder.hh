@@ -0,0 +1,29 @@
+#pragma once
+
+#include <protocol_decoder.hh>
+
+// Decodes the Lightweight Telemetry (LTM) frames sent by iNav and Betaflight.
+// Frames are "$T", a function byte, a fixed length payload and an XOR checksum of the payload.
+class LTMDecoder : public ProtocolDecoder {
+public:
+
+  LTMDecoder(Telemetry &telem) : ProtocolDecoder(telem) { reset(); }
+
+  const char *name() const { return "LTM"; }
+  bool parse(uint8_t c);
+  void reset();
+
+private:
+
+  enum State { SYNC1, SYNC2, FUNCTION, PAYLOAD, CHECKSUM };
+
+  static uint8_t payload_length(uint8_t function);
+  void handle_frame();
+
+  State m_state;
+  uint8_t m_function;
+  uint8_t m_len;
+  uint8_t m_idx;
+  uint8_t m_crc;
+  uint8_t m_buf[16];
+};
@@ -22,9 +22,11 @@
 /* Open as a full-screen window */
 #define LV_FULLSCREEN      1
 
-/* Maximal horizontal and vertical resolution to support by the library.*/
-#define LV_HOR_RES_MAX          (1280)
-#define LV_VER_RES_MAX          (720)
+/* Maximal horizontal and vertical resolution to support by the library.
+ * The monitors choose the actual resolution at runtime (up to this size), from the video or
+ * the desktop size.*/
+#define LV_HOR_RES_MAX          (1920)
+#define LV_VER_RES_MAX          (1080)
 
 
 /* Color depth:
@@ -180,7 +182,7 @@ typedef void * lv_group_user_data_t;
 #endif  /*LV_USE_GROUP*/
 
 /* 1: Enable GPU interface*/
-#define LV_USE_GPU              0   /*Only enables `gpu_fill_cb` and `gpu_blend_cb` in the disp. drv- */
+#define LV_USE_GPU              1   /*Only enables `gpu_fill_cb` and `gpu_blend_cb` in the disp. drv- (set to the SIMD loops of simd_blend.cc)*/
 #define LV_USE_GPU_STM32_DMA2D  0
 
 /* 1: Enable file system (might be required for images */
@@ -256,10 +258,9 @@ typedef void * lv_img_decoder_user_data_t;
 
 /* 1: use a custom tick source.
  * It removes the need to manually update the tick with `lv_tick_inc`) */
-#define LV_TICK_CUSTOM     0
+#define LV_TICK_CUSTOM     1
 #if LV_TICK_CUSTOM == 1
-#define LV_TICK_CUSTOM_INCLUDE  <stdint.h>       /*Header for the sys time function*/
-uint32_t custom_tick_get();
+#define LV_TICK_CUSTOM_INCLUDE  "osd_tick.h"       /*Header for the sys time function*/
 #define LV_TICK_CUSTOM_SYS_TIME_EXPR (custom_tick_get())     /*Expression evaluating to current systime in ms*/
 #endif   /*LV_TICK_CUSTOM*/
 
@@ -337,26 +338,33 @@ typedef void * lv_indev_drv_user_data_t;            /*Type of user data in the i
  */
 
 /* Montserrat fonts with bpp = 4
- * https://fonts.google.com/specimen/Montserrat  */
-#define LV_FONT_MONTSERRAT_12    1
-#define LV_FONT_MONTSERRAT_14    1
+ * https://fonts.google.com/specimen/Montserrat
+ * With OSD_FONT_SUBSET, the OSD has its own copies of these sizes with only the characters
+ * that it draws (generated by tools/font_subset.py), and only the theme's font is built in. */
+#if OSD_FONT_SUBSET
+#define OSD_FONT_BUILT_IN    0
+#else
+#define OSD_FONT_BUILT_IN    1
+#endif
+#define LV_FONT_MONTSERRAT_12    OSD_FONT_BUILT_IN
+#define LV_FONT_MONTSERRAT_14    OSD_FONT_BUILT_IN
 #define LV_FONT_MONTSERRAT_16    1
-#define LV_FONT_MONTSERRAT_18    1
-#define LV_FONT_MONTSERRAT_20    1
-#define LV_FONT_MONTSERRAT_22    1
-#define LV_FONT_MONTSERRAT_24    1
-#define LV_FONT_MONTSERRAT_26    1
-#define LV_FONT_MONTSERRAT_28    1
-#define LV_FONT_MONTSERRAT_30    1
-#define LV_FONT_MONTSERRAT_32    1
-#define LV_FONT_MONTSERRAT_34    1
-#define LV_FONT_MONTSERRAT_36    1
-#define LV_FONT_MONTSERRAT_38    1
-#define LV_FONT_MONTSERRAT_40    1
-#define LV_FONT_MONTSERRAT_42    1
-#define LV_FONT_MONTSERRAT_44    1
-#define LV_FONT_MONTSERRAT_46    1
-#define LV_FONT_MONTSERRAT_48    1
+#define LV_FONT_MONTSERRAT_18    OSD_FONT_BUILT_IN
+#define LV_FONT_MONTSERRAT_20    OSD_FONT_BUILT_IN
+#define LV_FONT_MONTSERRAT_22    OSD_FONT_BUILT_IN
+#define LV_FONT_MONTSERRAT_24    OSD_FONT_BUILT_IN
+#define LV_FONT_MONTSERRAT_26    OSD_FONT_BUILT_IN
+#define LV_FONT_MONTSERRAT_28    OSD_FONT_BUILT_IN
+#define LV_FONT_MONTSERRAT_30    OSD_FONT_BUILT_IN
+#define LV_FONT_MONTSERRAT_32    OSD_FONT_BUILT_IN
+#define LV_FONT_MONTSERRAT_34    OSD_FONT_BUILT_IN
+#define LV_FONT_MONTSERRAT_36    OSD_FONT_BUILT_IN
+#define LV_FONT_MONTSERRAT_38    OSD_FONT_BUILT_IN
+#define LV_FONT_MONTSERRAT_40    OSD_FONT_BUILT_IN
+#define LV_FONT_MONTSERRAT_42    OSD_FONT_BUILT_IN
+#define LV_FONT_MONTSERRAT_44    OSD_FONT_BUILT_IN
+#define LV_FONT_MONTSERRAT_46    OSD_FONT_BUILT_IN
+#define LV_FONT_MONTSERRAT_48    OSD_FONT_BUILT_IN
 
 /* Demonstrate special features */
 #define LV_FONT_MONTSERRAT_12_SUBPX      0
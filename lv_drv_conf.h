@@ -139,6 +139,21 @@
 #  define USE_FFMPEG_MONITOR         0
 #endif
 
+#if USE_FFMPEG_MONITOR
+/* Let LVGL render straight into a mapped GL pixel buffer, if the driver supports
+ * persistent mapping (otherwise the OSD is copied into a texture) */
+#  define MONITOR_DIRECT_RENDER 1
+
+/* The format that the OSD is stored and uploaded in:
+ * 0 = RGBA8888, 1 = ARGB4444, 2 = RGB565 + A8, 3 = 8 bit palette
+ * (direct rendering needs RGBA8888) */
+#  define MONITOR_OSD_FORMAT 0
+
+/* Render the OSD at this fraction of the video resolution per axis (up to 1.0), and let the
+ * GPU scale it up to the window. The layout and fonts are scaled to match. */
+#  define MONITOR_OSD_SCALE 1.0
+#endif
+
 #if USE_SDL_MONITOR
 #  define MONITOR_HOR_RES     LV_HOR_RES
 #  define MONITOR_VER_RES     LV_VER_RES
@@ -4,6 +4,7 @@
  *********************/
 #define _DEFAULT_SOURCE /* needed for usleep() */
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #define SDL_MAIN_HANDLED /*To fix SDL's "undefined reference to WinMain" \
                             issue*/
@@ -13,6 +14,18 @@
 #include "mpv_monitor.h"
 #include "ffmpeg_monitor.h"
 #include "telemetry.hh"
+#include "osd_bindings.hh"
+#include "osd_layout.hh"
+#include "formatted_label.hh"
+#include "numeric_label.hh"
+#include "alarm_style.hh"
+#include "rotation_cache.hh"
+#include "attitude_indicator.hh"
+#include "hud_state.hh"
+#include "event_loop.hh"
+#include "frame_governor.hh"
+#include "osd_tick.h"
+#include "logger.hh"
 
 /*********************
  *      DEFINES
@@ -25,57 +38,30 @@
 /**********************
  *  STATIC PROTOTYPES
  **********************/
+static const lv_font_t *scaled_font(uint32_t size, float scale);
+
+/**********************
+ *      FONTS
+ **********************/
+#if OSD_FONT_SUBSET
+// Generated at build time with only the characters that the OSD draws (tools/font_subset.py)
+#define OSD_FONT(size) osd_font_##size
+LV_FONT_DECLARE(osd_font_12) LV_FONT_DECLARE(osd_font_14) LV_FONT_DECLARE(osd_font_16)
+LV_FONT_DECLARE(osd_font_18) LV_FONT_DECLARE(osd_font_20) LV_FONT_DECLARE(osd_font_22)
+LV_FONT_DECLARE(osd_font_24) LV_FONT_DECLARE(osd_font_26) LV_FONT_DECLARE(osd_font_28)
+LV_FONT_DECLARE(osd_font_30) LV_FONT_DECLARE(osd_font_32) LV_FONT_DECLARE(osd_font_34)
+LV_FONT_DECLARE(osd_font_36) LV_FONT_DECLARE(osd_font_38) LV_FONT_DECLARE(osd_font_40)
+LV_FONT_DECLARE(osd_font_42) LV_FONT_DECLARE(osd_font_44) LV_FONT_DECLARE(osd_font_46)
+LV_FONT_DECLARE(osd_font_48)
+#else
+#define OSD_FONT(size) lv_font_montserrat_##size
+#endif
 
 /**********************
  *  STATIC VARIABLES
  **********************/
 static lv_indev_t * kb_indev;
 static lv_style_t style;
-static const char *g_arducopter_mode_strings[] = {
-  "Stabilize", // manual airframe angle with manual throttle
-  "Acro",      // manual body-frame angular rate with manual throttle
-  "Alt Hold",  // manual airframe angle with automatic throttle
-  "Auto",      // fully automatic waypoint control using mission commands
-  "Guided",    // fully automatic fly to coordinate or fly at velocity/direction using GCS immediate commands
-  "Loiter",    // automatic horizontal acceleration with automatic throttle
-  "RTL",       // automatic return to launching point
-  "Circle",    // automatic circular flight with automatic throttle
-  "Land",      // automatic landing with horizontal position control
-  "Drift",     // semi-automous position, yaw and throttle control
-  "Sport",     // manual earth-frame angular rate control with manual throttle
-  "Flip",      // automatically flip the vehicle on the roll axis
-  "Autotune",  // automatically tune the vehicle's roll and pitch gains
-  "Poshold",   // automatic position hold with manual override, with automatic throttle
-  "Brake",     // full-brake using inertial/GPS system, no pilot input
-  "Throw",     // throw to launch mode using inertial/GPS system, no pilot input
-  "Avoid",     // automatic avoidance of obstacles in the macro scale - e.g. full-sized aircraft
-  "Guided",    // guided mode but only accepts attitude and altitude
-};
-static const char *g_arduplane_mode_strings[] = {
- "Manual",
- "Circle",
- "Stabilize",
- "Training",
- "Acro",
- "Fly By Wire A",
- "Fly By Wire B",
- "Cruise",
- "Autotune",
- "Auto",
- "RTL",
- "Loiter",
- "Takeoff",
- "Avoid ADSB",
- "Guided",
- "Initialixing",
- "QStabalize",
- "QHover",
- "QLoiter",
- "QLand",
- "QRTL",
- "Qautune",
- "QAcro"
-};
 
 /**********************
  *      IMAGES
@@ -109,21 +95,47 @@ LV_IMG_DECLARE(home_arrow);
 
 int main(int argc, char **argv) {
 
+  // Parse the command line: [--layout <file>] [video url]
+  const char *url = NULL;
+  const char *layout_file = NULL;
+  for (int i = 1; i < argc; ++i) {
+    if ((strcmp(argv[i], "--layout") == 0) && (i + 1 < argc)) {
+      layout_file = argv[++i];
+    } else if (!url) {
+      url = argv[i];
+    }
+  }
+
   // Create the Telemetry class that controls the telemetry receive threads
   Telemetry telem;
   if (!telem.start("127.0.0.1", 14950, "127.0.0.1", 5800)) {
-    fprintf(stderr, "Error starting the telemetry receive threads.\n");
+    LOG_ERROR("Error starting the telemetry receive threads.");
   }
 
   /*Initialize LVGL*/
   lv_init();
 
   /*Initialize the HAL (display, input devices, tick) for LVGL*/
-  monitor_init(argv[1]);
-  printf("HAL initialized\n");
+  monitor_init(url);
+  LOG_INFO("HAL initialized");
 
   lv_obj_set_style_local_bg_opa(lv_scr_act(), LV_OBJMASK_PART_MAIN, LV_STATE_DEFAULT, LV_OPA_TRANSP);
+#if LV_COLOR_DEPTH == 32
   lv_disp_set_bg_opa(NULL, LV_OPA_TRANSP);
+#else
+  // Without an alpha channel, the background is the chroma key that the monitor makes transparent
+  lv_disp_set_bg_color(NULL, LV_COLOR_TRANSP);
+  lv_disp_set_bg_opa(NULL, LV_OPA_COVER);
+#endif
+
+  // The display resolution is chosen by the monitor at runtime, so the layout and the sizes in
+  // the styles are scaled to fit it.
+  OSDLayout layout;
+  layout.set_screen_size(lv_disp_get_hor_res(NULL), lv_disp_get_ver_res(NULL));
+  float scale = layout.scale();
+  auto px = [scale](lv_coord_t v) {
+    return std::max<lv_coord_t>(1, static_cast<lv_coord_t>(lroundf(v * scale)));
+  };
 
   // Default style properties
   static lv_style_t style;
@@ -133,40 +145,40 @@ int main(int argc, char **argv) {
   lv_style_set_bg_grad_dir(&style, LV_STATE_DEFAULT, LV_GRAD_DIR_NONE);
   lv_style_set_value_opa(&style, LV_STATE_DEFAULT, LV_OPA_COVER);
   lv_style_set_value_color(&style, LV_STATE_DEFAULT, LV_COLOR_WHITE);
-  lv_style_set_text_font(&style, LV_STATE_DEFAULT, &lv_font_montserrat_16);
+  lv_style_set_text_font(&style, LV_STATE_DEFAULT, scaled_font(16, scale));
 
   // Gauge properties
   lv_style_set_bg_opa(&style, LV_GAUGE_PART_MAIN, LV_OPA_COVER);
   lv_style_set_bg_color(&style, LV_GAUGE_PART_MAIN, LV_COLOR_BLACK);
   lv_style_set_bg_grad_color(&style, LV_GAUGE_PART_MAIN, LV_COLOR_BLACK);
-  lv_style_set_line_width(&style, LV_GAUGE_PART_MAIN, 2);
-  lv_style_set_line_width(&style, LV_GAUGE_PART_MAJOR, 4);
+  lv_style_set_line_width(&style, LV_GAUGE_PART_MAIN, px(2));
+  lv_style_set_line_width(&style, LV_GAUGE_PART_MAJOR, px(4));
   lv_style_set_line_color(&style, LV_GAUGE_PART_MAIN, LV_COLOR_WHITE);
   lv_style_set_scale_grad_color(&style, LV_GAUGE_PART_MAIN, LV_COLOR_WHITE);
   lv_style_set_scale_end_color(&style, LV_GAUGE_PART_MAIN, LV_COLOR_RED);
-  lv_style_set_scale_end_line_width(&style, LV_GAUGE_PART_MAIN, 2);
-  lv_style_set_scale_end_line_width(&style, LV_GAUGE_PART_MAJOR, 4);
+  lv_style_set_scale_end_line_width(&style, LV_GAUGE_PART_MAIN, px(2));
+  lv_style_set_scale_end_line_width(&style, LV_GAUGE_PART_MAJOR, px(4));
   lv_style_set_scale_border_width(&style, LV_GAUGE_PART_MAIN, 0);
-  lv_style_set_scale_border_width(&style, LV_GAUGE_PART_MAJOR, 2);
+  lv_style_set_scale_border_width(&style, LV_GAUGE_PART_MAJOR, px(2));
   lv_style_set_scale_end_border_width(&style, LV_GAUGE_PART_MAIN, 0);
   lv_style_set_scale_border_width(&style, LV_GAUGE_PART_MAIN, 0);
-  lv_style_set_border_width(&style, LV_GAUGE_PART_MAIN, 2);
-  lv_style_set_pad_inner(&style, LV_GAUGE_PART_MAIN, 20);
-  lv_style_set_pad_top(&style, LV_GAUGE_PART_MAIN, 5);
-  lv_style_set_pad_left(&style, LV_GAUGE_PART_MAIN, 5);
-  lv_style_set_pad_right(&style, LV_GAUGE_PART_MAIN, 5);
-  lv_style_set_text_font(&style, LV_GAUGE_PART_MAJOR, &lv_font_montserrat_14);
-  lv_style_set_text_font(&style, LV_GAUGE_PART_MAIN, &lv_font_montserrat_14);
+  lv_style_set_border_width(&style, LV_GAUGE_PART_MAIN, px(2));
+  lv_style_set_pad_inner(&style, LV_GAUGE_PART_MAIN, px(20));
+  lv_style_set_pad_top(&style, LV_GAUGE_PART_MAIN, px(5));
+  lv_style_set_pad_left(&style, LV_GAUGE_PART_MAIN, px(5));
+  lv_style_set_pad_right(&style, LV_GAUGE_PART_MAIN, px(5));
+  lv_style_set_text_font(&style, LV_GAUGE_PART_MAJOR, scaled_font(14, scale));
+  lv_style_set_text_font(&style, LV_GAUGE_PART_MAIN, scaled_font(14, scale));
 
   // Label properties
   lv_style_set_bg_opa(&style, LV_LABEL_PART_MAIN, LV_OPA_TRANSP);
   lv_style_set_bg_color(&style, LV_LABEL_PART_MAIN, LV_COLOR_BLACK);
   lv_style_set_bg_grad_color(&style, LV_LABEL_PART_MAIN, LV_COLOR_WHITE);
   lv_style_set_text_color(&style, LV_LABEL_PART_MAIN, LV_COLOR_WHITE);
-  lv_style_set_pad_top(&style, LV_LABEL_PART_MAIN, 3);
-  lv_style_set_pad_bottom(&style, LV_LABEL_PART_MAIN, 3);
-  lv_style_set_pad_left(&style, LV_LABEL_PART_MAIN, 3);
-  lv_style_set_pad_right(&style, LV_LABEL_PART_MAIN, 3);
+  lv_style_set_pad_top(&style, LV_LABEL_PART_MAIN, px(3));
+  lv_style_set_pad_bottom(&style, LV_LABEL_PART_MAIN, px(3));
+  lv_style_set_pad_left(&style, LV_LABEL_PART_MAIN, px(3));
+  lv_style_set_pad_right(&style, LV_LABEL_PART_MAIN, px(3));
   lv_style_set_border_width(&style, LV_LABEL_PART_MAIN, 0);
 
   // Container properties
@@ -185,7 +197,7 @@ int main(int argc, char **argv) {
   lv_style_set_pad_right(&style, LV_IMG_PART_MAIN, 0);
 
   // Line properties
-  lv_style_set_line_width(&style, LV_LINE_PART_MAIN, 3);
+  lv_style_set_line_width(&style, LV_LINE_PART_MAIN, px(3));
   lv_style_set_line_color(&style, LV_LINE_PART_MAIN, LV_COLOR_WHITE);
   lv_style_set_line_rounded(&style, LV_LINE_PART_MAIN, true);
 
@@ -194,510 +206,373 @@ int main(int argc, char **argv) {
   // Copy the style for labels, but increase the font size
   static lv_style_t label_style;
   lv_style_copy(&label_style, &style);
-  lv_style_set_text_font(&label_style, LV_STATE_DEFAULT, &lv_font_montserrat_30);
+  lv_style_set_text_font(&label_style, LV_STATE_DEFAULT, scaled_font(30, scale));
 
   // Create a small font for units, etc
   static lv_style_t units_style;
   lv_style_copy(&units_style, &label_style);
-  lv_style_set_text_font(&units_style, LV_STATE_DEFAULT, &lv_font_montserrat_14);
-
-
-  /*******************************
-   * Create the video stats gague
-   *******************************/
+  lv_style_set_text_font(&units_style, LV_STATE_DEFAULT, scaled_font(14, scale));
 
-  // Create the video stats group
-  lv_obj_t *video_group = lv_cont_create(lv_scr_act(), NULL);
-  lv_obj_set_auto_realign(video_group, true);
-  lv_obj_align_origo(video_group, NULL, LV_ALIGN_CENTER, 0, 0);
-  lv_cont_set_fit(video_group, LV_FIT_TIGHT);
-  lv_cont_set_layout(video_group, LV_LAYOUT_COLUMN_MID);
-  lv_obj_align(video_group, NULL, LV_ALIGN_IN_TOP_MID, -200, 10);
-  //lv_obj_add_style(video_group, LV_GAUGE_PART_MAJOR, &style);
-  lv_obj_add_style(video_group, LV_GAUGE_PART_MAIN, &style);
+  // Increase the font size of the mode string
+  static lv_style_t mode_style;
+  lv_style_copy(&mode_style, &label_style);
+  lv_style_set_text_font(&mode_style, LV_STATE_DEFAULT, scaled_font(40, scale));
 
   // Create a custom style for the video gague
   static lv_style_t video_style;
   lv_style_copy(&video_style, &style);
-  lv_style_set_pad_inner(&video_style, LV_GAUGE_PART_MAIN, 10);
-
-  // Describe the color for the needles
-  static lv_color_t video_needle_colors[2];
-  video_needle_colors[0] = LV_COLOR_YELLOW;
-  video_needle_colors[1] = LV_COLOR_RED;
-  video_needle_colors[2] = LV_COLOR_BLUE;
-
-  // Create the video guage
-  lv_obj_t *video_gauge = lv_gauge_create(video_group, NULL);
-  //lv_gauge_set_needle_count(video_gauge, 2, video_needle_colors);
-  lv_obj_set_size(video_gauge, 150, 150);
-  lv_obj_align(video_gauge, video_group, LV_ALIGN_CENTER, 0, 0);
-  lv_gauge_set_range(video_gauge, 0, 20);
-  lv_gauge_set_critical_value(video_gauge, 15);
-  lv_obj_add_style(video_gauge, LV_GAUGE_PART_MAJOR, &video_style);
-  lv_obj_add_style(video_gauge, LV_GAUGE_PART_MAIN, &video_style);
-
-  // Add the bitrate down group
-  lv_obj_t *bitrate_down_group = lv_cont_create(video_group, NULL);
-  lv_obj_set_auto_realign(bitrate_down_group, true);
-  lv_cont_set_fit(bitrate_down_group, LV_FIT_TIGHT);
-  lv_cont_set_layout(bitrate_down_group, LV_LAYOUT_ROW_BOTTOM);
-  lv_obj_align(bitrate_down_group, video_group, LV_ALIGN_IN_BOTTOM_MID, 0, 0);
-  lv_obj_add_style(bitrate_down_group, LV_LABEL_PART_MAIN, &label_style);
-
-  // Add the bitrate label
-  lv_obj_t *rx_bitrate_label = lv_label_create(bitrate_down_group, NULL);
-  lv_label_set_align(rx_bitrate_label, LV_LABEL_ALIGN_RIGHT);
-  lv_obj_align(rx_bitrate_label, bitrate_down_group, LV_ALIGN_IN_BOTTOM_MID, 0, 0);
-  lv_obj_set_auto_realign(rx_bitrate_label, true);
-
-  // Add the Mbps label
-  lv_obj_t *rx_mbps_label = lv_label_create(bitrate_down_group, NULL);
-  lv_label_set_align(rx_mbps_label, LV_LABEL_ALIGN_RIGHT);
-  lv_obj_align(rx_mbps_label, rx_bitrate_label, LV_ALIGN_IN_BOTTOM_MID, 0, 0);
-  lv_obj_set_auto_realign(rx_mbps_label, true);
-  lv_obj_add_style(rx_mbps_label, LV_LABEL_PART_MAIN, &units_style);
-  lv_label_set_text(rx_mbps_label, "Mbps " LV_SYMBOL_DOWN);
-
-  /******************************
-   * Create the compass gauge
-   ******************************/
-
-  // Create the top-level compass group
-  lv_obj_t *compass_group = lv_cont_create(lv_scr_act(), NULL);
-  lv_obj_set_auto_realign(compass_group, true);
-  lv_obj_align_origo(compass_group, NULL, LV_ALIGN_CENTER, 0, 0);
-  lv_cont_set_fit(compass_group, LV_FIT_TIGHT);
-  lv_cont_set_layout(compass_group, LV_LAYOUT_COLUMN_LEFT);
-  lv_obj_align(compass_group, NULL, LV_ALIGN_IN_TOP_MID, 0, -90);
-  lv_obj_add_style(compass_group, LV_GAUGE_PART_MAIN, &style);
-
-  // Create the compass image
-  lv_obj_t *compass_img = lv_img_create(compass_group, NULL);
-  lv_img_set_src(compass_img, &compass);
-  lv_img_set_zoom(compass_img, 128);
-  lv_obj_align(compass_img, compass_group, LV_ALIGN_CENTER, 0, 0);
-  lv_obj_set_auto_realign(compass_img, true);
-  lv_obj_add_style(compass_img, LV_IMG_PART_MAIN, &style);
-
-  // Add the rssi label
-  lv_obj_t *orientation_label = lv_label_create(compass_img, NULL);
-  lv_label_set_align(orientation_label, LV_LABEL_ALIGN_RIGHT);
-  lv_obj_align(orientation_label, compass_img, LV_ALIGN_CENTER, 0, 40);
-  lv_obj_set_auto_realign(orientation_label, true);
-  lv_obj_add_style(orientation_label, LV_LABEL_PART_MAIN, &label_style);
-
-  // Create the home arrow image
-  lv_obj_t *home_img = lv_img_create(compass_img, NULL);
-  lv_img_set_src(home_img, &home_arrow);
-  lv_img_set_zoom(home_img, 128);
-  lv_obj_align(home_img, compass_img, LV_ALIGN_CENTER, 0, 0);
-  lv_obj_set_auto_realign(home_img, true);
-  lv_obj_add_style(home_img, LV_IMG_PART_MAIN, &style);
-
-  /*******************************
-   * Create the rssi gague
-   *******************************/
+  lv_style_set_pad_inner(&video_style, LV_GAUGE_PART_MAIN, px(10));
 
   // Create a custom style for the rssi gauge
-  lv_style_t rssi_style;
+  static lv_style_t rssi_style;
   lv_style_copy(&rssi_style, &style);
-  lv_style_set_pad_inner(&rssi_style, LV_GAUGE_PART_MAIN, 10);
+  lv_style_set_pad_inner(&rssi_style, LV_GAUGE_PART_MAIN, px(10));
   lv_style_set_line_color(&rssi_style, LV_GAUGE_PART_MAIN, LV_COLOR_RED);
   lv_style_set_line_color(&rssi_style, LV_GAUGE_PART_MAJOR, LV_COLOR_RED);
   lv_style_set_scale_grad_color(&rssi_style, LV_GAUGE_PART_MAIN, LV_COLOR_RED);
   lv_style_set_scale_grad_color(&rssi_style, LV_GAUGE_PART_MAJOR, LV_COLOR_RED);
   lv_style_set_scale_end_color(&rssi_style, LV_GAUGE_PART_MAIN, LV_COLOR_WHITE);
   lv_style_set_scale_end_color(&rssi_style, LV_GAUGE_PART_MAJOR, LV_COLOR_WHITE);
-  lv_style_set_line_width(&rssi_style, LV_GAUGE_PART_MAIN, 2);
-  lv_style_set_line_width(&rssi_style, LV_GAUGE_PART_MAJOR, 4);
-
-  // Create the rssi stats group
-  lv_obj_t *rssi_group = lv_cont_create(lv_scr_act(), NULL);
-  lv_obj_set_auto_realign(rssi_group, true);
-  lv_obj_align_origo(rssi_group, NULL, LV_ALIGN_CENTER, 0, 0);
-  lv_cont_set_fit(rssi_group, LV_FIT_TIGHT);
-  lv_cont_set_layout(rssi_group, LV_LAYOUT_COLUMN_LEFT);
-  lv_obj_align(rssi_group, NULL, LV_ALIGN_IN_TOP_MID, 200, 10);
-  //lv_obj_add_style(rssi_group, LV_GAUGE_PART_MAJOR, &rssi_style);
-  lv_obj_add_style(rssi_group, LV_GAUGE_PART_MAIN, &rssi_style);
-
-  // Describe the color for the needles
-  static lv_color_t rssi_needle_colors[2];
-  rssi_needle_colors[0] = LV_COLOR_YELLOW;
-  rssi_needle_colors[1] = LV_COLOR_RED;
-
-  // Create the rssi guage
-  lv_obj_t *rssi_gauge = lv_gauge_create(rssi_group, NULL);
-  lv_gauge_set_needle_count(rssi_gauge, 2, rssi_needle_colors);
-  lv_obj_set_size(rssi_gauge, 150, 150);
-  lv_obj_align(rssi_gauge, NULL, LV_ALIGN_CENTER, 0, 0);
-  lv_gauge_set_range(rssi_gauge, -100, 0);
-  lv_gauge_set_critical_value(rssi_gauge, -80);
-  lv_obj_add_style(rssi_gauge, LV_GAUGE_PART_MAJOR, &rssi_style);
-  lv_obj_add_style(rssi_gauge, LV_GAUGE_PART_MAIN, &rssi_style);
-
-  // Add the rssi down group
-  lv_obj_t *rssi_down_group = lv_cont_create(rssi_group, NULL);
-  lv_obj_set_auto_realign(rssi_down_group, true);
-  lv_cont_set_fit(rssi_down_group, LV_FIT_TIGHT);
-  lv_cont_set_layout(rssi_down_group, LV_LAYOUT_ROW_BOTTOM);
-  lv_obj_align(rssi_down_group, rssi_group, LV_ALIGN_IN_BOTTOM_MID, 0, 0);
-  lv_obj_add_style(rssi_down_group, LV_LABEL_PART_MAIN, &label_style);
-
-  // Add the rssi label
-  lv_obj_t *rssi_down_label = lv_label_create(rssi_down_group, NULL);
-  lv_label_set_align(rssi_down_label, LV_LABEL_ALIGN_RIGHT);
-  lv_obj_align(rssi_down_label, rssi_down_group, LV_ALIGN_IN_BOTTOM_MID, 0, 0);
-  lv_obj_set_auto_realign(rssi_down_label, true);
-
-  // Add the dbm label
-  lv_obj_t *rx_dbm_label = lv_label_create(rssi_down_group, NULL);
-  lv_label_set_align(rx_dbm_label, LV_LABEL_ALIGN_RIGHT);
-  lv_obj_align(rx_dbm_label, rssi_down_label, LV_ALIGN_IN_BOTTOM_MID, 0, 0);
-  lv_obj_set_auto_realign(rx_dbm_label, true);
-  lv_obj_add_style(rx_dbm_label, LV_LABEL_PART_MAIN, &units_style);
-  lv_label_set_text(rx_dbm_label, "dBm" LV_SYMBOL_DOWN);
-
-  /***********************
-   * Create the GPS object
-   ***********************/
-
-  // Create the GPS group
-  lv_obj_t *gps_group = lv_cont_create(lv_scr_act(), NULL);
-  lv_obj_set_auto_realign(gps_group, true);
-  lv_obj_align_origo(gps_group, NULL, LV_ALIGN_CENTER, 0, 0);
-  lv_cont_set_fit(gps_group, LV_FIT_TIGHT);
-  lv_cont_set_layout(gps_group, LV_LAYOUT_COLUMN_LEFT);
-  lv_obj_align(gps_group, NULL, LV_ALIGN_IN_BOTTOM_RIGHT, -50, -30);
-  lv_obj_add_style(gps_group, LV_LABEL_PART_MAIN, &label_style);
-
-  // Add the satellite status group
-  lv_obj_t *gps_stats_group = lv_cont_create(gps_group, NULL);
-  lv_obj_set_auto_realign(gps_stats_group, true);
-  lv_obj_align_origo(gps_stats_group, NULL, LV_ALIGN_CENTER, 0, 0);
-  lv_cont_set_fit(gps_stats_group, LV_FIT_TIGHT);
-  lv_cont_set_layout(gps_stats_group, LV_LAYOUT_ROW_BOTTOM);
-  lv_obj_align(gps_stats_group, gps_group, LV_ALIGN_OUT_BOTTOM_MID, 0, 0);
-  lv_obj_add_style(gps_stats_group, LV_LABEL_PART_MAIN, &label_style);
-
-  // Add the satellite icon
-  lv_obj_t *satellite_img = lv_img_create(gps_stats_group, NULL);
-  lv_img_set_src(satellite_img, &satellite);
-  lv_img_set_zoom(satellite_img, 100);
-  lv_obj_align(satellite_img, gps_stats_group, LV_ALIGN_IN_TOP_LEFT, 0, 0);
-  lv_obj_set_auto_realign(satellite_img, true);
-  lv_obj_add_style(satellite_img, LV_IMG_PART_MAIN, &style);
-
-  // Add the satellite status labels
-  lv_obj_t *sats_label = lv_label_create(gps_stats_group, NULL);
-  lv_label_set_align(sats_label, LV_LABEL_ALIGN_RIGHT);
-  lv_obj_align(sats_label, satellite_img, LV_ALIGN_OUT_TOP_RIGHT, 0, 0);
-  lv_obj_set_auto_realign(sats_label, true);
-  lv_obj_t *nsats_label = lv_label_create(gps_stats_group, NULL);
-  lv_label_set_align(nsats_label, LV_LABEL_ALIGN_RIGHT);
-  lv_obj_align(nsats_label, sats_label, LV_ALIGN_OUT_TOP_RIGHT, 0, 0);
-  lv_obj_set_auto_realign(nsats_label, true);
-  lv_obj_add_style(nsats_label, LV_LABEL_PART_MAIN, &units_style);
-  lv_label_set_text(nsats_label, "SATS");
-  lv_obj_t *hdop_label = lv_label_create(gps_stats_group, NULL);
-  lv_label_set_align(hdop_label, LV_LABEL_ALIGN_RIGHT);
-  lv_obj_align(hdop_label, nsats_label, LV_ALIGN_OUT_TOP_RIGHT, 0, 0);
-  lv_obj_set_auto_realign(hdop_label, true);
-  lv_obj_t *hdopl_label = lv_label_create(gps_stats_group, NULL);
-  lv_label_set_align(hdopl_label, LV_LABEL_ALIGN_RIGHT);
-  lv_obj_align(hdopl_label, hdop_label, LV_ALIGN_OUT_TOP_RIGHT, 0, 0);
-  lv_obj_set_auto_realign(hdopl_label, true);
-  lv_obj_add_style(hdopl_label, LV_LABEL_PART_MAIN, &units_style);
-  lv_label_set_text(hdopl_label, "HDOP");
-
-  // Add the latitude label
-  lv_obj_t *lat_label = lv_label_create(gps_group, NULL);
-  lv_label_set_align(lat_label, LV_LABEL_ALIGN_RIGHT);
-  lv_obj_align(lat_label, sats_label, LV_ALIGN_OUT_BOTTOM_RIGHT, 0, 0);
-  lv_obj_set_auto_realign(lat_label, true);
-
-  // Add the longitude label
-  lv_obj_t *lon_label = lv_label_create(gps_group, NULL);
-  lv_label_set_align(lon_label, LV_LABEL_ALIGN_RIGHT);
-  lv_obj_align(lon_label, lat_label, LV_ALIGN_OUT_BOTTOM_RIGHT, 0, 0);
-  lv_obj_set_auto_realign(lon_label, true);
-
-  /**************************
-   * Create the battery group
-   **************************/
-
-  // Create the top-level battery group
-  lv_obj_t *bat_group = lv_cont_create(lv_scr_act(), NULL);
-  lv_obj_set_auto_realign(bat_group, true);
-  lv_obj_align_origo(bat_group, NULL, LV_ALIGN_CENTER, 0, 0);
-  lv_cont_set_fit(bat_group, LV_FIT_TIGHT);
-  lv_cont_set_layout(bat_group, LV_LAYOUT_ROW_MID);
-  lv_obj_align(bat_group, NULL, LV_ALIGN_IN_BOTTOM_LEFT, 30, -30);
-  lv_obj_add_style(bat_group, LV_LABEL_PART_MAIN, &label_style);
-
-  // Create the vertical battery group
-  lv_obj_t *batv_group = lv_cont_create(bat_group, NULL);
-  lv_obj_set_auto_realign(batv_group, true);
-  lv_obj_align_origo(batv_group, NULL, LV_ALIGN_CENTER, 0, 0);
-  lv_cont_set_fit(batv_group, LV_FIT_TIGHT);
-  lv_cont_set_layout(batv_group, LV_LAYOUT_COLUMN_RIGHT);
-  lv_obj_align(batv_group, gps_group, LV_ALIGN_OUT_BOTTOM_MID, 0, 0);
-  lv_obj_add_style(batv_group, LV_LABEL_PART_MAIN, &label_style);
-
-  // Create the battery labels
-  lv_obj_t *volt_label = lv_label_create(batv_group, NULL);
-  lv_label_set_align(volt_label, LV_LABEL_ALIGN_RIGHT);
-  lv_obj_align(volt_label, batv_group, LV_ALIGN_IN_TOP_RIGHT, 0, 0);
-  lv_obj_set_auto_realign(volt_label, true);
-  lv_obj_t *cur_label = lv_label_create(batv_group, NULL);
-  lv_label_set_align(cur_label, LV_LABEL_ALIGN_RIGHT);
-  lv_obj_align(cur_label, batv_group, LV_ALIGN_OUT_BOTTOM_RIGHT, 0, 0);
-  lv_obj_set_auto_realign(cur_label, true);
-
-  // Add the battery icon
-  lv_obj_t *bat_img = lv_img_create(bat_group, NULL);
-  lv_img_set_src(bat_img, &bat_0);
-  lv_obj_align(bat_img, volt_label, LV_ALIGN_IN_RIGHT_MID, 100, 100);
-  lv_obj_set_auto_realign(bat_img, true);
-
-  /******************************
-   * Create the flight mode label
-   ******************************/
-
-  // Add the flight mode label
-  lv_obj_t *mode_label = lv_label_create(lv_scr_act(), NULL);
-  lv_label_set_align(mode_label, LV_LABEL_ALIGN_CENTER);
-  lv_obj_align(mode_label, NULL, LV_ALIGN_IN_BOTTOM_MID, -30, -30);
-  lv_obj_set_auto_realign(mode_label, true);
+  lv_style_set_line_width(&rssi_style, LV_GAUGE_PART_MAIN, px(2));
+  lv_style_set_line_width(&rssi_style, LV_GAUGE_PART_MAJOR, px(4));
 
-  // Increase the font size of the mode string
-  static lv_style_t mode_style;
-  lv_style_copy(&mode_style, &label_style);
-  lv_style_set_text_font(&mode_style, LV_STATE_DEFAULT, &lv_font_montserrat_40);
-  lv_obj_add_style(mode_label, LV_LABEL_PART_MAIN, &mode_style);
+  /*******************************
+   * Create the widgets
+   *******************************/
+
+  // The widget positions come from the layout, which can be overridden from a file.
+  layout.add_style("default", &style);
+  layout.add_style("label", &label_style);
+  layout.add_style("units", &units_style);
+  layout.add_style("mode", &mode_style);
+  layout.add_style("video", &video_style);
+  layout.add_style("rssi", &rssi_style);
+  layout.add_image("compass", &compass);
+  layout.add_image("home_arrow", &home_arrow);
+  layout.add_image("satellite", &satellite);
+  layout.add_image("bat_0", &bat_0);
+  if (layout_file && !layout.load(layout_file)) {
+    LOG_ERROR("Error loading the layout file, using the default layout for the invalid settings");
+  }
+  layout.create(lv_scr_act());
+
+  lv_obj_t *video_gauge = layout.get("video_gauge");
+  lv_obj_t *rx_bitrate_label = layout.get("rx_bitrate_label");
+  lv_obj_t *rssi_gauge = layout.get("rssi_gauge");
+  lv_obj_t *rssi_down_label = layout.get("rssi_down_label");
+  lv_obj_t *compass_img = layout.get("compass_img");
+  lv_obj_t *orientation_label = layout.get("orientation_label");
+  lv_obj_t *home_img = layout.get("home_img");
+  lv_obj_t *satellite_img = layout.get("satellite_img");
+  lv_obj_t *sats_label = layout.get("sats_label");
+  lv_obj_t *nsats_label = layout.get("nsats_label");
+  lv_obj_t *hdop_label = layout.get("hdop_label");
+  lv_obj_t *hdopl_label = layout.get("hdopl_label");
+  lv_obj_t *lat_label = layout.get("lat_label");
+  lv_obj_t *lon_label = layout.get("lon_label");
+  lv_obj_t *volt_label = layout.get("volt_label");
+  lv_obj_t *cur_label = layout.get("cur_label");
+  lv_obj_t *bat_img = layout.get("bat_img");
+  lv_obj_t *mode_label = layout.get("mode_label");
 
   /**************************************
    * Create the attitude indicator
    **************************************/
 
-  // Create the top-level attitude group
-  lv_obj_t *att_group = lv_cont_create(lv_scr_act(), NULL);
-  lv_obj_set_auto_realign(att_group, true);
-  lv_obj_align_origo(att_group, NULL, LV_ALIGN_CENTER, 0, 0);
-  lv_cont_set_fit(att_group, LV_FIT_TIGHT);
-  lv_cont_set_layout(att_group, LV_LAYOUT_ROW_MID);
-  lv_obj_align(att_group, NULL, LV_ALIGN_CENTER, 0, 0);
-  lv_obj_add_style(att_group, LV_LINE_PART_MAIN, &style);
-
-  // Add the horizon lines
-  static lv_point_t horizon_points[] = {
-    { 0, 0 },
-    { LV_HOR_RES_MAX / 10 - LV_HOR_RES_MAX / 50, 0 },
-    { LV_HOR_RES_MAX / 10, LV_VER_RES_MAX / 50 },
-    { LV_HOR_RES_MAX / 10 + LV_HOR_RES_MAX / 50, 0 },
-    { LV_HOR_RES_MAX / 5, 0 }
-  };
-  lv_obj_t *horizon_line = lv_line_create(lv_scr_act(), NULL);
-  lv_line_set_points(horizon_line, horizon_points, sizeof(horizon_points) / sizeof(lv_point_t));
-  lv_obj_add_style(horizon_line, LV_LINE_PART_MAIN, &style);
-  lv_obj_align(horizon_line, att_group, LV_ALIGN_CENTER, 0, 0);
+  // The horizon and pitch ladder are drawn as lines over the area of the attitude widget.
+  AttitudeIndicator attitude(layout.get("attitude"), 8 * scale);
 
-  /* Handle LitlevGL tasks (tickless mode) */
-  uint64_t loop_counter = 0;
-  uint8_t prev_bat_level = 0;
-  while (1) {
+  /**************************************
+   * Bind the widgets to the telemetry
+   **************************************/
 
-    /* Periodically call the lv_task handler.
-     * It could be done in a timer interrupt or an OS task too.*/
-    lv_task_handler();
-    ++loop_counter;
-
-    // Update the telemetry every 100 ms
-    if ((loop_counter % 20) == 0) {
-      bool blink_on = ((loop_counter % 200) > 100);
-
-      // Get the geo coordinates from the telemetry
-      float latitude = 0;
-      float longitude = 0;
-      telem.get_value("latitude", latitude);
-      telem.get_value("longitude", longitude);
-      float deg = fabs(std::max(std::min(latitude, 90.0F), -90.0F));
-      int32_t deg_int = static_cast<int32_t>(fabs(deg));
-      float min = (deg - static_cast<float>(deg_int)) * 60.0;
-      int32_t min_int = static_cast<int32_t>(fabs(min));
-      float sec = fabs((min - static_cast<float>(min_int)) * 60.0);
-      int8_t geo_x = -10;
-      char NS = (latitude < 0) ? 'S' : 'N';
-      lv_label_set_text_fmt(lat_label, "%3d %2d %5.1f %c", deg_int, min_int, sec, NS);
-      deg = fabs(std::max(std::min(longitude, 180.0F), -180.0F));
-      deg_int = static_cast<int32_t>(deg);
-      min = (deg - static_cast<float>(deg_int)) * 60.0;
-      min_int = static_cast<int32_t>(fabs(min));
-      sec = fabs((min - static_cast<float>(min_int)) * 60.0);
-      char EW = ((longitude < 0) ? 'W' : 'E');
-      lv_label_set_text_fmt(lon_label, "%3d %2d %5.1f %c", deg_int, min_int, sec, EW);
-
-      // Set the battery status text
-      float remain = 0;
-      uint8_t bat_level = 0;
-      if (telem.get_value("battery_remaining", remain)) {
-        bat_level = floor(remain / 20);
+  BindingTable bindings(telem);
+
+  // The labels only pass their text to LVGL when it changes. The numbers that change all the
+  // time are drawn from a glyph atlas instead, and only redraw the characters that changed.
+  NumericLabel lat_text(lat_label);
+  NumericLabel lon_text(lon_label);
+  NumericLabel volt_text(volt_label);
+  NumericLabel cur_text(cur_label);
+  FormattedLabel mode_text(mode_label);
+  NumericLabel sats_text(sats_label);
+  NumericLabel hdop_text(hdop_label);
+  NumericLabel rssi_text(rssi_down_label);
+  NumericLabel bitrate_text(rx_bitrate_label);
+  NumericLabel heading_text(orientation_label);
+
+  // Geo coordinates in degrees, minutes and seconds
+  auto format_dms = [](NumericLabel &label, float value, float max, char pos, char neg) {
+    float deg = fabs(std::max(std::min(value, max), -max));
+    int32_t deg_int = static_cast<int32_t>(deg);
+    float min = (deg - static_cast<float>(deg_int)) * 60.0;
+    int32_t min_int = static_cast<int32_t>(fabs(min));
+    float sec = fabs((min - static_cast<float>(min_int)) * 60.0);
+    label.set(LabelText().num(deg_int, 3).ch(' ').num(min_int, 2).ch(' ').fixed(sec, 1, 5).
+              ch(' ').ch((value < 0) ? neg : pos));
+  };
+  bindings.add(lat_label, "latitude",
+               [&](lv_obj_t *, float value) { format_dms(lat_text, value, 90.0, 'N', 'S'); },
+               2, BindingTable::LOW);
+  bindings.add(lon_label, "longitude",
+               [&](lv_obj_t *, float value) { format_dms(lon_text, value, 180.0, 'E', 'W'); },
+               2, BindingTable::LOW);
+
+  // Battery status
+  AlarmIndicator bat_alarm(AlarmIndicator::BLINK);
+  bat_alarm.add(bat_img);
+  bindings.add(bat_img, "battery_remaining", [&](lv_obj_t *obj, float value) {
+      uint8_t bat_level = floor(value / 20);
+      bat_alarm.set_level((bat_level < 2) ? AlarmIndicator::CRITICAL : AlarmIndicator::NORMAL);
+      switch (bat_level) {
+      case 0:
+        lv_img_set_src(obj, &bat_0);
+        break;
+      case 1:
+        lv_img_set_src(obj, &bat_1);
+        break;
+      case 2:
+        lv_img_set_src(obj, &bat_2);
+        break;
+      case 3:
+        lv_img_set_src(obj, &bat_3);
+        break;
+      default:
+        lv_img_set_src(obj, &bat_4);
+        break;
       }
-      if (bat_level != prev_bat_level) {
-        switch (bat_level) {
-          case 0:
-            lv_img_set_src(bat_img, &bat_0);
-            break;
-          case 1:
-            lv_img_set_src(bat_img, &bat_1);
-            break;
-          case 2:
-            lv_img_set_src(bat_img, &bat_2);
-            lv_obj_set_hidden(bat_img, false);
-            break;
-          case 3:
-            lv_img_set_src(bat_img, &bat_3);
-            lv_obj_set_hidden(bat_img, false);
-            break;
-          default:
-            lv_img_set_src(bat_img, &bat_4);
-            lv_obj_set_hidden(bat_img, false);
-            break;
-        }
-        prev_bat_level = bat_level;
+    }, 2, BindingTable::NORMAL, 1.0);
+  bindings.add(volt_label, "voltage_battery", [&](lv_obj_t *, float value) {
+      volt_text.set(LabelText().fixed(value, 1, 4).str(" V "));
+    }, 5, BindingTable::NORMAL, 0.05, 11.9);
+  bindings.add(cur_label, "current_battery", [&](lv_obj_t *, float value) {
+      cur_text.set(LabelText().fixed(value, 1, 4).str(" A "));
+    }, 5, BindingTable::NORMAL, 0.05, 10.2);
+
+  // Flight mode
+  // The decoder of the detected protocol names the mode (see ProtocolDecoder::set_mode()).
+  int mode_name_id = telem.key_id("mode_name");
+  bindings.add(mode_label, "mode_name", [&](lv_obj_t *, float) {
+      char name[LABEL_TEXT_LEN];
+      if (telem.get_text(mode_name_id, name, sizeof(name))) {
+        mode_text.set(LabelText().str(name));
       }
-      if (bat_level < 2) {
-        lv_obj_set_hidden(bat_img, blink_on);
+    }, 5, BindingTable::HIGH);
+
+  // GPS stats
+  // The satellite icon shows the worst of the satellite count and HDOP status.
+  AlarmIndicator sats_alarm(AlarmIndicator::TEXT);
+  sats_alarm.add(sats_label);
+  sats_alarm.add(nsats_label);
+  AlarmIndicator hdop_alarm(AlarmIndicator::TEXT);
+  hdop_alarm.add(hdop_label);
+  hdop_alarm.add(hdopl_label);
+  AlarmIndicator gps_alarm(AlarmIndicator::IMAGE);
+  gps_alarm.add(satellite_img);
+  auto set_gps_status = [&]() {
+    gps_alarm.set_level(std::max(sats_alarm.level(), hdop_alarm.level()));
+  };
+  bindings.add(sats_label, "gps_num_sats", [&](lv_obj_t *, float value) {
+      sats_text.set(LabelText().num(int(value + 0.5), 2));
+      sats_alarm.set_level((value < 5) ? AlarmIndicator::CRITICAL :
+                           (value < 8) ? AlarmIndicator::WARN : AlarmIndicator::NORMAL);
+      set_gps_status();
+    }, 1, BindingTable::LOW);
+  bindings.add(hdop_label, "gps_HDOP", [&](lv_obj_t *, float value) {
+      hdop_text.set(LabelText().fixed(value, 1, 5));
+      hdop_alarm.set_level((value > 15) ? AlarmIndicator::CRITICAL :
+                           (value > 9) ? AlarmIndicator::WARN : AlarmIndicator::NORMAL);
+      set_gps_status();
+    }, 1, BindingTable::LOW, 0.05);
+
+  // Downlink stats
+  bindings.add(rssi_down_label, "rx_video_rssi", [&](lv_obj_t *, float value) {
+      rssi_text.set(LabelText().fixed(value, 1, 6));
+    }, 5);
+  bindings.add(rssi_gauge, "rx_video_rssi", [](lv_obj_t *obj, float value) {
+      lv_gauge_set_value(obj, 0, value);
+    }, 5);
+  bindings.add(rssi_gauge, "tx_rssi", [](lv_obj_t *obj, float value) {
+      lv_gauge_set_value(obj, 1, value);
+    }, 5);
+  bindings.add(rx_bitrate_label, "rx_video_bitrate", [&](lv_obj_t *, float value) {
+      bitrate_text.set(LabelText().fixed(value * 1e-6, 1, 4));
+    }, 2, BindingTable::LOW, 5e4);
+  bindings.add(video_gauge, "rx_video_dropped_packet_perc", [](lv_obj_t *obj, float value) {
+      lv_gauge_set_value(obj, 0, int(rint(std::min(value * 100.0, 20.0))));
+    }, 5);
+  bindings.add(video_gauge, "rx_video_bad_blocks", [](lv_obj_t *obj, float value) {
+      lv_gauge_set_value(obj, 1, int(rint(value)));
+    }, 5);
+  bindings.add(video_gauge, "rx_video_inject_errors", [](lv_obj_t *obj, float value) {
+      lv_gauge_set_value(obj, 2, int(rint(value)));
+    }, 5);
+
+  // The attitude, compass and home arrow are drawn by the GPU HUD over the video while it's
+  // active (FFmpeg build only), and by the LVGL widgets otherwise. Only the main loop changes
+  // which one draws them (see swap_hud below).
+  HudState &hud = hud_state();
+  bool hud_active = false;
+#if USE_FFMPEG_MONITOR
+  // The HUD takes every change of the heading and home direction.
+  const float rotation_rate = 0;
+#else
+  const float rotation_rate = 20;
+#endif
+
+  // Attitude, which is updated whenever the display is refreshed
+  bindings.add(layout.get("attitude"), "roll", [&](lv_obj_t *, float value) {
+      if (hud_active) {
+        hud.set_roll(value);
+      } else {
+        attitude.set_roll(value);
       }
-      float voltage = 11.9;
-      telem.get_value("voltage_battery", voltage);
-      lv_label_set_text_fmt(volt_label, "%4.1f V ", voltage);
-      float current = 10.2;
-      telem.get_value("current_battery", current);
-      lv_label_set_text_fmt(cur_label, "%4.1f A ", current);
-
-      // Set the mode text.
-      float mode_val = 0;
-      if (!telem.get_value("mode", mode_val)) {
-        mode_val = 0;
+    }, 0, BindingTable::HIGH, 0.002);
+  bindings.add(layout.get("attitude"), "pitch", [&](lv_obj_t *, float value) {
+      if (hud_active) {
+        hud.set_pitch(value);
+      } else {
+        attitude.set_pitch(value);
       }
-      uint32_t mode = static_cast<uint32_t>(mode_val);
-      lv_label_set_text(mode_label, g_arducopter_mode_strings[mode]);
-
-      // Set the GPS stats
-      float sats_vis = 0;
-      float hdop = 0;
-      telem.get_value("gps_num_sats", sats_vis);
-      telem.get_value("gps_HDOP", hdop);
-      // sats_vis < 8  sats_vis < 6   hdop > 15  hdop > 9
-      lv_label_set_text_fmt(sats_label, "%2d", int(sats_vis + 0.5));
-      lv_label_set_text_fmt(hdop_label, "%5.1f", hdop);
-      uint8_t gps_error_level = 0;
-      if (sats_vis < 5) {
-        lv_obj_set_style_local_text_color(sats_label, LV_LABEL_PART_MAIN, LV_STATE_DEFAULT,
-                                          LV_COLOR_RED);
-        lv_obj_set_style_local_text_color(nsats_label, LV_LABEL_PART_MAIN, LV_STATE_DEFAULT,
-                                          LV_COLOR_RED);
-        gps_error_level = 2;
-      } else if (sats_vis < 8) {
-        lv_obj_set_style_local_text_color(sats_label, LV_LABEL_PART_MAIN, LV_STATE_DEFAULT,
-                                          LV_COLOR_YELLOW);
-        lv_obj_set_style_local_text_color(nsats_label, LV_LABEL_PART_MAIN, LV_STATE_DEFAULT,
-                                          LV_COLOR_YELLOW);
-        gps_error_level = 1;
+    }, 0, BindingTable::HIGH, 0.002);
+
+  // The compass and home arrow are rotated in advance, rather than by LVGL on every change.
+  RotationCache compass_rotation(compass_img);
+  RotationCache home_rotation(home_img);
+  bindings.add(compass_img, "heading", [&](lv_obj_t *, float value) {
+      if (hud_active) {
+        hud.set_heading(value);
       } else {
-        lv_obj_set_style_local_text_color(sats_label, LV_LABEL_PART_MAIN, LV_STATE_DEFAULT,
-                                          LV_COLOR_WHITE);
-        lv_obj_set_style_local_text_color(nsats_label, LV_LABEL_PART_MAIN, LV_STATE_DEFAULT,
-                                          LV_COLOR_WHITE);
+        compass_rotation.set_angle(360.0 - value);
       }
-      if (hdop > 15) {
-        lv_obj_set_style_local_text_color(hdop_label, LV_LABEL_PART_MAIN, LV_STATE_DEFAULT,
-                                          LV_COLOR_RED);
-        lv_obj_set_style_local_text_color(hdopl_label, LV_LABEL_PART_MAIN, LV_STATE_DEFAULT,
-                                          LV_COLOR_RED);
-        gps_error_level = 2;
-      } else if (hdop > 9) {
-        lv_obj_set_style_local_text_color(hdop_label, LV_LABEL_PART_MAIN, LV_STATE_DEFAULT,
-                                          LV_COLOR_YELLOW);
-        lv_obj_set_style_local_text_color(hdopl_label, LV_LABEL_PART_MAIN, LV_STATE_DEFAULT,
-                                          LV_COLOR_YELLOW);
-        gps_error_level = (gps_error_level == 2) ? 2 : 1;
+    }, rotation_rate, BindingTable::HIGH);
+  bindings.add(home_img, "home_direction", [&](lv_obj_t *, float value) {
+      if (hud_active) {
+        hud.set_home_direction(value);
       } else {
-        lv_obj_set_style_local_text_color(hdop_label, LV_LABEL_PART_MAIN, LV_STATE_DEFAULT,
-                                          LV_COLOR_WHITE);
-        lv_obj_set_style_local_text_color(hdopl_label, LV_LABEL_PART_MAIN, LV_STATE_DEFAULT,
-                                          LV_COLOR_WHITE);
+        home_rotation.set_angle(value);
       }
-      switch (gps_error_level) {
-      case 2:
-        if (blink_on) {
-          lv_obj_set_style_local_image_recolor_opa(satellite_img, LV_IMG_PART_MAIN,
-                                                   LV_STATE_DEFAULT, LV_OPA_COVER);
-          lv_obj_set_style_local_image_recolor(satellite_img, LV_IMG_PART_MAIN,
-                                               LV_STATE_DEFAULT, LV_COLOR_RED);
-        } else {
-          lv_obj_set_style_local_image_recolor_opa(satellite_img, LV_IMG_PART_MAIN,
-                                                   LV_STATE_DEFAULT, LV_OPA_COVER);
-          lv_obj_set_style_local_image_recolor(satellite_img, LV_IMG_PART_MAIN,
-                                               LV_STATE_DEFAULT, LV_COLOR_WHITE);
-        }
-        break;
-      case 1:
-        lv_obj_set_style_local_image_recolor_opa(satellite_img, LV_IMG_PART_MAIN,
-                                                 LV_STATE_DEFAULT, LV_OPA_COVER);
-        lv_obj_set_style_local_image_recolor(satellite_img, LV_IMG_PART_MAIN,
-                                             LV_STATE_DEFAULT, LV_COLOR_YELLOW);
-        break;
-      default:
-        lv_obj_set_style_local_image_recolor_opa(satellite_img, LV_IMG_PART_MAIN,
-                                                 LV_STATE_DEFAULT, LV_OPA_COVER);
-        lv_obj_set_style_local_image_recolor(satellite_img, LV_IMG_PART_MAIN,
-                                             LV_STATE_DEFAULT, LV_COLOR_GREEN);
-        break;
+    }, rotation_rate, BindingTable::HIGH, 0, 90.0);
+
+#if USE_FFMPEG_MONITOR
+  // The video thread draws the horizon, a heading tape and the home arrow in GL at the
+  // positions of the LVGL widgets that they replace.
+  auto hud_area = [](lv_obj_t *obj) {
+    lv_area_t a;
+    lv_obj_get_coords(obj, &a);
+    HudRect r = { float(a.x1), float(a.y1), float(lv_area_get_width(&a)),
+                  float(lv_area_get_height(&a)) };
+    if (lv_obj_get_hidden(obj)) {
+      r.width = r.height = 0;
+    }
+    return r;
+  };
+  HudRect compass_area = hud_area(compass_img);
+  HudRect tape = { compass_area.x + compass_area.width / 2 - 200 * scale, 8 * scale,
+                   400 * scale, 40 * scale };
+  if (compass_area.width == 0) {
+    tape.width = 0;
+  }
+  hud.set_layout(hud_area(layout.get("attitude")), tape, hud_area(home_img), 8 * scale, scale);
+  hud.enable();
+
+  // The LVGL widgets are hidden once the video thread has initialized the HUD, and shown again
+  // if it stops drawing it (or never does, e.g. because the GPU doesn't support it). The
+  // current values are handed to whichever draws them now.
+  std::vector<lv_obj_t*> hud_objs;
+  for (lv_obj_t *obj : { layout.get("attitude"), compass_img, home_img }) {
+    if (!lv_obj_get_hidden(obj)) {
+      hud_objs.push_back(obj);
+    }
+  }
+  auto swap_hud = [&]() {
+    bool active = hud.active();
+    if (active == hud_active) {
+      return;
+    }
+    hud_active = active;
+    for (lv_obj_t *obj : hud_objs) {
+      lv_obj_set_hidden(obj, active);
+    }
+    float roll = 0, pitch = 0, heading = 0, home_direction = 90.0;
+    telem.get_value("roll", roll);
+    telem.get_value("pitch", pitch);
+    telem.get_value("heading", heading);
+    bool have_home = telem.get_value("home_direction", home_direction);
+    if (active) {
+      hud.set_roll(roll);
+      hud.set_pitch(pitch);
+      hud.set_heading(heading);
+      if (have_home) {
+        hud.set_home_direction(home_direction);
+      }
+    } else {
+      attitude.set_roll(roll);
+      attitude.set_pitch(pitch);
+      compass_rotation.set_angle(360.0 - heading);
+      home_rotation.set_angle(home_direction);
+    }
+  };
+#endif
+
+  // Heading
+  bindings.add(orientation_label, "heading", [&](lv_obj_t *, float value) {
+      heading_text.set(LabelText().fixed(value, 1, 5));
+    }, 20, BindingTable::HIGH);
+
+  // Blink the critical alarms
+  std::vector<AlarmIndicator*> blink_alarms = { &bat_alarm, &gps_alarm };
+  lv_task_create([](lv_task_t *task) {
+      static bool blink_on = false;
+      blink_on = !blink_on;
+      for (AlarmIndicator *alarm : *static_cast<std::vector<AlarmIndicator*>*>(task->user_data)) {
+        alarm->blink(blink_on);
       }
+    }, 500, LV_TASK_PRIO_LOW, &blink_alarms);
+
+  // Telemetry changes wake up the main loop
+  EventLoop event_loop;
+  telem.set_change_callback([&event_loop]() { event_loop.notify(); });
+#if USE_FFMPEG_MONITOR
+  // and so does the video thread when the GPU HUD starts or stops
+  hud.set_active_callback([&event_loop]() { event_loop.notify(); });
+#endif
+
+  /* Handle LitlevGL tasks (tickless mode) */
+  // The display refresh task is paused while there is nothing to redraw, so the loop sleeps
+  // until a telemetry value changes or the next LVGL task is due.
+  lv_disp_t *disp = lv_disp_get_default();
+  FrameGovernor governor(disp, bindings, telem);
+  while (1) {
 
-      // Set the downlink stats
-      float rx_rssi = 0;
-      float rx_video_packet_count = 0;
-      float rx_video_rssi = 0;
-      float rx_video_dropped_packets = 0;
-      float rx_video_bad_blocks = 0;
-      float rx_video_bitrate = 0;
-      float rx_video_dropped_packet_perc = 0;
-      float rx_video_inject_errors = 0;
-      float tx_rssi = 0;
-      float tx_dropped_packets = 0;
-      telem.get_value("rx_video_rssi", rx_rssi);
-      telem.get_value("rx_video_packet_count", rx_video_packet_count);
-      telem.get_value("rx_video_bitrate", rx_video_bitrate);
-      telem.get_value("rx_video_dropped_packets", rx_video_dropped_packets);
-      telem.get_value("rx_video_bad_blocks", rx_video_bad_blocks);
-      telem.get_value("rx_video_dropped_packet_perc", rx_video_dropped_packet_perc);
-      telem.get_value("rx_video_inject_errors", rx_video_inject_errors);
-      telem.get_value("tx_rssi", tx_rssi);
-      telem.get_value("tx_dropped_packets", tx_dropped_packets);
-      lv_label_set_text_fmt(rssi_down_label, "%6.1f", rx_rssi);
-      lv_label_set_text_fmt(rx_bitrate_label, "%4.1f",
-                            rx_video_bitrate * 1e-6);
-      lv_gauge_set_value(rssi_gauge, 0, rx_rssi);
-      lv_gauge_set_value(rssi_gauge, 1, tx_rssi);
-      lv_gauge_set_value(video_gauge, 0,
-                         int(rint(std::min(rx_video_dropped_packet_perc * 100.0, 20.0))));
-      lv_gauge_set_value(video_gauge, 1, int(rint(rx_video_bad_blocks)));
-      lv_gauge_set_value(video_gauge, 2, int(rint(rx_video_inject_errors)));
-
-      float heading = 0;
-      float home_direction = 90.0;
-      telem.get_value("heading", heading);
-      telem.get_value("home_direction", home_direction);
-      lv_img_set_angle(compass_img, (360.0 - heading) * 10);
-      lv_label_set_text_fmt(orientation_label, "%5.1f", heading);
-      lv_img_set_angle(home_img, home_direction * 10);
+#if USE_FFMPEG_MONITOR
+    swap_hud();
+#endif
+
+    // Update the widgets of the telemetry values that have changed.
+    // The microsecond clock, since the millisecond LVGL tick wraps after 49.7 days
+    double now = osd_time_us() * 1e-6;
+    double next_update = bindings.update(now);
+    governor.update(now);
+
+    if (disp->inv_p || lv_anim_count_running()) {
+      lv_task_set_prio(disp->refr_task, LV_TASK_PRIO_MID);
+    }
+    uint32_t timeout = lv_task_handler();
+    if (!disp->inv_p && !lv_anim_count_running()) {
+      lv_task_set_prio(disp->refr_task, LV_TASK_PRIO_OFF);
+      timeout = lv_task_handler();
+      // A task (e.g. the alarm blink) may have invalidated a widget, so it's drawn on time.
+      if (disp->inv_p) {
+        lv_task_set_prio(disp->refr_task, LV_TASK_PRIO_MID);
+        timeout = std::min(timeout, disp->refr_task->period);
+      }
+    }
+    if (next_update >= 0) {
+      timeout = std::min(timeout, static_cast<uint32_t>(ceil(next_update * 1000.0)));
     }
 
-    usleep(5 * 1000);
+    event_loop.wait(timeout);
   }
 
   return 0;
@@ -706,3 +581,17 @@ int main(int argc, char **argv) {
 /**********************
  *   STATIC FUNCTIONS
  **********************/
+
+// The built in font closest to a scaled font size (the montserrat fonts come in even sizes from
+// 12 to 48, so small sizes can only be scaled down to 12).
+static const lv_font_t *scaled_font(uint32_t size, float scale) {
+  static const lv_font_t *fonts[] = {
+    &OSD_FONT(12), &OSD_FONT(14), &OSD_FONT(16), &OSD_FONT(18), &OSD_FONT(20), &OSD_FONT(22),
+    &OSD_FONT(24), &OSD_FONT(26), &OSD_FONT(28), &OSD_FONT(30), &OSD_FONT(32), &OSD_FONT(34),
+    &OSD_FONT(36), &OSD_FONT(38), &OSD_FONT(40), &OSD_FONT(42), &OSD_FONT(44), &OSD_FONT(46),
+    &OSD_FONT(48)
+  };
+  const int32_t count = sizeof(fonts) / sizeof(fonts[0]);
+  int32_t i = static_cast<int32_t>(lroundf((size * scale - 12) / 2));
+  return fonts[std::max<int32_t>(0, std::min<int32_t>(i, count - 1))];
+}
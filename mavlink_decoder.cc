@@ -0,0 +1,382 @@
+
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+
+#include <mavlink_decoder.hh>
+#include <param_cache.hh>
+#include <logger.hh>
+
+// The MAVLink IDs that the OSD uses when sending requests.
+#define OSD_SYSTEM_ID 255
+#define OSD_COMPONENT_ID 191
+// The component ID of the autopilot.
+#define AUTOPILOT_COMPONENT_ID 1
+
+// The flight mode names of the ArduPilot custom_mode numbers
+static const char *g_arducopter_mode_strings[] = {
+  "Stabilize", // manual airframe angle with manual throttle
+  "Acro",      // manual body-frame angular rate with manual throttle
+  "Alt Hold",  // manual airframe angle with automatic throttle
+  "Auto",      // fully automatic waypoint control using mission commands
+  "Guided",    // fully automatic fly to coordinate or fly at velocity/direction using GCS immediate commands
+  "Loiter",    // automatic horizontal acceleration with automatic throttle
+  "RTL",       // automatic return to launching point
+  "Circle",    // automatic circular flight with automatic throttle
+  "Land",      // automatic landing with horizontal position control
+  "Drift",     // semi-automous position, yaw and throttle control
+  "Sport",     // manual earth-frame angular rate control with manual throttle
+  "Flip",      // automatically flip the vehicle on the roll axis
+  "Autotune",  // automatically tune the vehicle's roll and pitch gains
+  "Poshold",   // automatic position hold with manual override, with automatic throttle
+  "Brake",     // full-brake using inertial/GPS system, no pilot input
+  "Throw",     // throw to launch mode using inertial/GPS system, no pilot input
+  "Avoid",     // automatic avoidance of obstacles in the macro scale - e.g. full-sized aircraft
+  "Guided",    // guided mode but only accepts attitude and altitude
+};
+// ArduPlane (any fixed wing vehicle), the rest use the ArduCopter modes
+static const char *g_arduplane_mode_strings[] = {
+ "Manual",
+ "Circle",
+ "Stabilize",
+ "Training",
+ "Acro",
+ "Fly By Wire A",
+ "Fly By Wire B",
+ "Cruise",
+ "Autotune",
+ "Auto",
+ "RTL",
+ "Loiter",
+ "Takeoff",
+ "Avoid ADSB",
+ "Guided",
+ "Initializing",
+ "QStabilize",
+ "QHover",
+ "QLoiter",
+ "QLand",
+ "QRTL",
+ "QAutotune",
+ "QAcro"
+};
+
+MAVLinkDecoder::MAVLinkDecoder(Telemetry &telem) :
+  ProtocolDecoder(telem), m_sysid(0), m_compid(0), m_target_sysid(1),
+  m_target_compid(AUTOPILOT_COMPONENT_ID), m_rec_bat_status(false), m_messages_requested(false),
+  m_dropped(0) {
+
+  // The parameter cache sends its requests to the autopilot.
+  params().set_request_callbacks
+    ([this]() {
+       // Request the AUTOPILOT_VERSION message, which contains the vehicle UID.
+       // Older autopilots only support the deprecated capabilities request.
+       mavlink_message_t msg;
+       mavlink_msg_command_long_pack(OSD_SYSTEM_ID, OSD_COMPONENT_ID, &msg,
+                                     m_target_sysid, m_target_compid,
+                                     MAV_CMD_REQUEST_MESSAGE, 0,
+                                     MAVLINK_MSG_ID_AUTOPILOT_VERSION, 0, 0, 0, 0, 0, 0);
+       send_message(msg);
+       mavlink_msg_command_long_pack(OSD_SYSTEM_ID, OSD_COMPONENT_ID, &msg,
+                                     m_target_sysid, m_target_compid,
+                                     MAV_CMD_REQUEST_AUTOPILOT_CAPABILITIES, 0,
+                                     1, 0, 0, 0, 0, 0, 0);
+       send_message(msg);
+     },
+     [this]() {
+       mavlink_message_t msg;
+       mavlink_msg_param_request_list_pack(OSD_SYSTEM_ID, OSD_COMPONENT_ID, &msg,
+                                           m_target_sysid, m_target_compid);
+       send_message(msg);
+     },
+     [this](const char *id, int16_t index) {
+       mavlink_message_t msg;
+       mavlink_msg_param_request_read_pack(OSD_SYSTEM_ID, OSD_COMPONENT_ID, &msg,
+                                           m_target_sysid, m_target_compid, id, index);
+       send_message(msg);
+     });
+}
+
+static double monotonic_time() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return double(t.tv_sec) + double(t.tv_nsec) * 1e-9;
+}
+
+bool MAVLinkDecoder::parse(uint8_t c) {
+  bool received = mavlink_parse_char(MAVLINK_COMM_0, c, &m_msg, &m_status);
+
+  // The returned status reports the parse errors (e.g. bad CRCs) since the previous byte.
+  m_dropped += m_status.packet_rx_drop_count;
+  if (!received) {
+    return false;
+  }
+  m_sysid = m_msg.sysid;
+  m_compid = m_msg.compid;
+
+  // Track the sequence numbers to estimate the link quality, and export the statistics
+  // once a second.
+  double time = monotonic_time();
+  if (m_link_quality.update(time)) {
+    export_link_quality();
+  }
+  m_link_quality.add_dropped(m_dropped);
+  m_dropped = 0;
+  m_link_quality.add(m_msg.sysid, m_msg.compid, m_msg.seq,
+                     (m_msg.msgid == MAVLINK_MSG_ID_HEARTBEAT), time);
+
+  handle_message(m_msg, time);
+  params().tick(time);
+  return true;
+}
+
+void MAVLinkDecoder::reset() {
+  mavlink_reset_channel_status(MAVLINK_COMM_0);
+}
+
+void MAVLinkDecoder::handle_message(const mavlink_message_t &msg, double time) {
+  switch (msg.msgid) {
+  case MAVLINK_MSG_ID_POWER_STATUS:
+    break;
+  case MAVLINK_MSG_ID_SYS_STATUS:
+    mavlink_sys_status_t sys_status;
+    mavlink_msg_sys_status_decode(&msg, &sys_status);
+    if (!m_rec_bat_status) {
+      set_value("voltage_battery", sys_status.voltage_battery / 1000.0);
+      set_value("current_battery",
+                std::max(sys_status.current_battery, static_cast<short>(0)) / 100.0);
+      set_value("battery_remaining", sys_status.battery_remaining);
+    }
+    break;
+  case MAVLINK_MSG_ID_NAV_CONTROLLER_OUTPUT:
+    mavlink_nav_controller_output_t nav;
+    mavlink_msg_nav_controller_output_decode(&msg, &nav);
+    break;
+  case MAVLINK_MSG_ID_GLOBAL_POSITION_INT:
+    mavlink_global_position_int_t pos;
+    mavlink_msg_global_position_int_decode(&msg, &pos);
+    set_value("latitude", static_cast<float>(pos.lat) * 1e-7);
+    set_value("longitude", static_cast<float>(pos.lon) * 1e-7);
+    set_value("altitude", static_cast<float>(pos.alt) / 1000.0);
+    set_value("relative_altitude", static_cast<float>(pos.relative_alt) / 1000.0);
+    set_value("speed", sqrt(pos.vx * pos.vx + pos.vy * pos.vy + pos.vz * pos.vz) / 100.0);
+    // iNav is raw degrees (no scaling).
+    //set_value("heading", static_cast<float>(pos.hdg));
+    set_value("heading", static_cast<float>(pos.hdg) / 100.0);
+    break;
+  case MAVLINK_MSG_ID_ATTITUDE:
+    mavlink_attitude_t att;
+    mavlink_msg_attitude_decode(&msg, &att);
+    set_value("roll", att.roll);
+    set_value("pitch", att.pitch);
+    set_value("yaw", att.yaw);
+    break;
+  case MAVLINK_MSG_ID_STATUSTEXT:
+    mavlink_statustext_t status;
+    mavlink_msg_statustext_decode(&msg, &status);
+    break;
+  case MAVLINK_MSG_ID_MISSION_CURRENT:
+    //std::cerr << "Mission current " << std::endl;
+    break;
+  case MAVLINK_MSG_ID_SERVO_OUTPUT_RAW:
+    //std::cerr << "Servo raw " << std::endl;
+    break;
+  case MAVLINK_MSG_ID_RC_CHANNELS:
+    break;
+  case MAVLINK_MSG_ID_PARAM_VALUE: {
+    mavlink_param_value_t param;
+    mavlink_msg_param_value_decode(&msg, &param);
+    params().param_value(param.param_id, param.param_value, param.param_type,
+                         param.param_count, param.param_index, time);
+    break;
+  }
+  case MAVLINK_MSG_ID_VIBRATION:
+    //std::cerr << "Vibration " << std::endl;
+    break;
+  case MAVLINK_MSG_ID_HEARTBEAT: {
+    mavlink_heartbeat_t hb;
+    mavlink_msg_heartbeat_decode(&msg, &hb);
+    bool is_armed = (hb.base_mode & 0x80);
+    set_value("armed", is_armed ? 1.0 : 0.0);
+    if (hb.type == MAV_TYPE_FIXED_WING) {
+      set_mode(hb.custom_mode, g_arduplane_mode_strings,
+               sizeof(g_arduplane_mode_strings) / sizeof(g_arduplane_mode_strings[0]));
+    } else {
+      set_mode(hb.custom_mode, g_arducopter_mode_strings,
+               sizeof(g_arducopter_mode_strings) / sizeof(g_arducopter_mode_strings[0]));
+    }
+    if (!m_messages_requested) {
+      request_messages();
+    }
+    if (msg.compid == AUTOPILOT_COMPONENT_ID) {
+      m_target_sysid = msg.sysid;
+      m_target_compid = msg.compid;
+      params().heartbeat(time);
+    }
+    break;
+  }
+  case MAVLINK_MSG_ID_VFR_HUD:
+    //std::cerr << "VFR HUD " << std::endl;
+    break;
+  case MAVLINK_MSG_ID_RAW_IMU:
+    //std::cerr << "Raw IMU " << std::endl;
+    break;
+  case MAVLINK_MSG_ID_SCALED_PRESSURE:
+    //std::cerr << "Scaled Pressure " << std::endl;
+    break;
+  case MAVLINK_MSG_ID_GPS_RAW_INT:
+    mavlink_gps_raw_int_t rawgps;
+    mavlink_msg_gps_raw_int_decode(&msg, &rawgps);
+    set_value("gps_fix_type", rawgps.fix_type);
+    set_value("gps_HDOP", rawgps.eph / 100.0);
+    set_value("gps_VDOP", rawgps.epv / 100.0);
+    if (rawgps.vel != UINT16_MAX) {
+      set_value("gps_velosity", rawgps.vel / 100.0);
+    }
+    if (rawgps.cog != UINT16_MAX) {
+      set_value("gps_ground_course", rawgps.cog * 100.0);
+    }
+    if (rawgps.satellites_visible != 255) {
+      set_value("gps_num_sats", rawgps.satellites_visible);
+    }
+    //std::cerr << "GSP Raw " << std::endl;
+    break;
+  case MAVLINK_MSG_ID_SYSTEM_TIME:
+    //std::cerr << "System Time " << std::endl;
+    break;
+  case MAVLINK_MSG_ID_LOCAL_POSITION_NED:
+    //std::cerr << "Local position " << std::endl;
+    break;
+  case MAVLINK_MSG_ID_AUTOPILOT_VERSION: {
+    mavlink_autopilot_version_t version;
+    mavlink_msg_autopilot_version_decode(&msg, &version);
+    params().autopilot_version(version.uid, version.uid2, sizeof(version.uid2), time);
+    break;
+  }
+  case MAVLINK_MSG_ID_COMMAND_ACK:
+    //std::cerr << "Command ACK " << std::endl;
+    break;
+  case MAVLINK_MSG_ID_BATTERY_STATUS:
+    mavlink_battery_status_t bat;
+    mavlink_msg_battery_status_decode(&msg, &bat);
+/*
+    if (bat.voltages[0] != INT16_MAX) {
+      set_value("voltage_battery", bat.voltages[0] / 1000.0);
+      set_value("current_battery",
+                std::max(bat.current_battery, static_cast<short>(0)) / 100.0);
+      set_value("battery_remaining", bat.battery_remaining);
+      m_rec_bat_status = true;
+    }
+*/
+    break;
+  case MAVLINK_MSG_ID_HOME_POSITION:
+    mavlink_home_position_t home;
+    mavlink_msg_home_position_decode(&msg, &home);
+    set_value("home_latitude", home.latitude * 1e-7);
+    set_value("home_longitude", home.longitude * 1e-7);
+    set_value("home_altitude", home.altitude);
+    break;
+  case MAVLINK_MSG_ID_RC_CHANNELS_RAW:
+    {
+      mavlink_rc_channels_raw_t rc;
+      mavlink_msg_rc_channels_raw_decode(&msg, &rc);
+      set_value("chan1", rc.chan1_raw);
+      set_value("chan2", rc.chan2_raw);
+      set_value("chan3", rc.chan3_raw);
+      set_value("chan4", rc.chan4_raw);
+      set_value("chan5", rc.chan5_raw);
+      set_value("chan6", rc.chan6_raw);
+      set_value("chan7", rc.chan7_raw);
+      set_value("chan8", rc.chan8_raw);
+      set_value("rc_rssi", 70.0 * static_cast<float>(rc.rssi) / 255.0 - 90.0);
+    }
+    break;
+  case MAVLINK_MSG_ID_GPS_GLOBAL_ORIGIN:
+    {
+      mavlink_gps_global_origin_t origin;
+      mavlink_msg_gps_global_origin_decode(&msg, &origin);
+      set_value("home_latitude", origin.latitude * 1e-7);
+      set_value("home_longitude", origin.longitude * 1e-7);
+      set_value("home_altitude", origin.altitude);
+      // Calculate the home direction.
+      float gps_lat = 0;
+      float gps_lon = 0;
+      get_value("latitude", gps_lat);
+      get_value("longitude", gps_lon);
+      if ((gps_lat != 0) || (gps_lon != 0)) {
+        gps_lat *= M_PI / 180.0;
+        gps_lon *= M_PI / 180.0;
+        double hlat = origin.latitude * M_PI / 180.0;
+        double hlon = origin.latitude * M_PI / 180.0;
+        double dlon = hlon - gps_lon;
+        double x = sin(dlon) * sin(hlat);
+        double y = cos(gps_lat) * sin(hlat) - sin(gps_lat) * cos(hlat) * cos(dlon);
+        double hdir = atan2(y, x) * 180.0 / M_PI;
+        set_value("home_direction", hdir);
+      }
+    }
+    break;
+  default:
+    LOG_DEBUG("Received packet: SYS: %d, COMP: %d, LEN: %d, MSG ID: %u",
+              msg.sysid, msg.compid, msg.len, static_cast<unsigned int>(msg.msgid));
+    break;
+  }
+}
+
+void MAVLinkDecoder::send_message(const mavlink_message_t &msg) {
+  uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+  uint16_t len = mavlink_msg_to_send_buffer(buf, &msg);
+  send(buf, len);
+}
+
+void MAVLinkDecoder::request_messages() {
+  const uint8_t MAVStreams[] = {
+                                MAV_DATA_STREAM_RAW_SENSORS,
+                                MAV_DATA_STREAM_EXTENDED_STATUS,
+                                MAV_DATA_STREAM_RC_CHANNELS,
+                                MAV_DATA_STREAM_POSITION,
+                                MAV_DATA_STREAM_EXTRA1,
+                                MAV_DATA_STREAM_EXTRA2,
+                                MAVLINK_MSG_ID_ATTITUDE,
+                                MAVLINK_MSG_ID_RADIO_STATUS
+  };
+  const uint16_t MAVRates[] = { 2, 5, 2, 5, 2, 2, 20, 2 };
+  uint8_t data[MAVLINK_MAX_PACKET_LEN];
+  for (size_t i = 0; i < sizeof(MAVStreams); ++i) {
+/*
+    int len = mavlink_msg_request_data_stream_pack(m_sysid, m_compid,
+                                                   reinterpret_cast<mavlink_message_t*>(data),
+                                                   1, 1, MAVStreams[i], MAVRates[i], 1);
+    m_send_sock.send_to(boost::asio::buffer(data, len), m_sender_endpoint);
+*/
+    int len = mavlink_msg_message_interval_pack(m_sysid, m_compid,
+                                                reinterpret_cast<mavlink_message_t*>(data),
+                                                MAVStreams[i], 1000000 / MAVRates[i]);
+    //m_recv_sock.send_to(boost::asio::buffer(data, len), m_sender_endpoint);
+  }
+  m_messages_requested = true;
+}
+
+void MAVLinkDecoder::export_link_quality() {
+  static const char *burst_names[LinkQuality::BURST_BINS] = {
+    "telem_burst_1", "telem_burst_2", "telem_burst_3_4",
+    "telem_burst_5_8", "telem_burst_9_16", "telem_burst_17"
+  };
+  set_value("telem_received", m_link_quality.received());
+  set_value("telem_lost", m_link_quality.lost());
+  set_value("telem_loss_perc", m_link_quality.loss_percent());
+  set_value("telem_crc_errors", m_link_quality.dropped());
+  set_value("telem_max_burst", m_link_quality.max_burst());
+  for (int i = 0; i < LinkQuality::BURST_BINS; ++i) {
+    set_value(burst_names[i], m_link_quality.burst_count(i));
+  }
+  set_value("telem_jitter", m_link_quality.jitter() * 1000.0);
+
+  // Also export the loss for each of the sources on the link (autopilot, camera, etc).
+  m_link_quality.for_each_source([this](uint8_t sysid, uint8_t compid) {
+    char name[32];
+    snprintf(name, sizeof(name), "telem_loss_perc_%d_%d", sysid, compid);
+    set_value(std::string(name), m_link_quality.loss_percent(sysid, compid));
+  });
+}
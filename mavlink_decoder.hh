@@ -0,0 +1,35 @@
+#pragma once
+
+#include <mavlink.h>
+
+#include <protocol_decoder.hh>
+#include <link_quality.hh>
+
+// Decodes the MAVLink (v1 and v2) messages sent by ArduPilot, PX4 and iNav.
+class MAVLinkDecoder : public ProtocolDecoder {
+public:
+
+  MAVLinkDecoder(Telemetry &telem);
+
+  const char *name() const { return "MAVLink"; }
+  bool parse(uint8_t c);
+  void reset();
+
+private:
+
+  void handle_message(const mavlink_message_t &msg, double time);
+  void request_messages();
+  void send_message(const mavlink_message_t &msg);
+  void export_link_quality();
+
+  mavlink_message_t m_msg;
+  mavlink_status_t m_status;
+  uint8_t m_sysid;
+  uint8_t m_compid;
+  uint8_t m_target_sysid;
+  uint8_t m_target_compid;
+  bool m_rec_bat_status;
+  bool m_messages_requested;
+  uint32_t m_dropped;
+  LinkQuality m_link_quality;
+};
@@ -17,6 +17,10 @@
 #include <stdbool.h>
 #include <string.h>
 #include MONITOR_SDL_INCLUDE_PATH
+#include "osd_tick.h"
+#include "frame_stats.h"
+#include "color_convert.h"
+#include "simd_blend.h"
 #ifdef USE_MPV
 #include <GL/gl.h>
 #include <mpv/client.h>
@@ -30,14 +34,17 @@
 #define MONITOR_ZOOM        1
 #endif
 
-#ifndef MONITOR_HOR_RES
-#define MONITOR_HOR_RES        LV_HOR_RES
+/*The resolution of a window, or if the desktop size isn't known*/
+#ifndef MONITOR_DEFAULT_HOR_RES
+#define MONITOR_DEFAULT_HOR_RES  1280
 #endif
 
-#ifndef MONITOR_VER_RES
-#define MONITOR_VER_RES        LV_VER_RES
+#ifndef MONITOR_DEFAULT_VER_RES
+#define MONITOR_DEFAULT_VER_RES  720
 #endif
 
+#define MONITOR_DRAW_LINES       120
+
 /**********************
  *      TYPEDEFS
  **********************/
@@ -46,17 +53,19 @@ typedef struct {
   SDL_Renderer * renderer;
   SDL_Texture * texture;
   volatile bool sdl_refr_qry;
+  lv_coord_t hor_res;
+  lv_coord_t ver_res;
 #if MONITOR_DOUBLE_BUFFERED
   uint32_t * tft_fb_act;
 #else
-  uint32_t tft_fb[LV_HOR_RES_MAX * LV_VER_RES_MAX];
+  uint32_t * tft_fb;
 #endif
 } monitor_t;
 
 /**********************
  *  STATIC PROTOTYPES
  **********************/
-static int tick_thread(void *data);
+static void choose_resolution(monitor_t * m);
 static void window_create(monitor_t * m);
 static void window_update();
 static void redraw();
@@ -105,23 +114,28 @@ void monitor_init(const char *url) {
   monitor_sdl_init();
   lv_task_create(sdl_event_handler, 10, LV_TASK_PRIO_HIGH, NULL);
 
-  /*Create a display buffer*/
+  /*Create a display buffer (the width of the display, which is chosen at runtime)*/
   static lv_disp_buf_t disp_buf1;
-  static lv_color_t buf1_1[LV_HOR_RES_MAX * 120];
-  lv_disp_buf_init(&disp_buf1, buf1_1, NULL, LV_HOR_RES_MAX * 120);
+  uint32_t buf_size = monitor.hor_res * MONITOR_DRAW_LINES;
+  lv_color_t * buf1_1 = malloc(buf_size * sizeof(lv_color_t));
+  lv_disp_buf_init(&disp_buf1, buf1_1, NULL, buf_size);
 
   /*Create a display*/
   lv_disp_drv_t disp_drv;
   lv_disp_drv_init(&disp_drv); /*Basic initialization*/
   disp_drv.buffer = &disp_buf1;
   disp_drv.flush_cb = monitor_flush;
+  disp_drv.hor_res = monitor.hor_res;
+  disp_drv.ver_res = monitor.ver_res;
+  /*LVGL's fills and blends, with the fastest instruction set that the CPU has*/
+  simd_isa_t isa = simd_best_isa();
+  if(simd_set_callbacks(&disp_drv, isa)) {
+    printf("Blending the OSD with %s\n", simd_isa_name(isa));
+  }
+  /*and the conversion of its colors in the flush (below 32 bit colors)*/
+  color_convert_set_isa(isa);
   lv_disp_drv_register(&disp_drv);
 
-  /* Tick init.
-   * You have to call 'lv_tick_inc()' in periodically to inform LittelvGL about
-   * how much time were elapsed Create an SDL thread to do this*/
-  SDL_CreateThread(tick_thread, "tick", NULL);
-
 #ifdef USE_MPV
   const char *cmd[] = {"loadfile", url, NULL};
   mpv_set_option_string(mpv, "gpu-context", "drm");
@@ -173,23 +187,11 @@ void monitor_flush(lv_disp_drv_t * disp_drv, const lv_area_t * area, lv_color_t
   lv_disp_flush_ready(disp_drv);
 #else
 
-  int32_t y;
-#if LV_COLOR_DEPTH != 24 && LV_COLOR_DEPTH != 32    /*32 is valid but support 24 for backward compatibility too*/
-  int32_t x;
-  for(y = area->y1; y <= area->y2 && y < disp_drv->ver_res; y++) {
-    for(x = area->x1; x <= area->x2; x++) {
-      monitor.tft_fb[y * disp_drv->hor_res + x] = lv_color_to32(*color_p);
-      color_p++;
-    }
-
-  }
-#else
+  /*Convert into the 32 bit frame buffer (in one pass if the area spans the full width)*/
+  int32_t y2 = area->y2 < disp_drv->ver_res ? area->y2 : disp_drv->ver_res - 1;
   uint32_t w = lv_area_get_width(area);
-  for(y = area->y1; y <= area->y2 && y < disp_drv->ver_res; y++) {
-    memcpy(&monitor.tft_fb[y * MONITOR_HOR_RES + area->x1], color_p, w * sizeof(lv_color_t));
-    color_p += w;
-  }
-#endif
+  color_convert_rows(&monitor.tft_fb[area->y1 * disp_drv->hor_res + area->x1], disp_drv->hor_res,
+                     color_p, w, w, y2 - area->y1 + 1);
 
   monitor.sdl_refr_qry = true;
 
@@ -211,22 +213,6 @@ void mpv_play_video(const char *url) {
  *   STATIC FUNCTIONS
  **********************/
 
-/**
- * A task to measure the elapsed time for LVGL
- * @param data unused
- * @return never return
- */
-static int tick_thread(void *data) {
-  (void)data;
-
-  while (1) {
-    SDL_Delay(5);   /*Sleep for 5 millisecond*/
-    lv_tick_inc(5); /*Tell LittelvGL that 5 milliseconds were elapsed*/
-  }
-
-  return 0;
-}
-
 /**
  * Print the memory usage periodically
  * @param param
@@ -373,17 +359,38 @@ static void monitor_sdl_init(void)
 
   SDL_SetEventFilter(quit_filter, NULL);
 
+  choose_resolution(&monitor);
   window_create(&monitor);
 
   sdl_inited = true;
 }
 
+/**
+ * Choose the display resolution: the desktop size in full screen mode (scaled down to fit
+ * LV_HOR_RES_MAX x LV_VER_RES_MAX), otherwise the default window size
+ */
+static void choose_resolution(monitor_t * m)
+{
+  m->hor_res = MONITOR_DEFAULT_HOR_RES;
+  m->ver_res = MONITOR_DEFAULT_VER_RES;
+#if LV_FULLSCREEN
+  SDL_DisplayMode mode;
+  if(SDL_GetDesktopDisplayMode(0, &mode) == 0 && mode.w > 0 && mode.h > 0) {
+    float scale = 1.0f;
+    if(mode.w > LV_HOR_RES_MAX) scale = (float)LV_HOR_RES_MAX / mode.w;
+    if(mode.h * scale > LV_VER_RES_MAX) scale = (float)LV_VER_RES_MAX / mode.h;
+    m->hor_res = (lv_coord_t)(mode.w * scale + 0.5f);
+    m->ver_res = (lv_coord_t)(mode.h * scale + 0.5f);
+  }
+#endif
+  printf("OSD resolution: %dx%d\n", m->hor_res, m->ver_res);
+}
 
 static void window_create(monitor_t * m)
 {
   m->window = SDL_CreateWindow("FPView",
                                SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
-                               MONITOR_HOR_RES * MONITOR_ZOOM, MONITOR_VER_RES * MONITOR_ZOOM,
+                               m->hor_res * MONITOR_ZOOM, m->ver_res * MONITOR_ZOOM,
                                SDL_WINDOW_OPENGL
 #if LV_FULLSCREEN
                                | SDL_WINDOW_FULLSCREEN_DESKTOP
@@ -392,9 +399,10 @@ static void window_create(monitor_t * m)
 
   /*Initialize the frame buffer to gray (77 is an empirical value) */
 #if MONITOR_DOUBLE_BUFFERED
-  SDL_UpdateTexture(m->texture, NULL, m->tft_fb_act, MONITOR_HOR_RES * sizeof(uint32_t));
+  SDL_UpdateTexture(m->texture, NULL, m->tft_fb_act, m->hor_res * sizeof(uint32_t));
 #else
-  memset(m->tft_fb, 0x44, MONITOR_HOR_RES * MONITOR_VER_RES * sizeof(uint32_t));
+  m->tft_fb = malloc(m->hor_res * m->ver_res * sizeof(uint32_t));
+  memset(m->tft_fb, 0x44, m->hor_res * m->ver_res * sizeof(uint32_t));
 #endif
   glcontext = SDL_GL_CreateContext(m->window);
   if (!glcontext) {
@@ -460,7 +468,7 @@ static void window_create(monitor_t * m)
                                    SDL_RENDERER_ACCELERATED | SDL_RENDERER_TARGETTEXTURE);
   m->texture = SDL_CreateTexture(m->renderer,
                                  SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET,
-                                 MONITOR_HOR_RES, MONITOR_VER_RES);
+                                 m->hor_res, m->ver_res);
   SDL_SetTextureBlendMode(m->texture, SDL_BLENDMODE_BLEND);
   SDL_SetRenderTarget(m->renderer, NULL);
   SDL_SetRenderDrawBlendMode(m->renderer, SDL_BLENDMODE_BLEND);
@@ -471,10 +479,10 @@ static void window_create(monitor_t * m)
 
 static void window_update() {
 #if MONITOR_DOUBLE_BUFFERED == 0
-  SDL_UpdateTexture(monitor.texture, NULL, monitor.tft_fb, MONITOR_HOR_RES * sizeof(uint32_t));
+  SDL_UpdateTexture(monitor.texture, NULL, monitor.tft_fb, monitor.hor_res * sizeof(uint32_t));
 #else
   if(m->tft_fb_act == NULL) return;
-  SDL_UpdateTexture(monitor.texture, NULL, monitor.tft_fb_act, MONITOR_HOR_RES * sizeof(uint32_t));
+  SDL_UpdateTexture(monitor.texture, NULL, monitor.tft_fb_act, monitor.hor_res * sizeof(uint32_t));
 #endif
 #ifndef USE_MPV
   redraw();
@@ -482,12 +490,14 @@ static void window_update() {
 }
 
 static void redraw() {
+  uint64_t start_us = osd_time_us();
 #ifdef USE_MPV
-  int w = LV_HOR_RES_MAX;
-  int h = LV_VER_RES_MAX;
+  /*The video fills the window*/
+  int w;
+  int h;
+  SDL_GetWindowSize(monitor.window, &w, &h);
   mpv_opengl_fbo fbo = {0, w, h};
   static int flip_y = 1;
-  SDL_GetWindowSize(monitor.window, &w, &h);
   mpv_render_param params[] =
     {
      // Specify the default framebuffer (0) as target. This will
@@ -506,6 +516,7 @@ static void redraw() {
 #endif
   SDL_RenderCopy(monitor.renderer, monitor.texture, NULL, NULL);
   SDL_GL_SwapWindow(monitor.window);
+  frame_stats_present(start_us, osd_time_us());
 }
 
 #ifdef USE_MPV
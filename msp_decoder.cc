@@ -0,0 +1,188 @@
+
+#include <math.h>
+
+#include <algorithm>
+
+#include <msp_decoder.hh>
+
+// The MSP commands that carry telemetry.
+#define MSP_STATUS         101
+#define MSP_RAW_GPS        106
+#define MSP_COMP_GPS       107
+#define MSP_ATTITUDE       108
+#define MSP_ALTITUDE       109
+#define MSP_ANALOG         110
+#define MSP_BATTERY_STATE  130
+
+bool MSPDecoder::parse(uint8_t c) {
+  switch (m_state) {
+  case SYNC:
+    if (c == '$') {
+      m_state = VERSION;
+    }
+    break;
+  case VERSION:
+    if ((c == 'M') || (c == 'X')) {
+      m_v2 = (c == 'X');
+      m_state = DIRECTION;
+    } else {
+      m_state = SYNC;
+    }
+    break;
+  case DIRECTION:
+    // Only responses ('>') carry telemetry, but requests still need to be parsed to stay in sync.
+    if ((c == '>') || (c == '<') || (c == '!')) {
+      m_response = (c == '>');
+      m_crc = 0;
+      m_idx = 0;
+      m_state = m_v2 ? V2_FLAGS : V1_LENGTH;
+    } else {
+      m_state = SYNC;
+    }
+    break;
+  case V1_LENGTH:
+    m_len = c;
+    m_crc ^= c;
+    m_state = V1_COMMAND;
+    break;
+  case V1_COMMAND:
+    m_command = c;
+    m_crc ^= c;
+    m_state = (m_len == 0) ? V1_CHECKSUM : V1_PAYLOAD;
+    break;
+  case V1_PAYLOAD:
+    m_buf[m_idx++] = c;
+    m_crc ^= c;
+    if (m_idx == m_len) {
+      m_state = V1_CHECKSUM;
+    }
+    break;
+  case V2_FLAGS:
+    m_crc = crc8_dvb_s2(m_crc, c);
+    m_state = V2_COMMAND1;
+    break;
+  case V2_COMMAND1:
+    m_command = c;
+    m_crc = crc8_dvb_s2(m_crc, c);
+    m_state = V2_COMMAND2;
+    break;
+  case V2_COMMAND2:
+    m_command |= c << 8;
+    m_crc = crc8_dvb_s2(m_crc, c);
+    m_state = V2_LENGTH1;
+    break;
+  case V2_LENGTH1:
+    m_len = c;
+    m_crc = crc8_dvb_s2(m_crc, c);
+    m_state = V2_LENGTH2;
+    break;
+  case V2_LENGTH2:
+    m_len |= c << 8;
+    m_crc = crc8_dvb_s2(m_crc, c);
+    if (m_len > sizeof(m_buf)) {
+      // None of the telemetry messages are this large.
+      m_state = SYNC;
+    } else {
+      m_state = (m_len == 0) ? V2_CHECKSUM : V2_PAYLOAD;
+    }
+    break;
+  case V2_PAYLOAD:
+    m_buf[m_idx++] = c;
+    m_crc = crc8_dvb_s2(m_crc, c);
+    if (m_idx == m_len) {
+      m_state = V2_CHECKSUM;
+    }
+    break;
+  case V1_CHECKSUM:
+  case V2_CHECKSUM:
+    m_state = SYNC;
+    if (c == m_crc) {
+      if (m_response) {
+        handle_frame();
+      }
+      return true;
+    }
+    break;
+  }
+  return false;
+}
+
+void MSPDecoder::reset() {
+  m_state = SYNC;
+  m_v2 = false;
+  m_response = false;
+  m_command = 0;
+  m_len = 0;
+  m_idx = 0;
+  m_crc = 0;
+}
+
+void MSPDecoder::handle_frame() {
+  const uint8_t *p = m_buf;
+  switch (m_command) {
+  case MSP_STATUS:
+    if (m_len >= 10) {
+      // Bit 0 of the flight mode flags is the ARM box.
+      set_value("armed", (read_le32(p + 6) & 0x1) ? 1.0 : 0.0);
+    }
+    break;
+  case MSP_RAW_GPS:
+    if (m_len >= 16) {
+      set_value("gps_fix_type", p[0]);
+      set_value("gps_num_sats", p[1]);
+      set_value("latitude", static_cast<int32_t>(read_le32(p + 2)) * 1e-7);
+      set_value("longitude", static_cast<int32_t>(read_le32(p + 6)) * 1e-7);
+      set_value("altitude", read_le16(p + 10));
+      set_value("speed", read_le16(p + 12) / 100.0);
+      set_value("gps_ground_course", read_le16(p + 14) / 10.0);
+    }
+    if (m_len >= 18) {
+      set_value("gps_HDOP", read_le16(p + 16) / 100.0);
+    }
+    break;
+  case MSP_COMP_GPS:
+    if (m_len >= 4) {
+      set_value("home_distance", read_le16(p));
+      set_value("home_direction", static_cast<int16_t>(read_le16(p + 2)));
+    }
+    break;
+  case MSP_ATTITUDE:
+    if (m_len >= 6) {
+      // Roll and pitch are in tenths of a degree, the yaw is in degrees.
+      set_value("roll", static_cast<int16_t>(read_le16(p)) * M_PI / 1800.0);
+      set_value("pitch", static_cast<int16_t>(read_le16(p + 2)) * M_PI / 1800.0);
+      set_value("heading", static_cast<int16_t>(read_le16(p + 4)));
+    }
+    break;
+  case MSP_ALTITUDE:
+    if (m_len >= 4) {
+      set_value("relative_altitude", static_cast<int32_t>(read_le32(p)) / 100.0);
+    }
+    break;
+  case MSP_ANALOG:
+    if (m_len >= 7) {
+      set_value("rc_rssi", 70.0 * static_cast<float>(read_le16(p + 3)) / 1023.0 - 90.0);
+      set_value("current_battery",
+                std::max(static_cast<int16_t>(read_le16(p + 5)), static_cast<int16_t>(0)) / 100.0);
+      // Betaflight appends the voltage with 0.01V resolution.
+      if (m_len >= 9) {
+        set_value("voltage_battery", read_le16(p + 7) / 100.0);
+      } else {
+        set_value("voltage_battery", p[0] / 10.0);
+      }
+    }
+    break;
+  case MSP_BATTERY_STATE:
+    if (m_len >= 9) {
+      uint16_t capacity = read_le16(p + 1);
+      uint16_t consumed = read_le16(p + 4);
+      if (capacity > 0) {
+        set_value("battery_remaining",
+                  std::max(100.0 * (capacity - consumed) / capacity, 0.0));
+      }
+    }
+    break;
+  default:
+    break;
+  }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <protocol_decoder.hh>
+
+// Decodes the MSP (v1 and v2) responses sent by iNav and Betaflight flight controllers.
+// MSP is request/response, so this only sees data when something on the link is polling
+// the flight controller (e.g. a ground station or an MSP telemetry bridge).
+class MSPDecoder : public ProtocolDecoder {
+public:
+
+  MSPDecoder(Telemetry &telem) : ProtocolDecoder(telem) { reset(); }
+
+  const char *name() const { return "MSP"; }
+  bool parse(uint8_t c);
+  void reset();
+
+private:
+
+  enum State {
+              SYNC, VERSION, DIRECTION,
+              V1_LENGTH, V1_COMMAND, V1_PAYLOAD, V1_CHECKSUM,
+              V2_FLAGS, V2_COMMAND1, V2_COMMAND2, V2_LENGTH1, V2_LENGTH2, V2_PAYLOAD, V2_CHECKSUM
+  };
+
+  void handle_frame();
+
+  State m_state;
+  bool m_v2;
+  bool m_response;
+  uint16_t m_command;
+  uint16_t m_len;
+  uint16_t m_idx;
+  uint8_t m_crc;
+  uint8_t m_buf[256];
+};
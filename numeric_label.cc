@@ -0,0 +1,214 @@
+
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+
+#include "numeric_label.hh"
+
+const GlyphAtlas &GlyphAtlas::get(const lv_font_t *font) {
+  static std::map<const lv_font_t*, std::unique_ptr<GlyphAtlas>> atlases;
+  std::unique_ptr<GlyphAtlas> &atlas = atlases[font];
+  if (!atlas) {
+    atlas.reset(new GlyphAtlas(font));
+  }
+  return *atlas;
+}
+
+GlyphAtlas::GlyphAtlas(const lv_font_t *font) : m_height(lv_font_get_line_height(font)) {
+  const char *chars = GLYPH_ATLAS_CHARS;
+  size_t count = sizeof(m_glyphs) / sizeof(m_glyphs[0]);
+
+  lv_coord_t digit_width = 0;
+  for (char c = '0'; c <= '9'; ++c) {
+    digit_width = std::max<lv_coord_t>(digit_width, lv_font_get_glyph_width(font, c, 0));
+  }
+  std::vector<lv_coord_t> offsets(count);
+  size_t size = 0;
+  for (size_t i = 0; i < count; ++i) {
+    bool tabular = (chars[i] == ' ') || (chars[i] == '+') || (chars[i] == '-') ||
+      ((chars[i] >= '0') && (chars[i] <= '9'));
+    m_glyphs[i].width = tabular ? digit_width : lv_font_get_glyph_width(font, chars[i], 0);
+    offsets[i] = size;
+    size += m_glyphs[i].width * m_height;
+  }
+  m_pixels.assign(size, LV_OPA_TRANSP);
+
+  // Render each glyph where LVGL's label would put it in the cell (centered in a wider cell)
+  for (size_t i = 0; i < count; ++i) {
+    lv_opa_t *cell = m_pixels.data() + offsets[i];
+    m_glyphs[i].mask = cell;
+    lv_font_glyph_dsc_t g;
+    if (!lv_font_get_glyph_dsc(font, &g, chars[i], 0) || !g.box_w || !g.box_h) {
+      continue;
+    }
+    const uint8_t *bitmap = lv_font_get_glyph_bitmap(font, chars[i]);
+    if (!bitmap) {
+      continue;
+    }
+    uint32_t bpp = (g.bpp == 3) ? 4 : g.bpp;
+    uint32_t max = (1 << bpp) - 1;
+    lv_coord_t x0 = (m_glyphs[i].width - g.adv_w) / 2 + g.ofs_x;
+    lv_coord_t y0 = font->line_height - font->base_line - g.box_h - g.ofs_y;
+    for (lv_coord_t y = 0; y < g.box_h; ++y) {
+      for (lv_coord_t x = 0; x < g.box_w; ++x) {
+        lv_coord_t cx = x0 + x;
+        lv_coord_t cy = y0 + y;
+        if ((cx < 0) || (cx >= m_glyphs[i].width) || (cy < 0) || (cy >= m_height)) {
+          continue;
+        }
+        // The pixels are packed without any padding at the end of the rows
+        uint32_t bit = (y * g.box_w + x) * bpp;
+        uint32_t value = (bitmap[bit >> 3] >> (8 - bpp - (bit & 7))) & max;
+        cell[cy * m_glyphs[i].width + cx] = value * 255 / max;
+      }
+    }
+  }
+}
+
+const GlyphAtlas::Glyph *GlyphAtlas::glyph(char c) const {
+  const char *p = (c != '\0') ? strchr(GLYPH_ATLAS_CHARS, c) : NULL;
+  return p ? &m_glyphs[p - GLYPH_ATLAS_CHARS] : NULL;
+}
+
+// The NumericLabel of each label object. The ext attribute of a label is LVGL's
+// lv_label_ext_t, and the user data is disabled in lv_conf.h, so they are looked up here.
+static std::map<const lv_obj_t*, NumericLabel*> &numeric_labels() {
+  static std::map<const lv_obj_t*, NumericLabel*> labels;
+  return labels;
+}
+
+NumericLabel::NumericLabel(lv_obj_t *label) :
+  m_label(label),
+  m_atlas(GlyphAtlas::get(lv_obj_get_style_text_font(label, LV_LABEL_PART_MAIN))),
+  m_label_design_cb(lv_obj_get_design_cb(label)) {
+  // Start with the text that the layout gave the label
+  strncpy(m_text, lv_label_get_text(label), LABEL_TEXT_LEN - 1);
+  m_text[LABEL_TEXT_LEN - 1] = '\0';
+
+  // Replace the drawing of the label.
+  numeric_labels()[label] = this;
+  lv_obj_set_design_cb(label, design_cb);
+  lv_obj_invalidate(label);
+}
+
+NumericLabel::~NumericLabel() {
+  numeric_labels().erase(m_label);
+  lv_obj_set_design_cb(m_label, m_label_design_cb);
+}
+
+bool NumericLabel::set(const LabelText &text) {
+  if (strcmp(text.c_str(), m_text) == 0) {
+    return false;
+  }
+  lv_area_t old_cells[LABEL_TEXT_LEN];
+  lv_area_t new_cells[LABEL_TEXT_LEN];
+  size_t old_len = cells(m_text, old_cells);
+  size_t new_len = cells(text.c_str(), new_cells);
+
+  // A character that changed or moved needs both its old and new cell redrawn.
+  for (size_t i = 0; i < std::max(old_len, new_len); ++i) {
+    bool in_old = (i < old_len);
+    bool in_new = (i < new_len);
+    if (in_old && in_new && (m_text[i] == text.c_str()[i]) &&
+        (old_cells[i].x1 == new_cells[i].x1) && (old_cells[i].x2 == new_cells[i].x2)) {
+      continue;
+    }
+    if (in_old) {
+      lv_obj_invalidate_area(m_label, &old_cells[i]);
+    }
+    if (in_new) {
+      lv_obj_invalidate_area(m_label, &new_cells[i]);
+    }
+  }
+  strcpy(m_text, text.c_str());
+  return true;
+}
+
+size_t NumericLabel::cells(const char *text, lv_area_t *areas) const {
+  lv_area_t coords;
+  lv_obj_get_coords(m_label, &coords);
+  coords.x1 += lv_obj_get_style_pad_left(m_label, LV_LABEL_PART_MAIN);
+  coords.x2 -= lv_obj_get_style_pad_right(m_label, LV_LABEL_PART_MAIN);
+  coords.y1 += lv_obj_get_style_pad_top(m_label, LV_LABEL_PART_MAIN);
+
+  size_t len = strlen(text);
+  lv_coord_t width = 0;
+  for (size_t i = 0; i < len; ++i) {
+    const GlyphAtlas::Glyph *g = m_atlas.glyph(text[i]);
+    width += g ? g->width : m_atlas.glyph('0')->width;
+  }
+  lv_coord_t x = coords.x1;
+  switch (lv_label_get_align(m_label)) {
+  case LV_LABEL_ALIGN_CENTER:
+    x += (lv_area_get_width(&coords) - width) / 2;
+    break;
+  case LV_LABEL_ALIGN_RIGHT:
+    x = coords.x2 + 1 - width;
+    break;
+  default:
+    break;
+  }
+  for (size_t i = 0; i < len; ++i) {
+    const GlyphAtlas::Glyph *g = m_atlas.glyph(text[i]);
+    lv_coord_t w = g ? g->width : m_atlas.glyph('0')->width;
+    areas[i] = { x, coords.y1, lv_coord_t(x + w - 1),
+                 lv_coord_t(coords.y1 + m_atlas.height() - 1) };
+    x += w;
+  }
+  return len;
+}
+
+lv_design_res_t NumericLabel::design_cb(lv_obj_t *obj, const lv_area_t *clip_area,
+                                        lv_design_mode_t mode) {
+  if (mode == LV_DESIGN_COVER_CHK) {
+    return LV_DESIGN_RES_NOT_COVER;
+  }
+  if (mode == LV_DESIGN_DRAW_MAIN) {
+    auto li = numeric_labels().find(obj);
+    if (li != numeric_labels().end()) {
+      li->second->draw(clip_area);
+    }
+  }
+  return LV_DESIGN_RES_OK;
+}
+
+void NumericLabel::draw(const lv_area_t *clip_area) {
+  lv_area_t coords;
+  lv_area_t clip;
+  lv_obj_get_coords(m_label, &coords);
+  if (!_lv_area_intersect(&clip, clip_area, &coords)) {
+    return;
+  }
+  lv_draw_label_dsc_t label_dsc;
+  lv_draw_label_dsc_init(&label_dsc);
+  lv_obj_init_draw_label_dsc(m_label, LV_LABEL_PART_MAIN, &label_dsc);
+  if (label_dsc.opa <= LV_OPA_MIN) {
+    return;
+  }
+
+  lv_area_t areas[LABEL_TEXT_LEN];
+  size_t len = cells(m_text, areas);
+  bool masked = (lv_draw_mask_get_cnt() > 0);
+  for (size_t i = 0; i < len; ++i) {
+    const GlyphAtlas::Glyph *g = m_atlas.glyph(m_text[i]);
+    lv_area_t area;
+    if (!g || !_lv_area_intersect(&area, &clip, &areas[i])) {
+      continue;
+    }
+
+    // LVGL blends the mask with the stride of the (clipped) area
+    lv_coord_t w = lv_area_get_width(&area);
+    m_mask.resize(w * lv_area_get_height(&area));
+    lv_opa_t *row = m_mask.data();
+    for (lv_coord_t y = area.y1; y <= area.y2; ++y, row += w) {
+      memcpy(row, g->mask + (y - areas[i].y1) * g->width + (area.x1 - areas[i].x1), w);
+      if (masked && (lv_draw_mask_apply(row, area.x1, y, w) == LV_DRAW_MASK_RES_TRANSP)) {
+        memset(row, LV_OPA_TRANSP, w);
+      }
+    }
+    _lv_blend_fill(&clip, &area, label_dsc.color, m_mask.data(), LV_DRAW_MASK_RES_CHANGED,
+                   label_dsc.opa, label_dsc.blend_mode);
+  }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "lvgl/lvgl.h"
+#include "formatted_label.hh"
+
+// The characters of numeric labels: digits, sign, decimal point and the units.
+#define GLYPH_ATLAS_CHARS " +-.0123456789AENSVW"
+
+// The glyphs of GLYPH_ATLAS_CHARS in one font, rendered once into 8 bit alpha masks.
+// The digits, space and sign all get the width of the widest digit (like tabular figures),
+// so a changing number doesn't move the characters around it.
+class GlyphAtlas {
+public:
+
+  struct Glyph {
+    lv_coord_t width;
+    // width x height() opacities, with the glyph at its position in the line
+    const lv_opa_t *mask;
+  };
+
+  // The atlas of a font, which is built on first use and shared by all of its labels.
+  static const GlyphAtlas &get(const lv_font_t *font);
+
+  // NULL for a character that isn't in the atlas.
+  const Glyph *glyph(char c) const;
+
+  lv_coord_t height() const { return m_height; }
+
+private:
+
+  GlyphAtlas(const lv_font_t *font);
+
+  lv_coord_t m_height;
+  Glyph m_glyphs[sizeof(GLYPH_ATLAS_CHARS) - 1];
+  std::vector<lv_opa_t> m_pixels;
+};
+
+// A drop in replacement for a FormattedLabel that only shows numbers. It takes over the
+// drawing of the label: the characters are blitted from the glyph atlas of the label's font
+// into fixed cells, and a new text only invalidates the cells that changed. Characters that
+// aren't in the atlas are left blank.
+class NumericLabel {
+public:
+
+  NumericLabel(lv_obj_t *label);
+  ~NumericLabel();
+
+  // Returns true if the text changed.
+  bool set(const LabelText &text);
+
+  lv_obj_t *obj() const { return m_label; }
+
+private:
+
+  static lv_design_res_t design_cb(lv_obj_t *obj, const lv_area_t *clip_area,
+                                   lv_design_mode_t mode);
+  void draw(const lv_area_t *clip_area);
+
+  // The screen area of each character of a text, returns the number of characters.
+  size_t cells(const char *text, lv_area_t *areas) const;
+
+  lv_obj_t *m_label;
+  const GlyphAtlas &m_atlas;
+  // The label's own drawing, which is restored when this is destroyed
+  lv_design_cb_t m_label_design_cb;
+  char m_text[LABEL_TEXT_LEN];
+  // A glyph's mask, clipped and with any LVGL masks applied
+  std::vector<lv_opa_t> m_mask;
+};
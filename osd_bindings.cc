@@ -0,0 +1,151 @@
+
+#include <math.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "osd_bindings.hh"
+
+// The default time that can be spent updating widgets in each frame (seconds).
+#define DEFAULT_FRAME_BUDGET 0.004
+// Each degrade level halves the rate of the low priority bindings, and once those
+// are at the minimum, the normal priority bindings.
+#define MAX_DEGRADE_STEPS 3
+// The time without an overrun before the rates are increased again (seconds).
+#define DEGRADE_RECOVERY_TIME 1.0
+
+static double monotonic_time() {
+  return std::chrono::duration<double>
+    (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+BindingTable::BindingTable(Telemetry &telem) :
+  m_telem(telem), m_frame_budget(DEFAULT_FRAME_BUDGET),
+  m_frame_period(LV_DISP_DEF_REFR_PERIOD * 1e-3), m_degrade_level(0),
+  m_last_overrun(0), m_last_degrade(0) {}
+
+void BindingTable::add(lv_obj_t *obj, const std::string &key, Formatter formatter,
+                       float rate, Priority priority, float threshold, float default_value) {
+  Binding b;
+  b.obj = obj;
+  b.key = m_telem.key_id(key);
+  b.formatter = formatter;
+  b.interval = (rate > 0) ? (1.0 / rate) : 0;
+  b.priority = priority;
+  b.threshold = threshold;
+  b.default_value = default_value;
+  b.value = default_value;
+  b.last_update = 0;
+  b.applied = false;
+  b.pending = true;
+
+  // Spread the phases of the bindings evenly (golden ratio sequence), so that bindings with
+  // the same rate are updated in different frames.
+  int idx = static_cast<int>(m_bindings.size());
+  b.phase = fmod(idx * 0.618034, 1.0);
+
+  m_bindings.push_back(b);
+  if (static_cast<int>(m_key_bindings.size()) <= b.key) {
+    m_key_bindings.resize(b.key + 1);
+  }
+  m_key_bindings[b.key].push_back(idx);
+
+  // Every widget is drawn once with the current (or default) value.
+  m_pending.push_back(idx);
+}
+
+double BindingTable::interval(const Binding &b) const {
+  int steps = 0;
+  if (b.priority == LOW) {
+    steps = std::min(m_degrade_level, MAX_DEGRADE_STEPS);
+  } else if (b.priority == NORMAL) {
+    steps = std::max(m_degrade_level - MAX_DEGRADE_STEPS, 0);
+  }
+  return b.interval * (1 << steps);
+}
+
+double BindingTable::due_time(const Binding &b, double time) const {
+  double iv = interval(b);
+  if (!b.applied || (iv <= 0)) {
+    return 0;
+  }
+
+  // A binding that hasn't been updated for a full interval is updated right away. Otherwise
+  // the update is deferred to the next slot of the binding's phase.
+  double earliest = b.last_update + iv;
+  if (time >= earliest) {
+    return time;
+  }
+  double offset = b.phase * iv;
+  return offset + ceil((earliest - offset) / iv) * iv;
+}
+
+double BindingTable::update(double time) {
+
+  // Queue the bindings of the values that have changed.
+  m_telem.changed_keys(m_changed);
+  for (int key : m_changed) {
+    if (key >= static_cast<int>(m_key_bindings.size())) {
+      continue;
+    }
+    for (int idx : m_key_bindings[key]) {
+      if (!m_bindings[idx].pending) {
+        m_bindings[idx].pending = true;
+        m_pending.push_back(idx);
+      }
+    }
+  }
+
+  // Update the highest priority bindings first.
+  std::stable_sort(m_pending.begin(), m_pending.end(), [this](int a, int b) {
+      return m_bindings[a].priority > m_bindings[b].priority;
+    });
+
+  // Update the queued bindings that are due, leaving the rest on the queue.
+  double start = monotonic_time();
+  bool overrun = false;
+  size_t nkeep = 0;
+  double next = -1;
+  for (size_t i = 0; i < m_pending.size(); ++i) {
+    Binding &b = m_bindings[m_pending[i]];
+    double wait = due_time(b, time) - time;
+    if ((wait <= 0) && (b.priority != HIGH) && ((monotonic_time() - start) > m_frame_budget)) {
+      // Out of time for this frame, so try again in the next frame.
+      wait = m_frame_period;
+      overrun = true;
+    }
+    if (wait > 0) {
+      m_pending[nkeep++] = m_pending[i];
+      next = (next < 0) ? wait : std::min(next, wait);
+      continue;
+    }
+
+    b.pending = false;
+    float value = b.default_value;
+    m_telem.get_value(b.key, value);
+    if (b.applied && (fabs(value - b.value) <= b.threshold)) {
+      continue;
+    }
+    b.formatter(b.obj, value);
+    b.value = value;
+    b.last_update = time;
+    b.applied = true;
+  }
+  m_pending.resize(nkeep);
+
+  // Reduce the rates of the lower priority bindings while the budget is being exceeded,
+  // and restore them once it isn't.
+  // The level goes up at most once per frame, however often the loop runs in that frame.
+  if (overrun) {
+    if ((time - m_last_degrade) >= m_frame_period) {
+      m_degrade_level = std::min(m_degrade_level + 1, 2 * MAX_DEGRADE_STEPS);
+      m_last_degrade = time;
+    }
+    m_last_overrun = time;
+  } else if ((m_degrade_level > 0) && ((time - m_last_overrun) > DEGRADE_RECOVERY_TIME)) {
+    --m_degrade_level;
+    m_last_overrun = time;
+  }
+
+  return next;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "lvgl/lvgl.h"
+#include "telemetry.hh"
+
+// Connects the OSD widgets to the telemetry values.
+// Each binding is only updated when its telemetry value changes, so the cost of an update
+// depends on the number of values that changed rather than the number of widgets.
+//
+// Each binding also has a maximum update rate and a priority. Updates of bindings with the
+// same rate are spread across frames by giving each binding a different phase, and if the
+// updates in a frame exceed the frame budget, the rest are deferred to the next frame,
+// starting with the lowest priority. While the budget keeps being exceeded, the low (and
+// then the normal) priority bindings are updated at a reduced rate.
+class BindingTable {
+public:
+
+  enum Priority { LOW, NORMAL, HIGH };
+
+  // Pushes a new value into a widget.
+  typedef std::function<void(lv_obj_t *obj, float value)> Formatter;
+
+  BindingTable(Telemetry &telem);
+
+  // Bind a widget to a telemetry value.
+  // The widget is updated at most rate times per second, and only when the value changes
+  // by more than the threshold. The default value is used until the value is received.
+  void add(lv_obj_t *obj, const std::string &key, Formatter formatter,
+           float rate = 10, Priority priority = NORMAL, float threshold = 0,
+           float default_value = 0);
+
+  // The time (seconds) that can be spent updating widgets in each frame.
+  // High priority bindings are always updated.
+  void set_frame_budget(double seconds) { m_frame_budget = seconds; }
+  double frame_budget() const { return m_frame_budget; }
+
+  // The OSD refresh period (seconds), which is how long updates are deferred when the
+  // budget is exceeded.
+  void set_frame_period(double seconds) { m_frame_period = seconds; }
+
+  // How far the rates of the lower priority bindings have been reduced (0 = full rate).
+  int degrade_level() const { return m_degrade_level; }
+
+  // Update the widgets that are bound to the values that have changed.
+  // Returns the time (seconds) until a deferred update is due, or a negative value if
+  // there are no deferred updates.
+  double update(double time);
+
+private:
+
+  struct Binding {
+    lv_obj_t *obj;
+    int key;
+    Formatter formatter;
+    double interval;
+    double phase;
+    Priority priority;
+    float threshold;
+    float default_value;
+    float value;
+    double last_update;
+    bool applied;
+    bool pending;
+  };
+
+  // The update interval after the rate reduction for the current degrade level.
+  double interval(const Binding &b) const;
+  // The time that the next update of a pending binding is due.
+  double due_time(const Binding &b, double time) const;
+
+  Telemetry &m_telem;
+  std::vector<Binding> m_bindings;
+  // The bindings for each telemetry key ID.
+  std::vector<std::vector<int> > m_key_bindings;
+  std::vector<int> m_changed;
+  std::vector<int> m_pending;
+  double m_frame_budget;
+  double m_frame_period;
+  int m_degrade_level;
+  double m_last_overrun;
+  double m_last_degrade;
+};
@@ -0,0 +1,545 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "osd_layout.hh"
+#include "ft_font.hh"
+#include "logger.hh"
+
+// The built in layout for a 1280x720 screen.
+static const char *g_default_layout = R"(
+[attitude]
+type = attitude
+x = 440
+y = 160
+width = 400
+height = 400
+
+[video_gauge]
+type = gauge
+x = 365
+y = 10
+width = 150
+height = 150
+style = video
+range = 0 20
+critical = 15
+
+[rx_bitrate_label]
+type = label
+x = 345
+y = 160
+width = 100
+height = 42
+style = label
+align = right
+
+[rx_mbps_label]
+type = label
+x = 445
+y = 176
+width = 80
+height = 24
+style = units
+text = Mbps {down}
+
+[rssi_gauge]
+type = gauge
+x = 765
+y = 10
+width = 150
+height = 150
+style = rssi
+range = -100 0
+critical = -80
+needles = yellow red
+
+[rssi_down_label]
+type = label
+x = 725
+y = 160
+width = 120
+height = 42
+style = label
+align = right
+
+[rx_dbm_label]
+type = label
+x = 845
+y = 176
+width = 80
+height = 24
+style = units
+text = dBm{down}
+
+[compass_img]
+type = image
+x = 490
+y = -90
+src = compass
+zoom = 128
+
+[orientation_label]
+type = label
+x = 580
+y = 80
+width = 120
+height = 42
+style = label
+align = center
+
+[home_img]
+type = image
+x = 618
+y = 35
+src = home_arrow
+zoom = 128
+
+[satellite_img]
+type = image
+x = 1000
+y = 568
+src = satellite
+zoom = 100
+
+[sats_label]
+type = label
+x = 1030
+y = 570
+width = 50
+height = 42
+style = label
+align = right
+
+[nsats_label]
+type = label
+x = 1080
+y = 586
+width = 50
+height = 24
+style = units
+text = SATS
+
+[hdop_label]
+type = label
+x = 1130
+y = 570
+width = 80
+height = 42
+style = label
+align = right
+
+[hdopl_label]
+type = label
+x = 1210
+y = 586
+width = 60
+height = 24
+style = units
+text = HDOP
+
+[lat_label]
+type = label
+x = 1000
+y = 612
+width = 230
+height = 42
+style = label
+align = right
+
+[lon_label]
+type = label
+x = 1000
+y = 654
+width = 230
+height = 42
+style = label
+align = right
+
+[volt_label]
+type = label
+x = 30
+y = 612
+width = 120
+height = 42
+style = label
+align = right
+
+[cur_label]
+type = label
+x = 30
+y = 654
+width = 120
+height = 42
+style = label
+align = right
+
+[bat_img]
+type = image
+x = 155
+y = 625
+src = bat_0
+
+[mode_label]
+type = label
+x = 460
+y = 636
+width = 300
+height = 54
+style = mode
+align = center
+)";
+
+// The symbols that can be used in the label text, e.g. {down}
+static const struct {
+  const char *name;
+  const char *symbol;
+} g_symbols[] = {
+  { "{down}", LV_SYMBOL_DOWN },
+  { "{up}", LV_SYMBOL_UP },
+};
+
+static const struct {
+  const char *name;
+  lv_color_t color;
+} g_colors[] = {
+  { "white", LV_COLOR_WHITE },
+  { "black", LV_COLOR_BLACK },
+  { "red", LV_COLOR_RED },
+  { "green", LV_COLOR_GREEN },
+  { "blue", LV_COLOR_BLUE },
+  { "yellow", LV_COLOR_YELLOW },
+  { "orange", LV_COLOR_ORANGE },
+};
+
+static std::string trim(const std::string &s) {
+  size_t start = s.find_first_not_of(" \t\r");
+  if (start == std::string::npos) {
+    return "";
+  }
+  size_t end = s.find_last_not_of(" \t\r");
+  return s.substr(start, end - start + 1);
+}
+
+static bool parse_int(const std::string &s, int32_t &val) {
+  char *end;
+  long v = strtol(s.c_str(), &end, 10);
+  if ((end == s.c_str()) || (*end != '\0')) {
+    return false;
+  }
+  val = v;
+  return true;
+}
+
+static lv_coord_t scaled(lv_coord_t v, float scale) {
+  return static_cast<lv_coord_t>(lroundf(v * scale));
+}
+
+OSDLayout::OSDLayout() : m_scale(1), m_scale_x(1), m_scale_y(1) {
+  parse(g_default_layout, "default layout", true);
+}
+
+void OSDLayout::add_style(const std::string &name, lv_style_t *style) {
+  m_styles[name] = style;
+}
+
+void OSDLayout::add_image(const std::string &name, const lv_img_dsc_t *img) {
+  m_images[name] = img;
+}
+
+bool OSDLayout::load(const std::string &filename) {
+  std::ifstream is(filename.c_str());
+  if (!is) {
+    LOG_ERROR("Error opening the layout file: %s", filename.c_str());
+    return false;
+  }
+  std::stringstream ss;
+  ss << is.rdbuf();
+  return parse(ss.str(), filename, false);
+}
+
+void OSDLayout::set_screen_size(lv_coord_t width, lv_coord_t height) {
+  m_scale_x = float(width) / WIDTH;
+  m_scale_y = float(height) / HEIGHT;
+  m_scale = std::min(m_scale_x, m_scale_y);
+}
+
+void OSDLayout::create(lv_obj_t *parent) {
+  for (Widget &w : m_widgets) {
+    lv_style_t *s = style(w);
+    lv_coord_t x = scaled(w.x, m_scale_x);
+    lv_coord_t y = scaled(w.y, m_scale_y);
+    switch (w.type) {
+    case LABEL:
+      w.obj = lv_label_create(parent, NULL);
+      if (s) {
+        lv_obj_add_style(w.obj, LV_LABEL_PART_MAIN, s);
+      }
+      lv_label_set_long_mode(w.obj, LV_LABEL_LONG_CROP);
+      lv_label_set_align(w.obj, w.align);
+      lv_obj_set_size(w.obj, scaled(w.width, m_scale), scaled(w.height, m_scale));
+      lv_label_set_text(w.obj, w.text.c_str());
+      break;
+    case IMAGE: {
+      w.obj = lv_img_create(parent, NULL);
+      if (s) {
+        lv_obj_add_style(w.obj, LV_IMG_PART_MAIN, s);
+      }
+      auto ii = m_images.find(w.src);
+      if (ii != m_images.end()) {
+        lv_img_set_src(w.obj, ii->second);
+      } else {
+        LOG_ERROR("Unknown image for %s: %s", w.name.c_str(), w.src.c_str());
+      }
+      lv_img_set_zoom(w.obj, scaled(w.zoom, m_scale));
+      // The image is zoomed around its center, so that's what is moved to the scaled position.
+      lv_coord_t iw = lv_obj_get_width(w.obj);
+      lv_coord_t ih = lv_obj_get_height(w.obj);
+      x = scaled(w.x + iw / 2, m_scale_x) - iw / 2;
+      y = scaled(w.y + ih / 2, m_scale_y) - ih / 2;
+      break;
+    }
+    case GAUGE:
+      w.obj = lv_gauge_create(parent, NULL);
+      if (s) {
+        lv_obj_add_style(w.obj, LV_GAUGE_PART_MAJOR, s);
+        lv_obj_add_style(w.obj, LV_GAUGE_PART_MAIN, s);
+      }
+      if (!w.needles.empty()) {
+        lv_gauge_set_needle_count(w.obj, w.needles.size(), w.needles.data());
+      }
+      lv_obj_set_size(w.obj, scaled(w.width, m_scale), scaled(w.height, m_scale));
+      lv_gauge_set_range(w.obj, w.range_min, w.range_max);
+      lv_gauge_set_critical_value(w.obj, w.critical);
+      break;
+    case ATTITUDE:
+      // Drawn by an AttitudeIndicator, which only uses the line and text style.
+      w.obj = lv_obj_create(parent, NULL);
+      if (s) {
+        lv_obj_add_style(w.obj, LV_OBJ_PART_MAIN, s);
+      }
+      lv_obj_set_size(w.obj, scaled(w.width, m_scale), scaled(w.height, m_scale));
+      break;
+    }
+    if (!w.font.empty()) {
+      set_font(w);
+    }
+    lv_obj_set_pos(w.obj, x, y);
+    lv_obj_set_hidden(w.obj, w.hidden);
+  }
+}
+
+lv_obj_t *OSDLayout::get(const std::string &name) const {
+  auto wi = m_index.find(name);
+  return (wi == m_index.end()) ? NULL : m_widgets[wi->second].obj;
+}
+
+bool OSDLayout::parse(const std::string &text, const std::string &source, bool defaults) {
+  std::istringstream is(text);
+  std::string line;
+  Widget *w = NULL;
+  bool skip = false;
+  bool ok = true;
+  for (int lineno = 1; std::getline(is, line); ++lineno) {
+    line = trim(line);
+    if (line.empty() || (line[0] == ';') || (line[0] == '#')) {
+      continue;
+    }
+
+    // Start a new widget section
+    if (line[0] == '[') {
+      std::string name = trim(line.substr(1, line.find(']') - 1));
+      auto wi = m_index.find(name);
+      if (wi != m_index.end()) {
+        w = &m_widgets[wi->second];
+        skip = false;
+      } else if (defaults) {
+        Widget nw;
+        nw.name = name;
+        nw.type = LABEL;
+        nw.x = nw.y = 0;
+        nw.width = nw.height = 0;
+        nw.style = "default";
+        nw.font_size = 0;
+        nw.align = LV_LABEL_ALIGN_LEFT;
+        nw.zoom = LV_IMG_ZOOM_NONE;
+        nw.range_min = 0;
+        nw.range_max = 100;
+        nw.critical = 80;
+        nw.hidden = false;
+        nw.obj = NULL;
+        m_index[name] = m_widgets.size();
+        m_widgets.push_back(nw);
+        w = &m_widgets.back();
+        skip = false;
+      } else {
+        LOG_ERROR("%s:%d: unknown widget: %s", source.c_str(), lineno, name.c_str());
+        skip = true;
+        ok = false;
+      }
+      continue;
+    }
+    if (skip) {
+      continue;
+    }
+
+    size_t eq = line.find('=');
+    if (!w || (eq == std::string::npos)) {
+      LOG_ERROR("%s:%d: syntax error", source.c_str(), lineno);
+      ok = false;
+      continue;
+    }
+    std::string key = trim(line.substr(0, eq));
+    std::string value = trim(line.substr(eq + 1));
+    if ((key == "type") && !defaults) {
+      LOG_ERROR("%s:%d: the type of %s can't be changed", source.c_str(), lineno,
+                w->name.c_str());
+      ok = false;
+    } else if (!set(*w, key, value)) {
+      LOG_ERROR("%s:%d: invalid setting: %s = %s", source.c_str(), lineno,
+                key.c_str(), value.c_str());
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+bool OSDLayout::set(Widget &w, const std::string &key, const std::string &value) {
+  int32_t v;
+  if (key == "type") {
+    if (value == "label") {
+      w.type = LABEL;
+    } else if (value == "image") {
+      w.type = IMAGE;
+    } else if (value == "gauge") {
+      w.type = GAUGE;
+    } else if (value == "attitude") {
+      w.type = ATTITUDE;
+    } else {
+      return false;
+    }
+  } else if (key == "x") {
+    if (!parse_int(value, v)) {
+      return false;
+    }
+    w.x = v;
+  } else if (key == "y") {
+    if (!parse_int(value, v)) {
+      return false;
+    }
+    w.y = v;
+  } else if (key == "width") {
+    if (!parse_int(value, v)) {
+      return false;
+    }
+    w.width = v;
+  } else if (key == "height") {
+    if (!parse_int(value, v)) {
+      return false;
+    }
+    w.height = v;
+  } else if (key == "style") {
+    w.style = value;
+  } else if (key == "font") {
+    // The file name can contain spaces, the size is the last word.
+    size_t sp = value.find_last_of(" \t");
+    if (value.empty()) {
+      w.font.clear();
+    } else if ((sp == std::string::npos) || !parse_int(value.substr(sp + 1), v) || (v <= 0)) {
+      return false;
+    } else {
+      w.font = trim(value.substr(0, sp));
+      w.font_size = v;
+    }
+  } else if (key == "align") {
+    if (value == "left") {
+      w.align = LV_LABEL_ALIGN_LEFT;
+    } else if (value == "center") {
+      w.align = LV_LABEL_ALIGN_CENTER;
+    } else if (value == "right") {
+      w.align = LV_LABEL_ALIGN_RIGHT;
+    } else {
+      return false;
+    }
+  } else if (key == "text") {
+    w.text = value;
+    for (const auto &s : g_symbols) {
+      for (size_t pos; (pos = w.text.find(s.name)) != std::string::npos; ) {
+        w.text.replace(pos, strlen(s.name), s.symbol);
+      }
+    }
+  } else if (key == "src") {
+    w.src = value;
+  } else if (key == "zoom") {
+    if (!parse_int(value, v)) {
+      return false;
+    }
+    w.zoom = v;
+  } else if (key == "range") {
+    long min, max;
+    if (sscanf(value.c_str(), "%ld %ld", &min, &max) != 2) {
+      return false;
+    }
+    w.range_min = min;
+    w.range_max = max;
+  } else if (key == "critical") {
+    if (!parse_int(value, v)) {
+      return false;
+    }
+    w.critical = v;
+  } else if (key == "needles") {
+    w.needles.clear();
+    std::istringstream is(value);
+    std::string name;
+    while (is >> name) {
+      size_t i = 0;
+      for (; i < sizeof(g_colors) / sizeof(g_colors[0]); ++i) {
+        if (name == g_colors[i].name) {
+          w.needles.push_back(g_colors[i].color);
+          break;
+        }
+      }
+      if (i == sizeof(g_colors) / sizeof(g_colors[0])) {
+        return false;
+      }
+    }
+  } else if (key == "hidden") {
+    if (!parse_int(value, v)) {
+      return false;
+    }
+    w.hidden = (v != 0);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+lv_style_t *OSDLayout::style(const Widget &w) const {
+  auto si = m_styles.find(w.style);
+  if (si == m_styles.end()) {
+    LOG_ERROR("Unknown style for %s: %s", w.name.c_str(), w.style.c_str());
+    si = m_styles.find("default");
+  }
+  return (si == m_styles.end()) ? NULL : si->second;
+}
+
+void OSDLayout::set_font(const Widget &w) {
+#if USE_FFMPEG_MONITOR
+  const lv_font_t *font = FTFont::get(w.font, std::max(1L, lroundf(w.font_size * m_scale)));
+  if (!font) {
+    return;
+  }
+  // The part that has the text (the scale labels of a gauge)
+  uint8_t part = (w.type == GAUGE) ? LV_GAUGE_PART_MAJOR : LV_OBJ_PART_MAIN;
+  lv_obj_set_style_local_text_font(w.obj, part, LV_STATE_DEFAULT, font);
+#else
+  LOG_ERROR("Font files are only supported in the FFmpeg build, %s uses the built in font",
+            w.name.c_str());
+#endif
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "lvgl/lvgl.h"
+
+// The positions and styles of the OSD widgets.
+// The layout is described in INI format, with one section per widget:
+//
+//   [rssi_gauge]
+//   type = gauge
+//   x = 765
+//   y = 10
+//
+// The built in layout is always loaded first, and a layout file only needs to contain the
+// settings that it changes. All coordinates are absolute screen positions, and labels have
+// a fixed size, so nothing needs to be re-aligned when a value changes.
+//
+// The text of a widget is in the font of its style, unless the widget sets a font file and a
+// size (in layout pixels), which is rendered with FreeType in the FFmpeg build:
+//
+//   font = /usr/share/fonts/truetype/dejavu/DejaVuSansMono-Bold.ttf 30
+//
+// The positions are for a WIDTH x HEIGHT screen. The display resolution is chosen at runtime,
+// so set_screen_size() fits them to the actual screen when the widgets are created: positions
+// are scaled per axis, and sizes (and the image zoom) by the smaller of the two.
+class OSDLayout {
+public:
+
+  // The screen size that the layout positions are for
+  static const lv_coord_t WIDTH = 1280;
+  static const lv_coord_t HEIGHT = 720;
+
+  OSDLayout();
+
+  // The styles and images that the layout can refer to by name.
+  void add_style(const std::string &name, lv_style_t *style);
+  void add_image(const std::string &name, const lv_img_dsc_t *img);
+
+  // Apply the settings from a layout file on top of the current layout.
+  bool load(const std::string &filename);
+
+  // Fit the layout to the screen that it's created on.
+  void set_screen_size(lv_coord_t width, lv_coord_t height);
+
+  // The size of a layout pixel in screen pixels (1 by default).
+  float scale() const { return m_scale; }
+
+  // Create all of the widgets.
+  void create(lv_obj_t *parent);
+
+  // Lookup a widget by name (only valid after create).
+  lv_obj_t *get(const std::string &name) const;
+
+private:
+
+  enum Type { LABEL, IMAGE, GAUGE, ATTITUDE };
+
+  struct Widget {
+    std::string name;
+    Type type;
+    lv_coord_t x;
+    lv_coord_t y;
+    lv_coord_t width;
+    lv_coord_t height;
+    std::string style;
+    std::string font;
+    int32_t font_size;
+    lv_label_align_t align;
+    std::string text;
+    std::string src;
+    uint16_t zoom;
+    int32_t range_min;
+    int32_t range_max;
+    int32_t critical;
+    std::vector<lv_color_t> needles;
+    bool hidden;
+    lv_obj_t *obj;
+  };
+
+  bool parse(const std::string &text, const std::string &source, bool defaults);
+  bool set(Widget &w, const std::string &key, const std::string &value);
+  lv_style_t *style(const Widget &w) const;
+  void set_font(const Widget &w);
+
+
+  std::vector<Widget> m_widgets;
+  std::map<std::string, size_t> m_index;
+  std::map<std::string, lv_style_t*> m_styles;
+  std::map<std::string, const lv_img_dsc_t*> m_images;
+  float m_scale;
+  float m_scale_x;
+  float m_scale_y;
+};
@@ -0,0 +1,495 @@
+
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <thread>
+
+#include "osd_surface.hh"
+#include "color_convert.h"
+#include "logger.hh"
+
+#if USE_FFMPEG_MONITOR
+
+// Beyond this many separate dirty areas, they are all merged into one.
+#define MAX_DIRTY_RECTS 16
+
+// How long to wait for the GPU to finish reading a pixel buffer before LVGL gets it back.
+// It was uploaded a frame earlier, so this normally doesn't wait at all.
+#define FENCE_TIMEOUT_NS 100000000
+
+// Looked up in egl_video.cc (optional)
+extern PFNGLTEXSTORAGE2DPROC glTexStorage2D;
+extern PFNGLBUFFERSTORAGEPROC glBufferStorage;
+extern PFNGLMAPBUFFERRANGEPROC glMapBufferRange;
+extern PFNGLUNMAPBUFFERPROC glUnmapBuffer;
+extern PFNGLFENCESYNCPROC glFenceSync;
+extern PFNGLCLIENTWAITSYNCPROC glClientWaitSync;
+extern PFNGLDELETESYNCPROC glDeleteSync;
+
+// Pack a 32 bit LVGL color (0xAARRGGBB)
+static inline uint16_t pack_4444(uint32_t c) {
+  return ((c >> 8) & 0xf000) | ((c >> 4) & 0x0f00) | (c & 0x00f0) | (c >> 28);
+}
+
+static inline uint16_t pack_565(uint32_t c) {
+  return ((c >> 8) & 0xf800) | ((c >> 5) & 0x07e0) | ((c >> 3) & 0x001f);
+}
+
+static int64_t rect_area(const OSDSurface::Rect &r) {
+  return int64_t(r.x2 - r.x1 + 1) * (r.y2 - r.y1 + 1);
+}
+
+static OSDSurface::Rect rect_union(const OSDSurface::Rect &a, const OSDSurface::Rect &b) {
+  return { std::min(a.x1, b.x1), std::min(a.y1, b.y1), std::max(a.x2, b.x2),
+           std::max(a.y2, b.y2) };
+}
+
+// Add an area to a list of dirty areas.
+static void add_dirty(std::vector<OSDSurface::Rect> &rects, const OSDSurface::Rect &r) {
+  // Merge with an existing area if that doesn't cover any extra pixels (e.g. the strips
+  // that LVGL flushes a large area in).
+  OSDSurface::Rect merged = r;
+  for (size_t i = 0; i < rects.size(); ) {
+    OSDSurface::Rect u = rect_union(rects[i], merged);
+    if (rect_area(u) <= rect_area(rects[i]) + rect_area(merged)) {
+      merged = u;
+      rects.erase(rects.begin() + i);
+      i = 0;
+    } else {
+      ++i;
+    }
+  }
+  rects.push_back(merged);
+
+  if (rects.size() > MAX_DIRTY_RECTS) {
+    OSDSurface::Rect u = rects[0];
+    for (const OSDSurface::Rect &d : rects) {
+      u = rect_union(u, d);
+    }
+    rects.assign(1, u);
+  }
+}
+
+static void add_dirty(std::vector<OSDSurface::Rect> &rects,
+                      const std::vector<OSDSurface::Rect> &add) {
+  for (const OSDSurface::Rect &r : add) {
+    add_dirty(rects, r);
+  }
+}
+
+OSDSurface::OSDSurface(uint32_t width, uint32_t height, Format format) :
+  m_width(width), m_height(height), m_format(format), m_latest(1), m_palette(),
+  m_palette_size(1), m_direct_state(UNMAPPED), m_mapped(0), m_pbo(0), m_back(2),
+  m_direct(false), m_front(0), m_front_direct(false), m_front_fence(0), m_uploaded(false),
+  m_unit(0), m_textures(), m_palette_texture(0), m_palette_uploaded(0) {
+  switch (format) {
+  case RGBA8888:
+    m_planes[0] = { 4, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE };
+    m_nplanes = 1;
+    break;
+  case ARGB4444:
+    m_planes[0] = { 2, GL_RGBA4, GL_RGBA, GL_UNSIGNED_SHORT_4_4_4_4 };
+    m_nplanes = 1;
+    break;
+  case RGB565_A8:
+    m_planes[0] = { 2, GL_RGB565, GL_RGB, GL_UNSIGNED_SHORT_5_6_5 };
+    m_planes[1] = { 1, GL_R8, GL_RED, GL_UNSIGNED_BYTE };
+    m_nplanes = 2;
+    break;
+  case PALETTE8:
+    m_planes[0] = { 1, GL_R8, GL_RED, GL_UNSIGNED_BYTE };
+    m_nplanes = 1;
+    // Index 0 is transparent, and every transparent color maps to it.
+    m_palette_lookup.assign(65536, -1);
+    m_palette_lookup[0] = 0;
+    break;
+  }
+  for (auto &buffer : m_buffers) {
+    for (uint32_t p = 0; p < m_nplanes; ++p) {
+      buffer[p].assign(width * height * m_planes[p].bytes, 0);
+    }
+  }
+}
+
+uint32_t OSDSurface::bytes_per_pixel() const {
+  uint32_t bytes = 0;
+  for (uint32_t p = 0; p < m_nplanes; ++p) {
+    bytes += m_planes[p].bytes;
+  }
+  return bytes;
+}
+
+const char *OSDSurface::shader(Format format) {
+  switch (format) {
+  case ARGB4444:
+    return
+      "vec4 osd_color(vec2 c) {"
+      "\n" "  return texture(uTexO, c);"
+      "\n" "}";
+  case RGB565_A8:
+    return
+      "vec4 osd_color(vec2 c) {"
+      "\n" "  return vec4(texture(uTexO, c).rgb, texture(uTexA, c).r);"
+      "\n" "}";
+  case PALETTE8:
+    // The indices can't be filtered, so they're fetched from the nearest pixel.
+    return
+      "vec4 osd_color(vec2 c) {"
+      "\n" "  ivec2 size = textureSize(uTexO, 0);"
+      "\n" "  float i = texelFetch(uTexO, min(ivec2(c * vec2(size)), size - 1), 0).r;"
+      "\n" "  return texelFetch(uPalette, ivec2(int(i * 255. + .5), 0), 0).zyxw;"
+      "\n" "}";
+  default:
+    // LVGL's colors are BGRA in memory
+    return
+      "vec4 osd_color(vec2 c) {"
+      "\n" "  return texture(uTexO, c).zyxw;"
+      "\n" "}";
+  }
+}
+
+bool OSDSurface::clip(const lv_area_t *area, Rect &r) const {
+  r = { std::max<int32_t>(area->x1, 0), std::max<int32_t>(area->y1, 0),
+        std::min<int32_t>(area->x2, m_width - 1), std::min<int32_t>(area->y2, m_height - 1) };
+  return (r.x1 <= r.x2) && (r.y1 <= r.y2);
+}
+
+uint8_t *OSDSurface::plane(uint32_t index, uint32_t p, bool direct) {
+  if (direct) {
+    return reinterpret_cast<uint8_t*>(m_mapped + index * m_width * m_height);
+  }
+  return m_buffers[index][p].data();
+}
+
+uint8_t OSDSurface::palette_index(uint32_t color) {
+  uint16_t key = (color >> 28) ? pack_4444(color) : 0;
+  int16_t index = m_palette_lookup[key];
+  if (index >= 0) {
+    return index;
+  }
+
+  uint32_t size = m_palette_size.load(std::memory_order_relaxed);
+  if (size < 256) {
+    m_palette[size] = color;
+    m_palette_size.store(size + 1, std::memory_order_release);
+    index = size;
+  } else {
+    // The palette is full, so use the closest color.
+    int32_t best = INT_MAX;
+    for (uint32_t i = 1; i < 256; ++i) {
+      int32_t distance = 0;
+      for (uint32_t shift = 0; shift < 32; shift += 8) {
+        int32_t d = int32_t((color >> shift) & 0xff) - int32_t((m_palette[i] >> shift) & 0xff);
+        distance += d * d;
+      }
+      if (distance < best) {
+        best = distance;
+        index = i;
+      }
+    }
+  }
+  m_palette_lookup[key] = index;
+  return index;
+}
+
+void OSDSurface::write(const lv_area_t *area, const lv_color_t *colors) {
+  Rect r;
+  if (!clip(area, r)) {
+    return;
+  }
+  int32_t src_width = lv_area_get_width(area);
+  const lv_color_t *src = colors + (r.y1 - area->y1) * src_width + (r.x1 - area->x1);
+
+  int32_t width = r.x2 - r.x1 + 1;
+  if (m_format == RGBA8888) {
+    // No packing, so the rows are converted (or copied) in bulk
+    uint32_t *dst = reinterpret_cast<uint32_t*>(plane(m_back, 0, false)) + r.y1 * m_width + r.x1;
+    color_convert_rows(dst, m_width, src, src_width, width, r.y2 - r.y1 + 1);
+    add_dirty(m_frame, r);
+    return;
+  }
+  for (int32_t y = r.y1; y <= r.y2; ++y, src += src_width) {
+    uint32_t offset = y * m_width + r.x1;
+    switch (m_format) {
+    case RGBA8888:  // written above
+      break;
+    case ARGB4444: {
+      uint16_t *dst = reinterpret_cast<uint16_t*>(plane(m_back, 0, false)) + offset;
+      for (int32_t x = 0; x < width; ++x) {
+        dst[x] = pack_4444(color_convert_pixel(src[x]));
+      }
+      break;
+    }
+    case RGB565_A8: {
+      uint16_t *dst = reinterpret_cast<uint16_t*>(plane(m_back, 0, false)) + offset;
+      uint8_t *alpha = plane(m_back, 1, false) + offset;
+      for (int32_t x = 0; x < width; ++x) {
+        uint32_t c = color_convert_pixel(src[x]);
+        dst[x] = pack_565(c);
+        alpha[x] = c >> 24;
+      }
+      break;
+    }
+    case PALETTE8: {
+      uint8_t *dst = plane(m_back, 0, false) + offset;
+      for (int32_t x = 0; x < width; ++x) {
+        dst[x] = palette_index(color_convert_pixel(src[x]));
+      }
+      break;
+    }
+    }
+  }
+  add_dirty(m_frame, r);
+}
+
+void OSDSurface::add_area(const lv_area_t *area) {
+  Rect r;
+  if (clip(area, r)) {
+    add_dirty(m_frame, r);
+  }
+}
+
+lv_color_t *OSDSurface::back_buffer() {
+  return reinterpret_cast<lv_color_t*>(plane(m_back, 0, m_direct));
+}
+
+void OSDSurface::publish() {
+  if (m_frame.empty()) {
+    return;
+  }
+
+  // upload() may skip frames, so each published buffer carries everything that changed
+  // since the last frame that is known to have been picked up.
+  add_dirty(m_unseen, m_frame);
+  m_changed[m_back] = m_unseen;
+
+  uint32_t published = m_back;
+  uint32_t previous = m_latest.exchange(published | FRESH | (m_direct ? DIRECT : 0),
+                                        std::memory_order_acq_rel);
+  if (!(previous & FRESH)) {
+    // The previous frame was picked up, so only this frame's changes can still be unseen.
+    m_unseen = m_frame;
+  }
+  m_back = previous & INDEX;
+
+  // The other two buffers are now missing this frame's changes (in direct mode, LVGL copies
+  // them into its next buffer itself).
+  for (uint32_t i = 0; i < 3; ++i) {
+    if ((i != published) && !(m_direct && (i == m_back))) {
+      add_dirty(m_stale[i], m_frame);
+    }
+  }
+  m_frame.clear();
+
+  // Bring the new back buffer up to date, since LVGL only redraws the areas it invalidates.
+  // The published buffer may be read by the video thread at the same time, but never written.
+  copy_rects(m_back, published, m_direct, m_stale[m_back]);
+  m_stale[m_back].clear();
+}
+
+void OSDSurface::copy_rects(uint32_t dst, uint32_t src, bool direct,
+                            const std::vector<Rect> &rects) {
+  for (uint32_t p = 0; p < m_nplanes; ++p) {
+    uint8_t *to = plane(dst, p, direct);
+    const uint8_t *from = plane(src, p, direct);
+    uint32_t bytes = m_planes[p].bytes;
+    for (const Rect &r : rects) {
+      for (int32_t y = r.y1; y <= r.y2; ++y) {
+        uint32_t offset = (y * m_width + r.x1) * bytes;
+        memcpy(to + offset, from + offset, (r.x2 - r.x1 + 1) * bytes);
+      }
+    }
+  }
+}
+
+bool OSDSurface::update_direct() {
+  if (!m_direct) {
+    int expected = MAPPED;
+    if (!m_direct_state.compare_exchange_strong(expected, IN_USE, std::memory_order_acq_rel)) {
+      return false;
+    }
+    m_direct = true;
+  } else if (m_direct_state.load(std::memory_order_acquire) == RELEASING) {
+    m_direct = false;
+  } else {
+    return false;
+  }
+
+  // The buffers of the other mode are out of date, and the caller redraws the whole OSD.
+  Rect all = { 0, 0, int32_t(m_width) - 1, int32_t(m_height) - 1 };
+  for (auto &stale : m_stale) {
+    stale.assign(1, all);
+  }
+  m_stale[m_back].clear();
+  m_frame.clear();
+
+  if (!m_direct) {
+    m_direct_state.store(UNMAPPED, std::memory_order_release);
+  }
+  return true;
+}
+
+bool OSDSurface::create_textures(GLenum unit) {
+  m_unit = unit;
+  while (glGetError()) {}
+  glGenTextures(m_nplanes, m_textures);
+  for (uint32_t p = 0; p < m_nplanes; ++p) {
+    const Plane &plane = m_planes[p];
+    glActiveTexture(GL_TEXTURE0 + unit + p);
+    glBindTexture(GL_TEXTURE_2D, m_textures[p]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    GLint filter = (m_format == PALETTE8) ? GL_NEAREST : GL_LINEAR;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+    // allocated once, and only the areas that change are uploaded
+    if (glTexStorage2D) {
+      glTexStorage2D(GL_TEXTURE_2D, 1, plane.internal_format, m_width, m_height);
+    } else {
+      glTexImage2D(GL_TEXTURE_2D, 0, plane.internal_format, m_width, m_height, 0, plane.format,
+                   plane.type, NULL);
+    }
+  }
+  if (m_format == PALETTE8) {
+    glGenTextures(1, &m_palette_texture);
+    glActiveTexture(GL_TEXTURE0 + unit + MAX_PLANES);
+    glBindTexture(GL_TEXTURE_2D, m_palette_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 256, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, m_palette);
+    m_palette_uploaded = 0;
+  }
+  glActiveTexture(GL_TEXTURE0);
+  return !glGetError();
+}
+
+bool OSDSurface::map_buffers() {
+  if ((m_format != RGBA8888) || !glBufferStorage || !glMapBufferRange || !glUnmapBuffer || !glFenceSync ||
+      !glClientWaitSync || !glDeleteSync) {
+    return false;
+  }
+
+  // LVGL blends into the buffers, so they're mapped for reading too, and kept in client
+  // memory where reading is fast.
+  GLsizeiptr size = 3 * m_width * m_height * sizeof(uint32_t);
+  GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+    GL_MAP_COHERENT_BIT;
+  while (glGetError()) {}
+  glGenBuffers(1, &m_pbo);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbo);
+  glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL, flags | GL_CLIENT_STORAGE_BIT);
+  m_mapped = static_cast<uint32_t*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags));
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  if (glGetError() || !m_mapped) {
+    glDeleteBuffers(1, &m_pbo);
+    m_pbo = 0;
+    m_mapped = 0;
+    return false;
+  }
+  m_direct_state.store(MAPPED, std::memory_order_release);
+  return true;
+}
+
+void OSDSurface::unmap_buffers() {
+  int state = m_direct_state.exchange(RELEASING, std::memory_order_acq_rel);
+  if (state == IN_USE) {
+    // update_direct() switches LVGL back to its own buffer.
+    while (m_direct_state.load(std::memory_order_acquire) == RELEASING) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+  if (m_pbo) {
+    if (m_front_fence) {
+      glDeleteSync(m_front_fence);
+      m_front_fence = 0;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbo);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &m_pbo);
+    m_pbo = 0;
+    m_mapped = 0;
+  }
+  // A new texture needs all of the OSD.
+  m_front_direct = false;
+  m_uploaded = false;
+  m_direct_state.store(UNMAPPED, std::memory_order_release);
+}
+
+bool OSDSurface::upload() {
+  bool fresh = false;
+  if (m_latest.load(std::memory_order_relaxed) & FRESH) {
+    // The GPU has to be done with the displayed buffer before LVGL can render into it.
+    if (m_front_fence) {
+      if (glClientWaitSync(m_front_fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS) ==
+          GL_TIMEOUT_EXPIRED) {
+        LOG_WARN("Timed out waiting for the OSD pixel buffer upload");
+      }
+      glDeleteSync(m_front_fence);
+      m_front_fence = 0;
+    }
+    uint32_t latest = m_latest.exchange(m_front, std::memory_order_acq_rel);
+    m_front = latest & INDEX;
+    m_front_direct = latest & DIRECT;
+    fresh = true;
+  }
+
+  if (m_palette_texture) {
+    glActiveTexture(GL_TEXTURE0 + m_unit + MAX_PLANES);
+    glBindTexture(GL_TEXTURE_2D, m_palette_texture);
+    uint32_t size = m_palette_size.load(std::memory_order_acquire);
+    if (size > m_palette_uploaded) {
+      glTexSubImage2D(GL_TEXTURE_2D, 0, m_palette_uploaded, 0, size - m_palette_uploaded, 1,
+                      GL_RGBA, GL_UNSIGNED_BYTE, m_palette + m_palette_uploaded);
+      m_palette_uploaded = size;
+    }
+  }
+  for (uint32_t p = 0; p < m_nplanes; ++p) {
+    glActiveTexture(GL_TEXTURE0 + m_unit + p);
+    glBindTexture(GL_TEXTURE_2D, m_textures[p]);
+  }
+  if (m_uploaded && !fresh) {
+    return false;
+  }
+
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, m_width);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  if (m_front_direct) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbo);
+  }
+  for (uint32_t p = 0; p < m_nplanes; ++p) {
+    const Plane &plane = m_planes[p];
+    glActiveTexture(GL_TEXTURE0 + m_unit + p);
+
+    // Direct buffers are uploaded from the pixel buffer, by offset.
+    uintptr_t base = reinterpret_cast<uintptr_t>(this->plane(m_front, p, false));
+    if (m_front_direct) {
+      base = uintptr_t(m_front) * m_width * m_height * plane.bytes;
+    }
+    auto upload_rect = [&](const Rect &r) {
+      uintptr_t offset = (r.y1 * m_width + r.x1) * plane.bytes;
+      glTexSubImage2D(GL_TEXTURE_2D, 0, r.x1, r.y1, r.x2 - r.x1 + 1, r.y2 - r.y1 + 1,
+                      plane.format, plane.type, reinterpret_cast<const void*>(base + offset));
+    };
+    if (m_uploaded) {
+      for (const Rect &r : m_changed[m_front]) {
+        upload_rect(r);
+      }
+    } else {
+      // The texture starts out undefined.
+      upload_rect({ 0, 0, int32_t(m_width) - 1, int32_t(m_height) - 1 });
+    }
+  }
+  m_uploaded = true;
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  if (m_front_direct) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    m_front_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+  return true;
+}
+
+#endif /* USE_FFMPEG_MONITOR */
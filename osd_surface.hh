@@ -0,0 +1,160 @@
+#pragma once
+
+#include "ffmpeg_monitor.h"
+#if USE_FFMPEG_MONITOR
+
+#include <atomic>
+#include <vector>
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <GLES2/gl2.h>
+
+// The OSD framebuffer that LVGL flushes into, and the video thread uploads to a texture.
+//
+// It's triple buffered, so the video thread always uploads a complete OSD frame and never
+// waits for LVGL: LVGL draws into the back buffer, publish() swaps it with the "latest"
+// buffer at the end of each refresh, and upload() swaps the latest buffer with the one being
+// displayed if a newer one was published. The only shared state is the atomic latest index.
+//
+// The flushed areas are collected as dirty rectangles (adjacent flush strips are merged), and
+// only those areas are copied between buffers and uploaded, so an unchanged OSD costs nothing
+// per video frame.
+//
+// The OSD can be stored in a more compact format than LVGL's 32 bit colors, which the
+// fragment shader expands (see shader()). It's mostly transparent with a handful of colors,
+// so that costs little in quality.
+//
+// If the GL driver supports persistently mapped buffers, the three buffers can also live in a
+// pixel buffer object that LVGL renders into directly (as screen sized, "true double"
+// buffers), and the texture is updated from it by the GPU with no copy on the CPU. That's only
+// possible with the RGBA8888 format.
+class OSDSurface {
+public:
+
+  enum Format {
+    RGBA8888,   // LVGL's colors (4 bytes per pixel)
+    ARGB4444,   // 4 bits per channel (2 bytes per pixel)
+    RGB565_A8,  // a 16 bit color plane and an 8 bit alpha plane (3 bytes per pixel)
+    PALETTE8    // indices into a palette of up to 256 colors (1 byte per pixel)
+  };
+
+  struct Rect {
+    int32_t x1, y1, x2, y2;
+  };
+
+  OSDSurface(uint32_t width, uint32_t height, Format format = RGBA8888);
+
+  uint32_t width() const { return m_width; }
+  uint32_t height() const { return m_height; }
+  Format format() const { return m_format; }
+  uint32_t bytes_per_pixel() const;
+
+  // The GLSL function that returns the OSD color (vec4 osd_color(vec2 coord)) from the
+  // samplers uTexO, uTexA and uPalette.
+  static const char *shader(Format format);
+
+  // Copy a flushed area into the back buffer (LVGL thread).
+  void write(const lv_area_t *area, const lv_color_t *colors);
+
+  // Make the back buffer the latest complete frame, after the last flush of a refresh
+  // (LVGL thread).
+  void publish();
+
+  // Create the textures, for the samplers from texture unit `unit` on (video thread, with a
+  // current GL context).
+  bool create_textures(GLenum unit);
+
+  // Upload the areas that changed since the previous upload, and bind the textures
+  // (video thread). Returns false if nothing changed.
+  bool upload();
+
+  // Create the mapped pixel buffer for direct rendering (video thread, with a current GL
+  // context). Returns false if the driver or the format doesn't support it.
+  bool map_buffers();
+
+  // Release the pixel buffer, once the LVGL thread has stopped rendering into it (video
+  // thread, before the GL context is destroyed).
+  void unmap_buffers();
+
+  // Start or stop direct rendering when the pixel buffer is mapped or being released
+  // (LVGL thread, between refreshes). Returns true if the mode changed.
+  bool update_direct();
+  bool direct() const { return m_direct; }
+
+  // The buffer that LVGL renders the next frame into in direct mode
+  lv_color_t *back_buffer();
+
+  // Record an area that LVGL rendered in direct mode (LVGL thread).
+  void add_area(const lv_area_t *area);
+
+private:
+
+  // Set in the latest index when it hasn't been picked up by upload() yet
+  static const uint32_t FRESH = 4;
+  // Set in the latest index when the buffer is in the pixel buffer
+  static const uint32_t DIRECT = 8;
+  static const uint32_t INDEX = 3;
+
+  // Up to two planes per buffer
+  static const uint32_t MAX_PLANES = 2;
+
+  // The state of the pixel buffer
+  enum DirectState { UNMAPPED, MAPPED, IN_USE, RELEASING };
+
+  struct Plane {
+    uint32_t bytes;
+    GLenum internal_format;
+    GLenum format;
+    GLenum type;
+  };
+
+  bool clip(const lv_area_t *area, Rect &r) const;
+  void copy_rects(uint32_t dst, uint32_t src, bool direct, const std::vector<Rect> &rects);
+  uint8_t *plane(uint32_t index, uint32_t p, bool direct);
+  uint8_t palette_index(uint32_t color);
+
+  uint32_t m_width;
+  uint32_t m_height;
+  Format m_format;
+  Plane m_planes[MAX_PLANES];
+  uint32_t m_nplanes;
+  std::vector<uint8_t> m_buffers[3][MAX_PLANES];
+
+  // The areas that changed since the last frame upload() picked up, by buffer
+  // (written before the buffer is published)
+  std::vector<Rect> m_changed[3];
+
+  std::atomic<uint32_t> m_latest;
+
+  // The palette only grows, so an index never changes color and older buffers stay valid.
+  // The colors are written before the size is published.
+  uint32_t m_palette[256];
+  std::atomic<uint32_t> m_palette_size;
+
+  // The pixel buffer (created and released by the video thread)
+  std::atomic<int> m_direct_state;
+  uint32_t *m_mapped;
+  GLuint m_pbo;
+
+  // LVGL thread
+  uint32_t m_back;
+  bool m_direct;
+  std::vector<Rect> m_frame;
+  std::vector<Rect> m_unseen;
+  std::vector<Rect> m_stale[3];
+  // The palette index of each ARGB4444 color (-1 if it isn't assigned yet)
+  std::vector<int16_t> m_palette_lookup;
+
+  // Video thread
+  uint32_t m_front;
+  bool m_front_direct;
+  GLsync m_front_fence;
+  bool m_uploaded;
+  GLenum m_unit;
+  GLuint m_textures[MAX_PLANES];
+  GLuint m_palette_texture;
+  uint32_t m_palette_uploaded;
+};
+
+#endif /* USE_FFMPEG_MONITOR */
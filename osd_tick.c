@@ -0,0 +1,36 @@
+/**
+ * @file osd_tick.c
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#define _POSIX_C_SOURCE 199309L
+#include <time.h>
+
+#include "osd_tick.h"
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+/**
+ * Get the LVGL tick from the monotonic clock, so the tick can't drift and no tick thread is needed
+ * @return milliseconds since an arbitrary starting point
+ */
+uint32_t custom_tick_get(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)((uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+/**
+ * Get the monotonic clock with a finer resolution than the LVGL tick
+ * @return microseconds since an arbitrary starting point
+ */
+uint64_t osd_time_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
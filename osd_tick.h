@@ -0,0 +1,25 @@
+/**
+ * @file osd_tick.h
+ *
+ */
+
+#ifndef OSD_TICK_H
+#define OSD_TICK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* The LVGL tick (milliseconds), read directly from the monotonic clock */
+uint32_t custom_tick_get(void);
+
+/* The monotonic clock in microseconds, for timing the OSD and video frames */
+uint64_t osd_time_us(void);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* OSD_TICK_H */
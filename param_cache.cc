@@ -0,0 +1,405 @@
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <algorithm>
+
+#include <param_cache.hh>
+#include <logger.hh>
+
+// The pseudo parameter that returns the hash of the parameter table.
+#define HASH_CHECK_PARAM "_HASH_CHECK"
+// How long to wait for a response before re-sending a request (seconds).
+#define REQUEST_TIMEOUT 1.0
+#define REQUEST_RETRIES 3
+// The maximum number of missing parameters to re-request at a time.
+#define MAX_MISSING_REQUESTS 16
+// Wait for parameter changes to settle before updating the hash and the cache (seconds).
+#define CHANGE_SETTLE_TIME 2.0
+
+static bool make_dirs(const std::string &path) {
+  for (size_t pos = path.find('/', 1); ; pos = path.find('/', pos + 1)) {
+    std::string dir = path.substr(0, pos);
+    if ((mkdir(dir.c_str(), 0755) != 0) && (errno != EEXIST)) {
+      return false;
+    }
+    if (pos == std::string::npos) {
+      return true;
+    }
+  }
+}
+
+ParamCache::ParamCache() :
+  m_state(IDLE), m_last_request_time(0), m_last_param_time(0), m_retries(0),
+  m_hash(0), m_cached_hash(0), m_received(0), m_dirty(false), m_save_pending(false),
+  m_stop(false) {}
+
+ParamCache::~ParamCache() {
+  {
+    std::lock_guard<std::mutex> lock(m_save_mutex);
+    m_stop = true;
+  }
+  m_save_cond.notify_one();
+  if (m_writer && m_writer->joinable()) {
+    m_writer->join();
+  }
+}
+
+void ParamCache::set_request_callbacks(RequestCB request_version, RequestCB request_list,
+                                       RequestReadCB request_read) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_request_version = request_version;
+  m_request_list = request_list;
+  m_request_read = request_read;
+}
+
+void ParamCache::heartbeat(double time) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_state == IDLE) {
+    enter(REQUEST_UID, time);
+  }
+}
+
+void ParamCache::autopilot_version(uint64_t uid, const uint8_t *uid2, size_t uid2_len,
+                                   double time) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_state != REQUEST_UID) {
+    return;
+  }
+
+  // Prefer the 64 bit UID, and fall back to the longer UID2 if the autopilot only sets that.
+  char buf[64];
+  if (uid != 0) {
+    snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(uid));
+    m_uid = buf;
+  } else {
+    m_uid.clear();
+    for (size_t i = 0; i < uid2_len; ++i) {
+      snprintf(buf, sizeof(buf), "%02x", uid2[i]);
+      m_uid += buf;
+    }
+    if (m_uid.find_first_not_of('0') == std::string::npos) {
+      m_uid = "unknown";
+    }
+  }
+
+  if (load()) {
+    LOG_INFO("Loaded %d cached parameters for vehicle %s",
+            static_cast<int>(m_params.size()), m_uid.c_str());
+  }
+  enter(HASH_CHECK, time);
+}
+
+void ParamCache::param_value(const char *id, float value, uint8_t type, uint16_t count,
+                             uint16_t index, double time) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  // The param id is not null terminated if it uses all 16 characters.
+  std::string name(id, strnlen(id, 16));
+
+  // The hash of the parameter table is returned as the bits of the float value.
+  if (name == HASH_CHECK_PARAM) {
+    uint32_t hash;
+    memcpy(&hash, &value, sizeof(hash));
+    if (m_state == HASH_CHECK) {
+      if ((m_cached_hash == hash) && cache_complete()) {
+        LOG_INFO("Parameter cache is up to date (hash %08x)", hash);
+        enter(DONE, time);
+      } else {
+        m_hash = hash;
+        enter(FETCH, time);
+      }
+    } else if (m_state == RECHECK_HASH) {
+      m_hash = hash;
+      m_dirty = true;
+      enter(DONE, time);
+    }
+    return;
+  }
+
+  // Parameter sets are acknowledged with an index of 65535, so lookup the index by name.
+  if (index == UINT16_MAX) {
+    auto ii = m_index.find(name);
+    if (ii == m_index.end()) {
+      return;
+    }
+    index = ii->second;
+  } else if (count != m_params.size()) {
+    // The parameter table doesn't match the cache, so start over.
+    m_params.assign(count, Param());
+    m_have.assign(count, false);
+    m_index.clear();
+    m_received = 0;
+  }
+  if (index >= m_params.size()) {
+    return;
+  }
+
+  Param &p = m_params[index];
+  if (!p.valid || (p.value != value) || (p.name != name)) {
+    if (m_state != FETCH) {
+      m_dirty = true;
+    }
+    p.name = name;
+    p.type = type;
+    p.value = value;
+    p.valid = true;
+    m_index[name] = index;
+  }
+  if (!m_have[index]) {
+    m_have[index] = true;
+    ++m_received;
+  }
+  m_last_param_time = time;
+
+  // Save the table when the download completes, using the hash that was reported
+  // before the download started if the autopilot supports it.
+  if ((m_state == FETCH) && (m_received == m_params.size())) {
+    LOG_INFO("Received all %d parameters", static_cast<int>(m_params.size()));
+    m_dirty = true;
+    enter(m_hash ? DONE : RECHECK_HASH, time);
+  }
+}
+
+void ParamCache::tick(double time) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  bool timeout = ((time - m_last_request_time) > REQUEST_TIMEOUT);
+
+  switch (m_state) {
+  case REQUEST_UID:
+    if (timeout) {
+      if (++m_retries < REQUEST_RETRIES) {
+        m_last_request_time = time;
+        m_request_version();
+      } else {
+        // No UID, so there is no way to tell vehicles apart.
+        m_uid = "unknown";
+        load();
+        enter(HASH_CHECK, time);
+      }
+    }
+    break;
+  case HASH_CHECK:
+  case RECHECK_HASH:
+    if (timeout) {
+      if (++m_retries < REQUEST_RETRIES) {
+        m_last_request_time = time;
+        m_request_read(HASH_CHECK_PARAM, -1);
+      } else if (m_state == HASH_CHECK) {
+        // The autopilot doesn't support the hash check, so the cache can't be validated.
+        m_hash = 0;
+        enter(FETCH, time);
+      } else {
+        enter(DONE, time);
+      }
+    }
+    break;
+  case FETCH:
+    if ((time - m_last_param_time) > REQUEST_TIMEOUT) {
+      if (m_received == 0) {
+        // The list request (or the start of the response) was lost.
+        if (++m_retries < REQUEST_RETRIES) {
+          m_last_param_time = time;
+          m_request_list();
+        } else {
+          enter(IDLE, time);
+        }
+      } else {
+        request_missing(time);
+      }
+    }
+    break;
+  case DONE:
+    // A parameter was changed (e.g. by a ground station), so update the hash and the cache.
+    if (m_dirty && ((time - m_last_param_time) > CHANGE_SETTLE_TIME)) {
+      enter(RECHECK_HASH, time);
+    }
+    break;
+  case IDLE:
+    break;
+  }
+}
+
+bool ParamCache::get(const std::string &name, float &value) const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto ii = m_index.find(name);
+  if ((ii == m_index.end()) || !m_params[ii->second].valid) {
+    return false;
+  }
+  value = m_params[ii->second].value;
+  return true;
+}
+
+bool ParamCache::complete() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return (m_state == DONE);
+}
+
+void ParamCache::enter(State state, double time) {
+  m_state = state;
+  m_last_request_time = time;
+  m_retries = 0;
+
+  switch (state) {
+  case REQUEST_UID:
+    m_request_version();
+    break;
+  case HASH_CHECK:
+  case RECHECK_HASH:
+    m_request_read(HASH_CHECK_PARAM, -1);
+    break;
+  case FETCH:
+    // The cached values stay available while the new table is downloaded.
+    m_have.assign(m_params.size(), false);
+    m_received = 0;
+    m_last_param_time = time;
+    m_request_list();
+    break;
+  case DONE:
+    if (m_dirty) {
+      queue_save();
+      m_cached_hash = m_hash;
+      m_dirty = false;
+    }
+    break;
+  case IDLE:
+    break;
+  }
+}
+
+void ParamCache::request_missing(double time) {
+  int nrequested = 0;
+  for (size_t i = 0; (i < m_params.size()) && (nrequested < MAX_MISSING_REQUESTS); ++i) {
+    if (!m_have[i]) {
+      m_request_read("", static_cast<int16_t>(i));
+      ++nrequested;
+    }
+  }
+  m_last_param_time = time;
+}
+
+bool ParamCache::cache_complete() const {
+  return !m_params.empty() &&
+    std::all_of(m_params.begin(), m_params.end(), [](const Param &p) { return p.valid; });
+}
+
+bool ParamCache::load() {
+  m_params.clear();
+  m_have.clear();
+  m_index.clear();
+  m_received = 0;
+  m_cached_hash = 0;
+
+  FILE *fp = fopen(cache_path().c_str(), "r");
+  if (!fp) {
+    return false;
+  }
+  unsigned int hash;
+  unsigned int count;
+  if (fscanf(fp, "hash %x count %u\n", &hash, &count) != 2) {
+    fclose(fp);
+    return false;
+  }
+  m_params.resize(count);
+  m_have.assign(count, false);
+  unsigned int index;
+  char name[17];
+  unsigned int type;
+  uint32_t bits;
+  while (fscanf(fp, "%u %16s %u %x\n", &index, name, &type, &bits) == 4) {
+    if (index >= count) {
+      continue;
+    }
+    // Store the bits of the value to avoid any loss of precision.
+    Param &p = m_params[index];
+    p.name = name;
+    p.type = type;
+    memcpy(&p.value, &bits, sizeof(bits));
+    p.valid = true;
+    m_index[p.name] = index;
+  }
+  fclose(fp);
+  m_cached_hash = hash;
+  return true;
+}
+
+void ParamCache::queue_save() {
+  {
+    std::lock_guard<std::mutex> lock(m_save_mutex);
+    // A newer table replaces one that hasn't been written yet.
+    m_save.path = cache_path();
+    m_save.uid = m_uid;
+    m_save.hash = m_hash;
+    m_save.params = m_params;
+    m_save_pending = true;
+    if (!m_writer) {
+      m_writer.reset(new std::thread([this]() { this->writer_thread(); }));
+    }
+  }
+  m_save_cond.notify_one();
+}
+
+void ParamCache::writer_thread() {
+  std::unique_lock<std::mutex> lock(m_save_mutex);
+  while (true) {
+    m_save_cond.wait(lock, [this]() { return m_save_pending || m_stop; });
+    if (!m_save_pending) {
+      return;
+    }
+    SaveRequest req;
+    std::swap(req, m_save);
+    m_save_pending = false;
+
+    lock.unlock();
+    if (save(req)) {
+      LOG_INFO("Saved %d parameters for vehicle %s",
+              static_cast<int>(req.params.size()), req.uid.c_str());
+    }
+    lock.lock();
+  }
+}
+
+bool ParamCache::save(const SaveRequest &req) {
+  const std::string &path = req.path;
+  if (!make_dirs(path.substr(0, path.rfind('/')))) {
+    LOG_ERROR("Error creating the parameter cache directory for: %s", path.c_str());
+    return false;
+  }
+
+  // Write to a temporary file and rename it so that a partial cache is never read.
+  std::string tmp_path = path + ".tmp";
+  FILE *fp = fopen(tmp_path.c_str(), "w");
+  if (!fp) {
+    LOG_ERROR("Error writing the parameter cache: %s", tmp_path.c_str());
+    return false;
+  }
+  fprintf(fp, "hash %08x count %u\n", req.hash, static_cast<unsigned int>(req.params.size()));
+  for (size_t i = 0; i < req.params.size(); ++i) {
+    const Param &p = req.params[i];
+    if (p.valid) {
+      uint32_t bits;
+      memcpy(&bits, &p.value, sizeof(bits));
+      fprintf(fp, "%u %s %u %08x\n", static_cast<unsigned int>(i), p.name.c_str(), p.type, bits);
+    }
+  }
+  fclose(fp);
+  return (rename(tmp_path.c_str(), path.c_str()) == 0);
+}
+
+std::string ParamCache::cache_path() const {
+  std::string dir;
+  const char *cache_home = getenv("XDG_CACHE_HOME");
+  const char *home = getenv("HOME");
+  if (cache_home && *cache_home) {
+    dir = cache_home;
+  } else if (home && *home) {
+    dir = std::string(home) + "/.cache";
+  } else {
+    dir = "/tmp";
+  }
+  return dir + "/lvgl_osd/params/" + m_uid + ".params";
+}
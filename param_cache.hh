@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Caches the autopilot parameters on disk, keyed by the vehicle UID, so that they don't need to
+// be downloaded over the telemetry link after every reconnect.
+//
+// On connect the vehicle UID is requested (AUTOPILOT_VERSION), the cached table for that vehicle
+// is loaded, and the parameter hash is requested (the _HASH_CHECK pseudo parameter). If the hash
+// matches the cache, nothing else is downloaded. Otherwise the parameter list is requested, and
+// any parameters that were lost on the link are re-requested individually, rather than
+// restarting the whole download. Parameter changes seen on the link are applied to the cache.
+// The cache file is written by a background thread, so the telemetry thread never waits on
+// the disk.
+class ParamCache {
+public:
+
+  typedef std::function<void()> RequestCB;
+  typedef std::function<void(const char *id, int16_t index)> RequestReadCB;
+
+  ParamCache();
+  ~ParamCache();
+
+  // The callbacks used to send requests to the autopilot.
+  void set_request_callbacks(RequestCB request_version, RequestCB request_list,
+                             RequestReadCB request_read);
+
+  // Messages received from the autopilot.
+  void heartbeat(double time);
+  void autopilot_version(uint64_t uid, const uint8_t *uid2, size_t uid2_len, double time);
+  void param_value(const char *id, float value, uint8_t type, uint16_t count, uint16_t index,
+                   double time);
+
+  // Drive the retries and timeouts of the state machine.
+  void tick(double time);
+
+  // Lookup a parameter by name.
+  bool get(const std::string &name, float &value) const;
+
+  // True once the full parameter table is available (from the cache or downloaded).
+  bool complete() const;
+
+private:
+
+  enum State { IDLE, REQUEST_UID, HASH_CHECK, FETCH, RECHECK_HASH, DONE };
+
+  struct Param {
+    Param() : type(0), value(0), valid(false) {}
+    std::string name;
+    uint8_t type;
+    float value;
+    bool valid;
+  };
+
+  // A copy of the table to write to the cache file
+  struct SaveRequest {
+    std::string path;
+    std::string uid;
+    uint32_t hash;
+    std::vector<Param> params;
+  };
+
+  void enter(State state, double time);
+  void request_missing(double time);
+  bool cache_complete() const;
+  bool load();
+  void queue_save();
+  void writer_thread();
+  static bool save(const SaveRequest &req);
+  std::string cache_path() const;
+
+  mutable std::mutex m_mutex;
+  RequestCB m_request_version;
+  RequestCB m_request_list;
+  RequestReadCB m_request_read;
+  State m_state;
+  double m_last_request_time;
+  double m_last_param_time;
+  int m_retries;
+  std::string m_uid;
+  uint32_t m_hash;
+  uint32_t m_cached_hash;
+  std::vector<Param> m_params;
+  std::vector<bool> m_have;
+  std::map<std::string, uint16_t> m_index;
+  uint16_t m_received;
+  bool m_dirty;
+
+  std::mutex m_save_mutex;
+  std::condition_variable m_save_cond;
+  SaveRequest m_save;
+  bool m_save_pending;
+  bool m_stop;
+  std::shared_ptr<std::thread> m_writer;
+};
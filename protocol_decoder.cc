@@ -0,0 +1,161 @@
+
+#include <stdio.h>
+
+#include <algorithm>
+
+#include <protocol_decoder.hh>
+#include <mavlink_decoder.hh>
+#include <ltm_decoder.hh>
+#include <msp_decoder.hh>
+#include <crsf_decoder.hh>
+#include <telemetry.hh>
+#include <logger.hh>
+
+// The number of valid frames required before locking onto a protocol.
+#define PROTOCOL_LOCK_FRAMES 3
+// Restart the protocol detection if no valid frame has been received for this long (seconds).
+#define PROTOCOL_TIMEOUT 5.0
+// The frames that lock onto a protocol must be in a row, with at most this long between them
+// (seconds), so that frames that pass a short checksum by chance in noise don't add up.
+#define PROTOCOL_LOCK_WINDOW 1.0
+
+int ProtocolDecoder::key_id(const char *name) const {
+  for (const auto &k : m_key_ids) {
+    if (k.first == name) {
+      return k.second;
+    }
+  }
+  int id = m_telem.key_id(name);
+  m_key_ids.push_back(std::make_pair(name, id));
+  return id;
+}
+
+void ProtocolDecoder::set_value(const char *name, float value) {
+  if (m_publish) {
+    m_telem.set_value(key_id(name), value);
+  }
+}
+
+void ProtocolDecoder::set_value(const std::string &name, float value) {
+  if (m_publish) {
+    m_telem.set_value(name, value);
+  }
+}
+
+void ProtocolDecoder::set_text(const char *name, const char *text) {
+  if (m_publish) {
+    m_telem.set_text(key_id(name), text);
+  }
+}
+
+void ProtocolDecoder::set_mode(uint32_t mode, const char *const *names, size_t count) {
+  set_value("mode", static_cast<float>(mode));
+  if (mode < count) {
+    set_text("mode_name", names[mode]);
+  } else {
+    char name[32];
+    snprintf(name, sizeof(name), UNKNOWN_MODE_PREFIX "%u", mode);
+    set_text("mode_name", name);
+  }
+}
+
+bool ProtocolDecoder::get_value(const char *name, float &value) const {
+  return m_telem.get_value(key_id(name), value);
+}
+
+bool ProtocolDecoder::send(const uint8_t *data, size_t len) {
+  return m_telem.send(data, len);
+}
+
+ParamCache &ProtocolDecoder::params() {
+  return m_telem.m_params;
+}
+
+uint8_t ProtocolDecoder::crc8_dvb_s2(uint8_t crc, uint8_t c) {
+  crc ^= c;
+  for (int i = 0; i < 8; ++i) {
+    if (crc & 0x80) {
+      crc = (crc << 1) ^ 0xD5;
+    } else {
+      crc = crc << 1;
+    }
+  }
+  return crc;
+}
+
+ProtocolDetector::ProtocolDetector(Telemetry &telem) : m_active(-1), m_last_frame_time(0) {
+  m_decoders.push_back(std::make_shared<MAVLinkDecoder>(telem));
+  m_decoders.push_back(std::make_shared<LTMDecoder>(telem));
+  m_decoders.push_back(std::make_shared<MSPDecoder>(telem));
+  m_decoders.push_back(std::make_shared<CRSFDecoder>(telem));
+  m_frame_counts.resize(m_decoders.size(), 0);
+  unlock();
+}
+
+void ProtocolDetector::check_timeout(double time) {
+  int active = m_active;
+  if ((active >= 0) && ((time - m_last_frame_time) > PROTOCOL_TIMEOUT)) {
+    LOG_WARN("Lost the %s telemetry stream, restarting protocol detection",
+            m_decoders[active]->name());
+    unlock();
+  }
+}
+
+void ProtocolDetector::parse(const uint8_t *data, size_t len, double time) {
+  // A stream that was silent for too long may be a different protocol now.
+  check_timeout(time);
+  int active = m_active;
+
+  // Only the detected protocol needs to see the data once we're locked.
+  if (active >= 0) {
+    ProtocolDecoder &decoder = *m_decoders[active];
+    for (size_t i = 0; i < len; ++i) {
+      if (decoder.parse(data[i])) {
+        m_last_frame_time = time;
+      }
+    }
+    return;
+  }
+
+  // Otherwise try all of the decoders in parallel until one of them has decoded enough frames
+  // in a row.
+  for (size_t i = 0; i < len; ++i) {
+    for (size_t d = 0; d < m_decoders.size(); ++d) {
+      if (!m_decoders[d]->parse(data[i])) {
+        continue;
+      }
+      uint32_t count = ((time - m_last_frame_time) <= PROTOCOL_LOCK_WINDOW) ?
+        m_frame_counts[d] + 1 : 1;
+      std::fill(m_frame_counts.begin(), m_frame_counts.end(), 0);
+      m_frame_counts[d] = count;
+      m_last_frame_time = time;
+      if (count >= PROTOCOL_LOCK_FRAMES) {
+        active = static_cast<int>(d);
+        break;
+      }
+    }
+    if (active >= 0) {
+      LOG_INFO("Detected %s telemetry", m_decoders[active]->name());
+      m_decoders[active]->publish(true);
+      m_last_frame_time = time;
+      m_active = active;
+      // Hand the rest of the buffer to the detected protocol.
+      parse(data + i + 1, len - i - 1, time);
+      return;
+    }
+  }
+}
+
+const char *ProtocolDetector::protocol() const {
+  int active = m_active;
+  return (active >= 0) ? m_decoders[active]->name() : "";
+}
+
+void ProtocolDetector::unlock() {
+  m_active = -1;
+  for (size_t d = 0; d < m_decoders.size(); ++d) {
+    m_decoders[d]->reset();
+    m_decoders[d]->publish(false);
+    m_frame_counts[d] = 0;
+  }
+}
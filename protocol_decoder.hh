@@ -0,0 +1,117 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Telemetry;
+class ParamCache;
+
+#define UNKNOWN_MODE_PREFIX "Mode "
+
+// Base class for the streaming telemetry protocol parsers.
+// Parsers are fed one byte at a time and decode frames out of fixed size buffers, so
+// nothing is allocated on the receive path. Decoded values are written into the
+// Telemetry value store using the same names as the MAVLink decoder.
+class ProtocolDecoder {
+public:
+
+  ProtocolDecoder(Telemetry &telem) : m_telem(telem), m_publish(true) {}
+  virtual ~ProtocolDecoder() {}
+
+  virtual const char *name() const = 0;
+
+  // Parse the next byte of the stream.
+  // Returns true if the byte completed a frame that passed the checksum.
+  virtual bool parse(uint8_t c) = 0;
+
+  // Discard any partial frame and search for the start of the next frame.
+  virtual void reset() = 0;
+
+  // Decoded frames only update the telemetry values while publishing is enabled.
+  void publish(bool val) { m_publish = val; }
+
+protected:
+
+  // The names are string literals. Each one is looked up once, and after that its value is
+  // set by ID, so decoding a frame doesn't build any strings.
+  void set_value(const char *name, float value);
+  bool get_value(const char *name, float &value) const;
+  // A name that is built at runtime
+  void set_value(const std::string &name, float value);
+  // A text value (see Telemetry::get_text())
+  void set_text(const char *name, const char *text);
+
+  // Publish the flight mode number ("mode") and its name from the autopilot's mode table
+  // ("mode_name"). A mode that isn't in the table is named UNKNOWN_MODE_PREFIX and its number.
+  void set_mode(uint32_t mode, const char *const *names, size_t count);
+
+  // Send a message back to the sender of the telemetry stream.
+  bool send(const uint8_t *data, size_t len);
+
+  ParamCache &params();
+
+  static uint16_t read_le16(const uint8_t *p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+  }
+  static uint32_t read_le32(const uint8_t *p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+      (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+  }
+  static uint16_t read_be16(const uint8_t *p) {
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+  }
+  static uint32_t read_be24(const uint8_t *p) {
+    return (static_cast<uint32_t>(p[0]) << 16) | (static_cast<uint32_t>(p[1]) << 8) |
+      static_cast<uint32_t>(p[2]);
+  }
+  static uint32_t read_be32(const uint8_t *p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+      (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+  }
+
+  // CRC-8/DVB-S2, used by both MSPv2 and CRSF.
+  static uint8_t crc8_dvb_s2(uint8_t crc, uint8_t c);
+
+  Telemetry &m_telem;
+
+private:
+
+  int key_id(const char *name) const;
+
+  bool m_publish;
+  // The IDs of the names that have been used, by the address of the literal
+  mutable std::vector<std::pair<const char*, int> > m_key_ids;
+};
+
+// Feeds the telemetry byte stream to all of the known protocol decoders until one of them
+// has decoded a few valid frames, and then locks onto that protocol. If the locked protocol
+// stops producing frames, the detection starts over, so the same binary works with any
+// airframe without a protocol converter in front of it.
+class ProtocolDetector {
+public:
+
+  ProtocolDetector(Telemetry &telem);
+
+  void parse(const uint8_t *data, size_t len, double time);
+
+  // Restart the detection if the detected protocol hasn't produced a frame for a while.
+  // Called for each buffer that's parsed, and periodically while the stream is silent.
+  void check_timeout(double time);
+
+  // The name of the detected protocol, or an empty string if no protocol has been detected.
+  const char *protocol() const;
+
+private:
+
+  void unlock();
+
+  std::vector<std::shared_ptr<ProtocolDecoder> > m_decoders;
+  std::vector<uint32_t> m_frame_counts;
+  std::atomic<int> m_active;
+  double m_last_frame_time;
+};
@@ -0,0 +1,249 @@
+
+#include <math.h>
+
+#include <algorithm>
+
+#include "rotation_cache.hh"
+#include "logger.hh"
+
+// The most samples per axis that are averaged into each pixel when the image is scaled down.
+#define MAX_SUBSAMPLES 4
+
+// The memory for the rotated frames of each image. At least two frames are kept, the one that
+// is shown and the one that is being rendered.
+#ifndef ROTATION_CACHE_BYTES
+#define ROTATION_CACHE_BYTES (4 * 1024 * 1024)
+#endif
+
+RotationCache::RotationCache(lv_obj_t *img, int step_degrees) :
+  m_obj(img), m_src(NULL), m_zoom(lv_img_get_zoom(img)), m_step(std::max(step_degrees, 1)),
+  m_nframes(0), m_size(0), m_wanted(-1), m_shown(-1), m_clock(0), m_stop(false),
+  m_using_frames(false), m_frame(-1) {
+  m_center_x = lv_obj_get_x(img) + lv_obj_get_width(img) / 2;
+  m_center_y = lv_obj_get_y(img) + lv_obj_get_height(img) / 2;
+
+  // Only images in memory with an alpha channel can be rotated here, otherwise LVGL keeps
+  // doing the rotation.
+  const void *src = lv_img_get_src(img);
+  if (!src || (lv_img_src_get_type(src) != LV_IMG_SRC_VARIABLE)) {
+    return;
+  }
+  const lv_img_dsc_t *dsc = static_cast<const lv_img_dsc_t*>(src);
+  if ((LV_COLOR_DEPTH != 32) || (dsc->header.cf != LV_IMG_CF_TRUE_COLOR_ALPHA)) {
+    LOG_WARN("Rotated images must be ARGB8888, rotating with LVGL instead");
+    return;
+  }
+  m_src = dsc;
+
+  double w = dsc->header.w;
+  double h = dsc->header.h;
+  m_size = static_cast<int>(ceil(sqrt(w * w + h * h) * m_zoom / LV_IMG_ZOOM_NONE)) + 1;
+  m_nframes = (360 + m_step - 1) / m_step;
+}
+
+RotationCache::~RotationCache() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_cond.notify_one();
+  if (m_thread.joinable()) {
+    m_thread.join();
+  }
+}
+
+void RotationCache::start() {
+  if (!m_slots.empty()) {
+    return;
+  }
+  size_t frame_bytes = m_size * m_size * LV_IMG_PX_SIZE_ALPHA_BYTE;
+  int nslots = std::min(std::max(static_cast<int>(ROTATION_CACHE_BYTES / frame_bytes), 2),
+                        m_nframes);
+  m_slots.resize(nslots);
+  for (Slot &slot : m_slots) {
+    slot.data.resize(frame_bytes);
+    slot.dsc.header.always_zero = 0;
+    slot.dsc.header.w = m_size;
+    slot.dsc.header.h = m_size;
+    slot.dsc.header.cf = LV_IMG_CF_TRUE_COLOR_ALPHA;
+    slot.dsc.data_size = slot.data.size();
+    slot.dsc.data = slot.data.data();
+    slot.frame = -1;
+    slot.last_used = 0;
+  }
+  LOG_DEBUG("Caching %d of the %d rotations of a %dx%d image", nslots, m_nframes,
+            m_size, m_size);
+  m_thread = std::thread(&RotationCache::render_thread, this);
+}
+
+void RotationCache::set_angle(float degrees) {
+  float angle = fmod(degrees, 360.0);
+  if (angle < 0) {
+    angle += 360.0;
+  }
+  if (!m_src) {
+    lv_img_set_angle(m_obj, static_cast<int16_t>(angle * 10));
+    return;
+  }
+  start();
+
+  // Use the frame if it has been rendered, and have the render thread work on the frames
+  // around it.
+  int frame = static_cast<int>(angle / m_step + 0.5) % m_nframes;
+  int shown = -1;
+  bool moved;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    moved = (frame != m_wanted);
+    m_wanted = frame;
+    for (size_t i = 0; i < m_slots.size(); ++i) {
+      if (m_slots[i].frame == frame) {
+        m_slots[i].last_used = ++m_clock;
+        shown = static_cast<int>(i);
+        break;
+      }
+    }
+    m_shown = shown;
+  }
+  if (moved) {
+    m_cond.notify_one();
+  }
+
+  if (shown >= 0) {
+    use_frames(true);
+    if (shown != m_frame) {
+      lv_img_set_src(m_obj, &m_slots[shown].dsc);
+      m_frame = shown;
+    }
+  } else {
+    use_frames(false);
+    lv_img_set_angle(m_obj, static_cast<int16_t>(angle * 10));
+  }
+}
+
+void RotationCache::use_frames(bool on) {
+  if (on == m_using_frames) {
+    return;
+  }
+  m_using_frames = on;
+
+  // The frames are already rotated and scaled, and are larger than the image.
+  if (on) {
+    lv_img_set_angle(m_obj, 0);
+    lv_img_set_zoom(m_obj, LV_IMG_ZOOM_NONE);
+    lv_obj_set_pos(m_obj, m_center_x - m_size / 2, m_center_y - m_size / 2);
+  } else {
+    lv_img_set_src(m_obj, m_src);
+    lv_img_set_zoom(m_obj, m_zoom);
+    lv_obj_set_pos(m_obj, m_center_x - m_src->header.w / 2, m_center_y - m_src->header.h / 2);
+    m_frame = -1;
+  }
+}
+
+int RotationCache::next_frame() const {
+  if (m_wanted < 0) {
+    return -1;
+  }
+  // The wanted frame first, and then outwards in both directions while there are enough slots
+  // to keep them all.
+  int radius = (static_cast<int>(m_slots.size()) - 1) / 2;
+  for (int d = 0; d <= radius; ++d) {
+    for (int sign = 1; sign >= -1; sign -= 2) {
+      int frame = (m_wanted + sign * d + m_nframes) % m_nframes;
+      bool cached = std::any_of(m_slots.begin(), m_slots.end(),
+                                [frame](const Slot &slot) { return slot.frame == frame; });
+      if (!cached) {
+        return frame;
+      }
+    }
+  }
+  return -1;
+}
+
+void RotationCache::render_thread() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!m_stop) {
+    int frame = next_frame();
+    if (frame < 0) {
+      m_cond.wait(lock);
+      continue;
+    }
+
+    // Reuse the least recently used slot, but never the one that the widget shows.
+    Slot *slot = NULL;
+    for (size_t i = 0; i < m_slots.size(); ++i) {
+      if ((static_cast<int>(i) != m_shown) &&
+          (!slot || (m_slots[i].last_used < slot->last_used))) {
+        slot = &m_slots[i];
+      }
+    }
+    slot->frame = -1;
+
+    lock.unlock();
+    render(*slot, frame * m_step);
+    lock.lock();
+    slot->frame = frame;
+    slot->last_used = ++m_clock;
+  }
+}
+
+void RotationCache::render(Slot &slot, float degrees) const {
+  const uint8_t *src = m_src->data;
+  int sw = m_src->header.w;
+  int sh = m_src->header.h;
+  double scale = static_cast<double>(m_zoom) / LV_IMG_ZOOM_NONE;
+
+  // Map each output pixel back into the image (rotating counter-clockwise).
+  double rad = degrees * M_PI / 180.0;
+  double c = cos(rad) / scale;
+  double s = sin(rad) / scale;
+  double half = m_size / 2.0;
+  double src_cx = sw / 2.0 - 0.5;
+  double src_cy = sh / 2.0 - 0.5;
+
+  // Average several bilinear samples per pixel when scaling down, with premultiplied alpha so
+  // the transparent pixels don't darken the edges.
+  int nsub = std::min(std::max(static_cast<int>(ceil(1.0 / scale)), 1), MAX_SUBSAMPLES);
+  float nsamples = nsub * nsub;
+
+  uint8_t *out = slot.data.data();
+  for (int y = 0; y < m_size; ++y) {
+    for (int x = 0; x < m_size; ++x, out += 4) {
+      float acc[4] = { 0, 0, 0, 0 };
+      for (int j = 0; j < nsub; ++j) {
+        for (int i = 0; i < nsub; ++i) {
+          double dx = x + (i + 0.5) / nsub - half;
+          double dy = y + (j + 0.5) / nsub - half;
+          double sx = c * dx + s * dy + src_cx;
+          double sy = -s * dx + c * dy + src_cy;
+          int x0 = static_cast<int>(floor(sx));
+          int y0 = static_cast<int>(floor(sy));
+          float fx = sx - x0;
+          float fy = sy - y0;
+          for (int k = 0; k < 4; ++k) {
+            int px = x0 + (k & 1);
+            int py = y0 + (k >> 1);
+            if ((px < 0) || (py < 0) || (px >= sw) || (py >= sh)) {
+              continue;
+            }
+            const uint8_t *p = src + (py * sw + px) * 4;
+            float weight = ((k & 1) ? fx : (1.0f - fx)) * ((k >> 1) ? fy : (1.0f - fy));
+            float alpha = p[3] * weight;
+            acc[0] += p[0] * alpha;
+            acc[1] += p[1] * alpha;
+            acc[2] += p[2] * alpha;
+            acc[3] += alpha;
+          }
+        }
+      }
+      if (acc[3] <= 0) {
+        out[0] = out[1] = out[2] = out[3] = 0;
+        continue;
+      }
+      out[0] = static_cast<uint8_t>(acc[0] / acc[3] + 0.5f);
+      out[1] = static_cast<uint8_t>(acc[1] / acc[3] + 0.5f);
+      out[2] = static_cast<uint8_t>(acc[2] / acc[3] + 0.5f);
+      out[3] = static_cast<uint8_t>(std::min(acc[3] / nsamples + 0.5f, 255.0f));
+    }
+  }
+}
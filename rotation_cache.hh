@@ -0,0 +1,72 @@
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "lvgl/lvgl.h"
+
+// Shows an image widget at any angle using frames that were rotated in advance.
+// LVGL rotates and scales the whole image with antialiasing every time the angle changes,
+// but here the image is rendered at the widget's zoom for each angle step (in a background
+// thread), so changing the angle usually just selects a different frame.
+//
+// The frames are square, and large enough for the image at any angle, so each frame takes
+// (diagonal * zoom)^2 * 4 bytes. Only the frames near the current angle are kept, in a fixed
+// number of slots that fit in ROTATION_CACHE_BYTES, and the least recently used slot is reused
+// as the angle moves. Nothing is rendered (or allocated) until the first set_angle(), and until
+// the frame of an angle has been rendered, the angle is passed to LVGL as before.
+class RotationCache {
+public:
+
+  // The image source and zoom are taken from the widget, which must already be created.
+  RotationCache(lv_obj_t *img, int step_degrees = 2);
+  ~RotationCache();
+
+  // Rotate the image clockwise.
+  void set_angle(float degrees);
+
+private:
+
+  struct Slot {
+    lv_img_dsc_t dsc;
+    std::vector<uint8_t> data;
+    // The angle step of the frame, or -1 while the slot is empty or being rendered
+    int frame;
+    uint64_t last_used;
+  };
+
+  void start();
+  void render_thread();
+  // The next frame near the wanted angle that isn't in a slot, or -1 if there are none.
+  // Must be called with the mutex held.
+  int next_frame() const;
+  void render(Slot &slot, float degrees) const;
+  void use_frames(bool on);
+
+  lv_obj_t *m_obj;
+  const lv_img_dsc_t *m_src;
+  uint16_t m_zoom;
+  int m_step;
+  int m_nframes;
+  int m_size;
+  // The center of the widget, which is kept in place when the image size changes.
+  lv_coord_t m_center_x;
+  lv_coord_t m_center_y;
+
+  // The slots, the frame that set_angle() wants and the slot that the widget shows are shared
+  // with the render thread.
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+  std::vector<Slot> m_slots;
+  int m_wanted;
+  int m_shown;
+  uint64_t m_clock;
+  bool m_stop;
+  std::thread m_thread;
+  bool m_using_frames;
+  // The slot that the widget's source was set to (only used by set_angle())
+  int m_frame;
+};
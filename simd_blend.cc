@@ -0,0 +1,431 @@
+
+#include <string.h>
+
+#include "simd_blend.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#if defined(__ARM_NEON)
+#define SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+// The callbacks work on 32 bit pixels. At the other depths, LVGL's own loops are used.
+#if LV_COLOR_DEPTH == 32
+
+// The callbacks replace LVGL's software loops for fills and blends larger than GPU_SIZE_LIMIT,
+// so they produce exactly the same pixels: lv_color_mix() (with LV_MATH_UDIV255), and
+// lv_color_mix_with_alpha() when the screen is transparent. Opaque images are blended with
+// gpu_blend_cb as well, so it's also the image blend path (images with an alpha channel are
+// drawn through LVGL's mask path, which has no callback).
+//
+// The vector code divides by 255 with (x + 1 + (x >> 8)) >> 8, which is equal to LVGL's
+// (x * 0x8081) >> 23 for all of the 16 bit sums.
+
+static inline bool transparent_screen(const lv_disp_drv_t *disp_drv) {
+#if LV_COLOR_SCREEN_TRANSP
+  return disp_drv->screen_transp;
+#else
+  (void)disp_drv;
+  return false;
+#endif
+}
+
+static inline uint32_t div255(uint32_t x) {
+  return (x * 0x8081) >> 23;
+}
+
+// lv_color_mix()
+static inline uint32_t mix(uint32_t fg, uint32_t bg, uint32_t opa) {
+  uint32_t res = 0xff000000;
+  for (uint32_t shift = 0; shift < 24; shift += 8) {
+    res |= div255(((fg >> shift) & 0xff) * opa + ((bg >> shift) & 0xff) * (255 - opa)) << shift;
+  }
+  return res;
+}
+
+// lv_color_mix_with_alpha(), with the alpha channel as the background opacity
+static inline uint32_t mix_alpha(uint32_t fg, uint32_t bg, uint32_t opa) {
+  uint32_t bg_opa = bg >> 24;
+  if ((opa >= LV_OPA_MAX) || (bg_opa <= LV_OPA_MIN)) {
+    return (fg & 0xffffff) | (opa << 24);
+  }
+  if (opa <= LV_OPA_MIN) {
+    return bg;
+  }
+  if (bg_opa >= LV_OPA_MAX) {
+    return mix(fg, bg, opa);
+  }
+  uint32_t res_opa = 255 - (((255 - opa) * (255 - bg_opa)) >> 8);
+  uint8_t ratio = (opa * 255) / res_opa;
+  return (mix(fg, bg, ratio) & 0xffffff) | (res_opa << 24);
+}
+
+// Blend pixels one at a time (the tails of the vector loops)
+static void blend_pixels(lv_color_t *dest, const lv_color_t *src, uint32_t length, uint32_t opa,
+                         bool transp) {
+  for (uint32_t i = 0; i < length; ++i) {
+    dest[i].full = transp ? mix_alpha(src[i].full, dest[i].full, opa) :
+      mix(src[i].full, dest[i].full, opa);
+  }
+}
+
+/**********************
+ *   Portable C
+ **********************/
+
+static void fill_c(lv_disp_drv_t *disp_drv, lv_color_t *dest_buf, lv_coord_t dest_width,
+                   const lv_area_t *fill_area, lv_color_t color) {
+  (void)disp_drv;
+  for (lv_coord_t y = fill_area->y1; y <= fill_area->y2; ++y) {
+    lv_color_t *row = dest_buf + y * dest_width;
+    for (lv_coord_t x = fill_area->x1; x <= fill_area->x2; ++x) {
+      row[x] = color;
+    }
+  }
+}
+
+static void blend_c(lv_disp_drv_t *disp_drv, lv_color_t *dest, const lv_color_t *src,
+                    uint32_t length, lv_opa_t opa) {
+  if (opa > LV_OPA_MAX) {
+    memcpy(dest, src, length * sizeof(lv_color_t));
+    return;
+  }
+  blend_pixels(dest, src, length, opa, transparent_screen(disp_drv));
+}
+
+/**********************
+ *   SSE2 (4 pixels)
+ **********************/
+
+#if SIMD_X86
+
+TARGET_SSE2 static inline __m128i div255_sse2(__m128i x) {
+  return _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(x, _mm_set1_epi16(1)),
+                                      _mm_srli_epi16(x, 8)), 8);
+}
+
+TARGET_SSE2 static inline __m128i mix_sse2(__m128i fg, __m128i bg, __m128i opa, __m128i inv) {
+  const __m128i zero = _mm_setzero_si128();
+  __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(fg, zero), opa),
+                             _mm_mullo_epi16(_mm_unpacklo_epi8(bg, zero), inv));
+  __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(fg, zero), opa),
+                             _mm_mullo_epi16(_mm_unpackhi_epi8(bg, zero), inv));
+  return _mm_or_si128(_mm_packus_epi16(div255_sse2(lo), div255_sse2(hi)),
+                      _mm_set1_epi32(0xff000000));
+}
+
+TARGET_SSE2 static inline __m128i select_sse2(__m128i mask, __m128i a, __m128i b) {
+  return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+TARGET_SSE2 static void fill_sse2(lv_disp_drv_t *disp_drv, lv_color_t *dest_buf,
+                                  lv_coord_t dest_width, const lv_area_t *fill_area,
+                                  lv_color_t color) {
+  (void)disp_drv;
+  const __m128i c = _mm_set1_epi32(color.full);
+  int32_t width = lv_area_get_width(fill_area);
+  for (lv_coord_t y = fill_area->y1; y <= fill_area->y2; ++y) {
+    lv_color_t *row = dest_buf + y * dest_width + fill_area->x1;
+    int32_t x = 0;
+    for (; x + 4 <= width; x += 4) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(row + x), c);
+    }
+    for (; x < width; ++x) {
+      row[x] = color;
+    }
+  }
+}
+
+TARGET_SSE2 static void blend_sse2(lv_disp_drv_t *disp_drv, lv_color_t *dest,
+                                   const lv_color_t *src, uint32_t length, lv_opa_t opa) {
+  if (opa > LV_OPA_MAX) {
+    memcpy(dest, src, length * sizeof(lv_color_t));
+    return;
+  }
+  bool transp = transparent_screen(disp_drv);
+  const __m128i vopa = _mm_set1_epi16(opa);
+  const __m128i vinv = _mm_set1_epi16(255 - opa);
+  const __m128i rgb = _mm_set1_epi32(0xffffff);
+  const __m128i fg_alpha = _mm_set1_epi32(uint32_t(opa) << 24);
+  const __m128i min = _mm_set1_epi32(LV_OPA_MIN + 1);
+  const __m128i max = _mm_set1_epi32(LV_OPA_MAX - 1);
+  uint32_t i = 0;
+  for (; i + 4 <= length; i += 4) {
+    __m128i *d = reinterpret_cast<__m128i*>(dest + i);
+    __m128i fg = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    __m128i bg = _mm_loadu_si128(d);
+    if (!transp) {
+      _mm_storeu_si128(d, mix_sse2(fg, bg, vopa, vinv));
+      continue;
+    }
+    // On a transparent screen, the foreground replaces transparent pixels and is mixed into
+    // opaque ones. Anything in between takes the slow path.
+    __m128i bg_opa = _mm_srli_epi32(bg, 24);
+    __m128i clear = _mm_cmplt_epi32(bg_opa, min);
+    __m128i solid = _mm_cmpgt_epi32(bg_opa, max);
+    __m128i fg_a = _mm_or_si128(_mm_and_si128(fg, rgb), fg_alpha);
+    if (opa >= LV_OPA_MAX) {
+      _mm_storeu_si128(d, fg_a);
+    } else if (opa <= LV_OPA_MIN) {
+      _mm_storeu_si128(d, select_sse2(clear, fg_a, bg));
+    } else if (_mm_movemask_epi8(_mm_or_si128(clear, solid)) == 0xffff) {
+      _mm_storeu_si128(d, select_sse2(clear, fg_a, mix_sse2(fg, bg, vopa, vinv)));
+    } else {
+      blend_pixels(dest + i, src + i, 4, opa, true);
+    }
+  }
+  blend_pixels(dest + i, src + i, length - i, opa, transp);
+}
+
+/**********************
+ *   AVX2 (8 pixels)
+ **********************/
+
+TARGET_AVX2 static inline __m256i div255_avx2(__m256i x) {
+  return _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(x, _mm256_set1_epi16(1)),
+                                            _mm256_srli_epi16(x, 8)), 8);
+}
+
+// The unpacks and the pack work within 128 bit lanes, so the pixels stay in order.
+TARGET_AVX2 static inline __m256i mix_avx2(__m256i fg, __m256i bg, __m256i opa, __m256i inv) {
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(fg, zero), opa),
+                                _mm256_mullo_epi16(_mm256_unpacklo_epi8(bg, zero), inv));
+  __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(fg, zero), opa),
+                                _mm256_mullo_epi16(_mm256_unpackhi_epi8(bg, zero), inv));
+  return _mm256_or_si256(_mm256_packus_epi16(div255_avx2(lo), div255_avx2(hi)),
+                         _mm256_set1_epi32(0xff000000));
+}
+
+TARGET_AVX2 static void fill_avx2(lv_disp_drv_t *disp_drv, lv_color_t *dest_buf,
+                                  lv_coord_t dest_width, const lv_area_t *fill_area,
+                                  lv_color_t color) {
+  (void)disp_drv;
+  const __m256i c = _mm256_set1_epi32(color.full);
+  int32_t width = lv_area_get_width(fill_area);
+  for (lv_coord_t y = fill_area->y1; y <= fill_area->y2; ++y) {
+    lv_color_t *row = dest_buf + y * dest_width + fill_area->x1;
+    int32_t x = 0;
+    for (; x + 8 <= width; x += 8) {
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(row + x), c);
+    }
+    for (; x < width; ++x) {
+      row[x] = color;
+    }
+  }
+}
+
+TARGET_AVX2 static void blend_avx2(lv_disp_drv_t *disp_drv, lv_color_t *dest,
+                                   const lv_color_t *src, uint32_t length, lv_opa_t opa) {
+  if (opa > LV_OPA_MAX) {
+    memcpy(dest, src, length * sizeof(lv_color_t));
+    return;
+  }
+  bool transp = transparent_screen(disp_drv);
+  const __m256i vopa = _mm256_set1_epi16(opa);
+  const __m256i vinv = _mm256_set1_epi16(255 - opa);
+  const __m256i rgb = _mm256_set1_epi32(0xffffff);
+  const __m256i fg_alpha = _mm256_set1_epi32(uint32_t(opa) << 24);
+  const __m256i min = _mm256_set1_epi32(LV_OPA_MIN + 1);
+  const __m256i max = _mm256_set1_epi32(LV_OPA_MAX - 1);
+  uint32_t i = 0;
+  for (; i + 8 <= length; i += 8) {
+    __m256i *d = reinterpret_cast<__m256i*>(dest + i);
+    __m256i fg = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    __m256i bg = _mm256_loadu_si256(d);
+    if (!transp) {
+      _mm256_storeu_si256(d, mix_avx2(fg, bg, vopa, vinv));
+      continue;
+    }
+    __m256i bg_opa = _mm256_srli_epi32(bg, 24);
+    __m256i clear = _mm256_cmpgt_epi32(min, bg_opa);
+    __m256i solid = _mm256_cmpgt_epi32(bg_opa, max);
+    __m256i fg_a = _mm256_or_si256(_mm256_and_si256(fg, rgb), fg_alpha);
+    if (opa >= LV_OPA_MAX) {
+      _mm256_storeu_si256(d, fg_a);
+    } else if (opa <= LV_OPA_MIN) {
+      _mm256_storeu_si256(d, _mm256_blendv_epi8(bg, fg_a, clear));
+    } else if (_mm256_movemask_epi8(_mm256_or_si256(clear, solid)) == -1) {
+      _mm256_storeu_si256(d, _mm256_blendv_epi8(mix_avx2(fg, bg, vopa, vinv), fg_a, clear));
+    } else {
+      blend_pixels(dest + i, src + i, 8, opa, true);
+    }
+  }
+  blend_pixels(dest + i, src + i, length - i, opa, transp);
+}
+
+#endif /* SIMD_X86 */
+
+/**********************
+ *   NEON (4 pixels)
+ **********************/
+
+#if SIMD_NEON
+
+static inline uint8x8_t div255_neon(uint16x8_t x) {
+  return vshrn_n_u16(vaddq_u16(vaddq_u16(x, vdupq_n_u16(1)), vshrq_n_u16(x, 8)), 8);
+}
+
+static inline uint32x4_t mix_neon(uint32x4_t fg, uint32x4_t bg, uint8x8_t opa, uint8x8_t inv) {
+  uint8x16_t f = vreinterpretq_u8_u32(fg);
+  uint8x16_t b = vreinterpretq_u8_u32(bg);
+  uint16x8_t lo = vmlal_u8(vmull_u8(vget_low_u8(f), opa), vget_low_u8(b), inv);
+  uint16x8_t hi = vmlal_u8(vmull_u8(vget_high_u8(f), opa), vget_high_u8(b), inv);
+  return vorrq_u32(vreinterpretq_u32_u8(vcombine_u8(div255_neon(lo), div255_neon(hi))),
+                   vdupq_n_u32(0xff000000));
+}
+
+static inline bool all_set_neon(uint32x4_t mask) {
+  uint32x2_t m = vand_u32(vget_low_u32(mask), vget_high_u32(mask));
+  return (vget_lane_u32(m, 0) & vget_lane_u32(m, 1)) == 0xffffffff;
+}
+
+static void fill_neon(lv_disp_drv_t *disp_drv, lv_color_t *dest_buf, lv_coord_t dest_width,
+                      const lv_area_t *fill_area, lv_color_t color) {
+  (void)disp_drv;
+  const uint32x4_t c = vdupq_n_u32(color.full);
+  int32_t width = lv_area_get_width(fill_area);
+  for (lv_coord_t y = fill_area->y1; y <= fill_area->y2; ++y) {
+    lv_color_t *row = dest_buf + y * dest_width + fill_area->x1;
+    int32_t x = 0;
+    for (; x + 4 <= width; x += 4) {
+      vst1q_u32(reinterpret_cast<uint32_t*>(row + x), c);
+    }
+    for (; x < width; ++x) {
+      row[x] = color;
+    }
+  }
+}
+
+static void blend_neon(lv_disp_drv_t *disp_drv, lv_color_t *dest, const lv_color_t *src,
+                       uint32_t length, lv_opa_t opa) {
+  if (opa > LV_OPA_MAX) {
+    memcpy(dest, src, length * sizeof(lv_color_t));
+    return;
+  }
+  bool transp = transparent_screen(disp_drv);
+  const uint8x8_t vopa = vdup_n_u8(opa);
+  const uint8x8_t vinv = vdup_n_u8(255 - opa);
+  const uint32x4_t rgb = vdupq_n_u32(0xffffff);
+  const uint32x4_t fg_alpha = vdupq_n_u32(uint32_t(opa) << 24);
+  const uint32x4_t min = vdupq_n_u32(LV_OPA_MIN + 1);
+  const uint32x4_t max = vdupq_n_u32(LV_OPA_MAX - 1);
+  uint32_t i = 0;
+  for (; i + 4 <= length; i += 4) {
+    uint32_t *d = reinterpret_cast<uint32_t*>(dest + i);
+    uint32x4_t fg = vld1q_u32(reinterpret_cast<const uint32_t*>(src + i));
+    uint32x4_t bg = vld1q_u32(d);
+    if (!transp) {
+      vst1q_u32(d, mix_neon(fg, bg, vopa, vinv));
+      continue;
+    }
+    uint32x4_t bg_opa = vshrq_n_u32(bg, 24);
+    uint32x4_t clear = vcltq_u32(bg_opa, min);
+    uint32x4_t solid = vcgtq_u32(bg_opa, max);
+    uint32x4_t fg_a = vorrq_u32(vandq_u32(fg, rgb), fg_alpha);
+    if (opa >= LV_OPA_MAX) {
+      vst1q_u32(d, fg_a);
+    } else if (opa <= LV_OPA_MIN) {
+      vst1q_u32(d, vbslq_u32(clear, fg_a, bg));
+    } else if (all_set_neon(vorrq_u32(clear, solid))) {
+      vst1q_u32(d, vbslq_u32(clear, fg_a, mix_neon(fg, bg, vopa, vinv)));
+    } else {
+      blend_pixels(dest + i, src + i, 4, opa, true);
+    }
+  }
+  blend_pixels(dest + i, src + i, length - i, opa, transp);
+}
+
+#endif /* SIMD_NEON */
+
+#endif /* LV_COLOR_DEPTH == 32 */
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+bool simd_isa_supported(simd_isa_t isa) {
+  switch (isa) {
+  case SIMD_ISA_NONE:
+    return true;
+#if SIMD_X86
+  case SIMD_ISA_SSE2:
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+  case SIMD_ISA_AVX2:
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+#if SIMD_NEON
+  case SIMD_ISA_NEON:
+    // Always there when the compiler targets it (and on all 64 bit ARM CPUs)
+    return true;
+#endif
+  default:
+    return false;
+  }
+}
+
+simd_isa_t simd_best_isa(void) {
+  static const simd_isa_t fastest_first[] = { SIMD_ISA_AVX2, SIMD_ISA_NEON, SIMD_ISA_SSE2 };
+  for (simd_isa_t isa : fastest_first) {
+    if (simd_isa_supported(isa)) {
+      return isa;
+    }
+  }
+  return SIMD_ISA_NONE;
+}
+
+const char *simd_isa_name(simd_isa_t isa) {
+  switch (isa) {
+  case SIMD_ISA_SSE2:
+    return "SSE2";
+  case SIMD_ISA_AVX2:
+    return "AVX2";
+  case SIMD_ISA_NEON:
+    return "NEON";
+  default:
+    return "C";
+  }
+}
+
+bool simd_set_callbacks(lv_disp_drv_t *disp_drv, simd_isa_t isa) {
+#if LV_COLOR_DEPTH != 32
+  (void)disp_drv;
+  (void)isa;
+  return false;
+#else
+  if (!simd_isa_supported(isa)) {
+    return false;
+  }
+  switch (isa) {
+#if SIMD_X86
+  case SIMD_ISA_SSE2:
+    disp_drv->gpu_fill_cb = fill_sse2;
+    disp_drv->gpu_blend_cb = blend_sse2;
+    break;
+  case SIMD_ISA_AVX2:
+    disp_drv->gpu_fill_cb = fill_avx2;
+    disp_drv->gpu_blend_cb = blend_avx2;
+    break;
+#endif
+#if SIMD_NEON
+  case SIMD_ISA_NEON:
+    disp_drv->gpu_fill_cb = fill_neon;
+    disp_drv->gpu_blend_cb = blend_neon;
+    break;
+#endif
+  default:
+    disp_drv->gpu_fill_cb = fill_c;
+    disp_drv->gpu_blend_cb = blend_c;
+    break;
+  }
+  return true;
+#endif
+}
@@ -0,0 +1,53 @@
+/**
+ * @file simd_blend.h
+ *
+ */
+
+#ifndef SIMD_BLEND_H
+#define SIMD_BLEND_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdbool.h>
+
+#include "lvgl/lvgl.h"
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/* The instruction sets that the fill and blend callbacks are implemented with */
+typedef enum {
+  SIMD_ISA_NONE,  /* portable C, the same loops as LVGL's software renderer */
+  SIMD_ISA_SSE2,
+  SIMD_ISA_AVX2,
+  SIMD_ISA_NEON
+} simd_isa_t;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+/* The fastest instruction set that the CPU supports (detected at runtime) */
+simd_isa_t simd_best_isa(void);
+
+/* Whether the CPU supports an instruction set, and it's compiled in */
+bool simd_isa_supported(simd_isa_t isa);
+
+const char *simd_isa_name(simd_isa_t isa);
+
+/* Set gpu_fill_cb and gpu_blend_cb of a display driver (before it's registered) to the
+ * implementations for an instruction set. Returns false if it isn't supported, or if
+ * LV_COLOR_DEPTH isn't 32 (the callbacks only handle 32 bit pixels). */
+bool simd_set_callbacks(lv_disp_drv_t *disp_drv, simd_isa_t isa);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* SIMD_BLEND_H */
@@ -1,4 +1,6 @@
 
+#include <math.h>
+#include <string.h>
 #include <sys/time.h>
 
 #ifdef __WIN32
@@ -10,13 +12,12 @@
 #include <arpa/inet.h>
 #endif
 
-#include <iostream>
+#include <algorithm>
 #include <thread>
 #include <deque>
 
-#include <mavlink.h>
-
 #include <telemetry.hh>
+#include <logger.hh>
 
 // Standard OpenHD stats structures.
 typedef struct {
@@ -64,7 +65,7 @@ std::string hostname_to_ip(const std::string &hostname) {
   // Try to lookup the host.
   struct hostent *he;
   if ((he = gethostbyname(hostname.c_str())) == NULL) {
-    fprintf(stderr, "Error: invalid hostname\n");
+    LOG_ERROR("Error: invalid hostname");
     return "";
   }
 
@@ -82,7 +83,7 @@ int open_udp_socket_for_rx(uint16_t port, const std::string hostname) {
   // Try to open a UDP socket.
   int fd = socket(AF_INET, SOCK_DGRAM, 0);
   if (fd < 0) {
-    fprintf(stderr, "Error opening the UDP receive socket.\n");
+    LOG_ERROR("Error opening the UDP receive socket.");
     return -1;
   }
 
@@ -109,7 +110,7 @@ int open_udp_socket_for_rx(uint16_t port, const std::string hostname) {
   }
 
   if (bind(fd, (struct sockaddr *)&saddr, sizeof(saddr)) < 0) {
-    fprintf(stderr, "Error binding to the UDP receive socket: %d\n", port);
+    LOG_ERROR("Error binding to the UDP receive socket: %d", port);
     return -1;
   }
 
@@ -157,254 +158,183 @@ bool Telemetry::start(const std::string &telemetry_host, uint16_t telemetry_port
   m_recv_sock = open_udp_socket_for_rx(telemetry_port, telemetry_host);
   m_status_recv_sock = open_udp_socket_for_rx(status_port, status_host);
   if ((m_recv_sock < 0) || (m_status_recv_sock < 0)) {
-    printf("Error binding to telemetry sockets\n");
-    fflush(stdout);
+    LOG_ERROR("Error binding to telemetry sockets");
     return false;
   } else {
-    printf("Opened telemetry port: %s:%d and status port %s:%d\n",
+    LOG_INFO("Opened telemetry port: %s:%d and status port %s:%d",
             telemetry_host.c_str(), telemetry_port, status_host.c_str(), status_port);
   }
+
+  // Wake up the receive thread every second while the telemetry is silent, so a lost stream
+  // is noticed without waiting for the next packet.
+#ifdef __WIN32
+  DWORD timeout_ms = 1000;
+  setsockopt(m_recv_sock, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout_ms),
+             sizeof(timeout_ms));
+#else
+  struct timeval timeout = { 1, 0 };
+  setsockopt(m_recv_sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+#endif
+
   m_stats_thread.reset(new std::thread([this]() { this->wfb_reader_thread(); }));
   m_receive_thread.reset(new std::thread([this]() { this->reader_thread(); }));
   return true;
 }
 
 bool Telemetry::get_value(const std::string &name, float &value) const {
-  NVMap::const_iterator mi = m_values.find(name);
-  if (mi == m_values.end()) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  IDMap::const_iterator mi = m_key_ids.find(name);
+  if ((mi == m_key_ids.end()) || !m_valid[mi->second]) {
     return false;
   }
-  value = mi->second;
+  value = m_values[mi->second];
   return true;
 }
 
+int Telemetry::key_id(const std::string &name) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return add_key(name);
+}
+
+bool Telemetry::get_value(int id, float &value) const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if ((id < 0) || (id >= static_cast<int>(m_values.size())) || !m_valid[id]) {
+    return false;
+  }
+  value = m_values[id];
+  return true;
+}
+
+bool Telemetry::get_text(int id, char *text, size_t len) const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if ((id < 0) || (id >= static_cast<int>(m_texts.size())) || !m_valid[id] || (len == 0)) {
+    return false;
+  }
+  strncpy(text, m_texts[id].c_str(), len - 1);
+  text[len - 1] = '\0';
+  return true;
+}
+
+void Telemetry::changed_keys(std::vector<int> &keys) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  keys.swap(m_changed_keys);
+  m_changed_keys.clear();
+  for (int id : keys) {
+    m_changed[id] = false;
+  }
+}
+
+void Telemetry::set_change_callback(std::function<void()> cb) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_change_cb = cb;
+}
+
 void Telemetry::set_value(const std::string &name, float value) {
-  m_values[name] = value;
+  set_value(key_id(name), value);
+}
+
+void Telemetry::set_value(int id, float value) {
+  std::function<void()> cb;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_valid[id] && (m_values[id] == value)) {
+      return;
+    }
+    m_values[id] = value;
+    m_valid[id] = true;
+    if (m_changed[id]) {
+      return;
+    }
+    m_changed[id] = true;
+    m_changed_keys.push_back(id);
+    if (m_changed_keys.size() == 1) {
+      cb = m_change_cb;
+    }
+  }
+  if (cb) {
+    cb();
+  }
+}
+
+void Telemetry::set_text(int id, const char *text) {
+  float count;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_valid[id] && (m_texts[id] == text)) {
+      return;
+    }
+    // The names are short enough to fit in the string without allocating.
+    m_texts[id] = text;
+    count = m_values[id] + 1;
+  }
+  set_value(id, count);
+}
+
+// Must be called with the mutex held.
+int Telemetry::add_key(const std::string &name) {
+  IDMap::const_iterator mi = m_key_ids.find(name);
+  if (mi != m_key_ids.end()) {
+    return mi->second;
+  }
+  int id = static_cast<int>(m_values.size());
+  m_key_ids[name] = id;
+  m_values.push_back(0);
+  m_valid.push_back(false);
+  m_texts.push_back(std::string());
+  m_changed.push_back(false);
+  return id;
+}
+
+bool Telemetry::get_param(const std::string &name, float &value) const {
+  return m_params.get(name, value);
+}
+
+bool Telemetry::send(const uint8_t *data, size_t len) {
+  if (!m_sender_valid) {
+    return false;
+  }
+  struct sockaddr_in saddr;
+  memset((char *)&saddr, 0, sizeof(saddr));
+  saddr.sin_family = AF_INET;
+  saddr.sin_port = m_sender_port;
+  saddr.sin_addr.s_addr = m_sender_ip;
+  return (sendto(m_recv_sock, data, len, 0, (struct sockaddr *)&saddr, sizeof(saddr)) ==
+          static_cast<ssize_t>(len));
 }
 
 bool Telemetry::connected() const {
   return m_connected;
 }
 
+const char *Telemetry::protocol() const {
+  return m_decoders.protocol();
+}
+
 void Telemetry::reader_thread() {
-  mavlink_message_t msg;
-  mavlink_status_t status;
   int max_length = 1024;
-  char data[max_length];
-  bool messages_requested = false;
+  uint8_t data[max_length];
 
   while(1) {
-    ssize_t length = recv(m_recv_sock, data, max_length, 0);
+    struct sockaddr_in saddr;
+    socklen_t saddr_len = sizeof(saddr);
+    ssize_t length = recvfrom(m_recv_sock, data, max_length, 0,
+                              (struct sockaddr *)&saddr, &saddr_len);
+    if (length <= 0) {
+      m_decoders.check_timeout(cur_time());
+      continue;
+    }
+
+    // Replies (e.g. parameter requests) are sent back to wherever the telemetry comes from.
+    m_sender_ip = saddr.sin_addr.s_addr;
+    m_sender_port = saddr.sin_port;
+    m_sender_valid = true;
 
     if (!m_connected) {
       //set_value("ip_address", m_sender_endpoint.address().to_string());
       m_connected = true;
     }
 
-    bool heartbeat_received = false;
-    for (size_t i = 0; i < length; ++i) {
-      if (mavlink_parse_char(MAVLINK_COMM_0, data[i], &msg, &status)) {
-	m_sysid = msg.sysid;
-	m_compid = msg.compid;
-	switch (msg.msgid) {
-	case MAVLINK_MSG_ID_POWER_STATUS:
-	  break;
-	case MAVLINK_MSG_ID_SYS_STATUS:
-	  mavlink_sys_status_t sys_status;
-	  mavlink_msg_sys_status_decode(&msg, &sys_status);
-	  if (!m_rec_bat_status) {
-	    set_value("voltage_battery", sys_status.voltage_battery / 1000.0);
-	    set_value("current_battery",
-		      std::max(sys_status.current_battery, static_cast<short>(0)) / 100.0);
-	    set_value("battery_remaining", sys_status.battery_remaining);
-	  }
-	  break;
-	case MAVLINK_MSG_ID_NAV_CONTROLLER_OUTPUT:
-	  mavlink_nav_controller_output_t nav;
-	  mavlink_msg_nav_controller_output_decode(&msg, &nav);
-	  break;
-	case MAVLINK_MSG_ID_GLOBAL_POSITION_INT:
-	  mavlink_global_position_int_t pos;
-	  mavlink_msg_global_position_int_decode(&msg, &pos);
-	  set_value("latitude", static_cast<float>(pos.lat) * 1e-7);
-	  set_value("longitude", static_cast<float>(pos.lon) * 1e-7);
-	  set_value("altitude", static_cast<float>(pos.alt) / 1000.0);
-	  set_value("relative_altitude", static_cast<float>(pos.relative_alt) / 1000.0);
-	  set_value("speed", sqrt(pos.vx * pos.vx + pos.vy * pos.vy + pos.vz * pos.vz) / 100.0);
-          // iNav is raw degrees (no scaling).
-	  //set_value("heading", static_cast<float>(pos.hdg));
-	  set_value("heading", static_cast<float>(pos.hdg) / 100.0);
-	  break;
-	case MAVLINK_MSG_ID_ATTITUDE:
-	  mavlink_attitude_t att;
-	  mavlink_msg_attitude_decode(&msg, &att);
-	  set_value("roll", att.roll);
-	  set_value("pitch", att.pitch);
-	  set_value("yaw", att.yaw);
-	  break;
-	case MAVLINK_MSG_ID_STATUSTEXT:
-	  mavlink_statustext_t status;
-	  mavlink_msg_statustext_decode(&msg, &status);
-	  break;
-	case MAVLINK_MSG_ID_MISSION_CURRENT:
-	  //std::cerr << "Mission current " << std::endl;
-	  break;
-	case MAVLINK_MSG_ID_SERVO_OUTPUT_RAW:
-	  //std::cerr << "Servo raw " << std::endl;
-	  break;
-	case MAVLINK_MSG_ID_RC_CHANNELS:
-	  break;
-	case MAVLINK_MSG_ID_PARAM_VALUE:
-	  //std::cerr << "Param value " << std::endl;
-	  break;
-	case MAVLINK_MSG_ID_VIBRATION:
-	  //std::cerr << "Vibration " << std::endl;
-	  break;
-	case MAVLINK_MSG_ID_HEARTBEAT: {
-	  mavlink_heartbeat_t hb;
-	  mavlink_msg_heartbeat_decode(&msg, &hb);
-	  bool is_armed = (hb.base_mode & 0x80);
-	  set_value("armed", is_armed ? 1.0 : 0.0);
-	  set_value("mode", static_cast<float>(hb.custom_mode));
-	  heartbeat_received = true;
-	  break;
-	}
-	case MAVLINK_MSG_ID_VFR_HUD:
-	  //std::cerr << "VFR HUD " << std::endl;
-	  break;
-	case MAVLINK_MSG_ID_RAW_IMU:
-	  //std::cerr << "Raw IMU " << std::endl;
-	  break;
-	case MAVLINK_MSG_ID_SCALED_PRESSURE:
-	  //std::cerr << "Scaled Pressure " << std::endl;
-	  break;
-	case MAVLINK_MSG_ID_GPS_RAW_INT:
-	  mavlink_gps_raw_int_t rawgps;
-	  mavlink_msg_gps_raw_int_decode(&msg, &rawgps);
-	  set_value("gps_fix_type", rawgps.fix_type);
-	  set_value("gps_HDOP", rawgps.eph / 100.0);
-	  set_value("gps_VDOP", rawgps.epv / 100.0);
-          if (rawgps.vel != UINT16_MAX) {
-            set_value("gps_velosity", rawgps.vel / 100.0);
-          }
-          if (rawgps.cog != UINT16_MAX) {
-            set_value("gps_ground_course", rawgps.cog * 100.0);
-          }
-          if (rawgps.satellites_visible != 255) {
-            set_value("gps_num_sats", rawgps.satellites_visible);
-          }
-	  //std::cerr << "GSP Raw " << std::endl;
-	  break;
-	case MAVLINK_MSG_ID_SYSTEM_TIME:
-	  //std::cerr << "System Time " << std::endl;
-	  break;
-	case MAVLINK_MSG_ID_LOCAL_POSITION_NED:
-	  //std::cerr << "Local position " << std::endl;
-	  break;
-	case MAVLINK_MSG_ID_AUTOPILOT_VERSION:
-	  //std::cerr << "Autopilot version " << std::endl;
-	  break;
-	case MAVLINK_MSG_ID_COMMAND_ACK:
-	  //std::cerr << "Command ACK " << std::endl;
-	  break;
-	case MAVLINK_MSG_ID_BATTERY_STATUS:
-	  mavlink_battery_status_t bat;
-	  mavlink_msg_battery_status_decode(&msg, &bat);
-/*
-	  if (bat.voltages[0] != INT16_MAX) {
-	    set_value("voltage_battery", bat.voltages[0] / 1000.0);
-	    set_value("current_battery",
-		      std::max(bat.current_battery, static_cast<short>(0)) / 100.0);
-	    set_value("battery_remaining", bat.battery_remaining);
-	    m_rec_bat_status = true;
-	  }
-*/
-	  break;
-	case MAVLINK_MSG_ID_HOME_POSITION:
-	  mavlink_home_position_t home;
-	  mavlink_msg_home_position_decode(&msg, &home);
-	  set_value("home_latitude", home.latitude * 1e-7);
-	  set_value("home_longitude", home.longitude * 1e-7);
-	  set_value("home_altitude", home.altitude);
-	  break;
-	case MAVLINK_MSG_ID_RC_CHANNELS_RAW:
-          {
-            mavlink_rc_channels_raw_t rc;
-            mavlink_msg_rc_channels_raw_decode(&msg, &rc);
-            set_value("chan1", rc.chan1_raw);
-            set_value("chan2", rc.chan2_raw);
-            set_value("chan3", rc.chan3_raw);
-            set_value("chan4", rc.chan4_raw);
-            set_value("chan5", rc.chan5_raw);
-            set_value("chan6", rc.chan6_raw);
-            set_value("chan7", rc.chan7_raw);
-            set_value("chan8", rc.chan8_raw);
-            set_value("rc_rssi", 70.0 * static_cast<float>(rc.rssi) / 255.0 - 90.0);
-          }
-	  break;
-	case MAVLINK_MSG_ID_GPS_GLOBAL_ORIGIN:
-          {
-            mavlink_gps_global_origin_t origin;
-            mavlink_msg_gps_global_origin_decode(&msg, &origin);
-            set_value("home_latitude", origin.latitude * 1e-7);
-            set_value("home_longitude", origin.longitude * 1e-7);
-            set_value("home_altitude", origin.altitude);
-            // Calculate the home direction.
-            float gps_lat = 0;
-            float gps_lon = 0;
-            get_value("latitude", gps_lat);
-            get_value("longitude", gps_lon);
-            if ((gps_lat != 0) || (gps_lon != 0)) {
-              gps_lat *= M_PI / 180.0;
-              gps_lon *= M_PI / 180.0;
-              double hlat = origin.latitude * M_PI / 180.0;
-              double hlon = origin.latitude * M_PI / 180.0;
-              double dlon = hlon - gps_lon;
-              double x = sin(dlon) * sin(hlat);
-              double y = cos(gps_lat) * sin(hlat) - sin(gps_lat) * cos(hlat) * cos(dlon);
-              double hdir = atan2(y, x) * 180.0 / M_PI;
-              set_value("home_direction", hdir);
-            }
-          }
-          break;
-	default:
-	  std::cerr << "Received packet: SYS: " << int(msg.sysid)
-		    << ", COMP: " << int(msg.compid)
-		    << ", LEN: " << int(msg.len)
-		    << ", MSG ID: " << msg.msgid << std::endl;
-	  break;
-	}
-      }
-    }
-
-    if (heartbeat_received && !messages_requested) {
-      const uint8_t MAVStreams[] = {
-				    MAV_DATA_STREAM_RAW_SENSORS,
-				    MAV_DATA_STREAM_EXTENDED_STATUS,
-				    MAV_DATA_STREAM_RC_CHANNELS,
-				    MAV_DATA_STREAM_POSITION,
-				    MAV_DATA_STREAM_EXTRA1,
-				    MAV_DATA_STREAM_EXTRA2,
-				    MAVLINK_MSG_ID_ATTITUDE,
-				    MAVLINK_MSG_ID_RADIO_STATUS
-      };
-      const uint16_t MAVRates[] = { 2, 5, 2, 5, 2, 2, 20, 2 };
-      uint8_t data[max_length];
-      for (size_t i = 0; i < sizeof(MAVStreams); ++i) {
-/*
-	int len = mavlink_msg_request_data_stream_pack(m_sysid, m_compid,
-						       reinterpret_cast<mavlink_message_t*>(data),
-						       1, 1, MAVStreams[i], MAVRates[i], 1);
-	m_send_sock.send_to(boost::asio::buffer(data, len), m_sender_endpoint);
-*/
-	int len = mavlink_msg_message_interval_pack(m_sysid, m_compid,
-						    reinterpret_cast<mavlink_message_t*>(data),
-						    MAVStreams[i], 1000000 / MAVRates[i]);
-	//m_recv_sock.send_to(boost::asio::buffer(data, len), m_sender_endpoint);
-      }
-      messages_requested = true;
-    }
-
+    m_decoders.parse(data, length, cur_time());
   }
 }
 
@@ -427,7 +357,7 @@ void Telemetry::wfb_reader_thread() {
     if (len != sizeof(link_stats)) {
       continue;
     }
-    std::cerr << "Received status\n";
+    LOG_DEBUG("Received status");
 
     // Insert a new stats message into the queue if the second has rolled over.
     double time = cur_time();
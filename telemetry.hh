@@ -1,31 +1,69 @@
 #pragma once
 
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <map>
+#include <vector>
+
+#include <protocol_decoder.hh>
+#include <param_cache.hh>
 
 class Telemetry {
 public:
 
-  Telemetry() : m_recv_sock(0), m_status_recv_sock(0), m_sysid(0), m_compid(0),
-                m_last_telemetry_packet_time(0), m_sender_valid(false), m_rec_bat_status(false),
-                m_connected(false) {}
+  Telemetry() : m_recv_sock(0), m_status_recv_sock(0), m_decoders(*this),
+                m_last_telemetry_packet_time(0), m_sender_ip(0), m_sender_port(0),
+                m_sender_valid(false), m_connected(false) {}
 
   bool start(const std::string &telemetry_host, uint16_t telemetry_port,
              const std::string &status_host, uint16_t status_port);
 
   bool get_value(const std::string &name, float &value) const;
 
+  // Telemetry values can also be accessed by ID, which avoids the name lookup and
+  // allows the changes to be tracked. IDs are assigned on first use and never change.
+  int key_id(const std::string &name);
+  bool get_value(int id, float &value) const;
+
+  // The text of a value that is a name (e.g. "mode_name", the flight mode from the decoder of
+  // the detected protocol). The number value of a text counts its changes, so the text can be
+  // bound like any other value. Returns false if there is no text for the key.
+  bool get_text(int id, char *text, size_t len) const;
+
+  // Get the IDs of the values that have changed since the previous call.
+  void changed_keys(std::vector<int> &keys);
+
+  // Called (from the receive threads) when a value changes and there were no other
+  // changes pending, so the OSD can sleep until there is something to update.
+  void set_change_callback(std::function<void()> cb);
+
+  // Set a value that is produced by the OSD itself (e.g. the frame rates chosen by the
+  // FrameGovernor), so it can be shown like any other telemetry value.
+  void set_metric(const std::string &name, float value) { set_value(name, value); }
+
+  // Lookup an autopilot parameter.
+  bool get_param(const std::string &name, float &value) const;
+
   bool armed() const;
   void armed(bool val);
 
   bool connected() const;
 
+  // The name of the protocol detected on the telemetry port.
+  const char *protocol() const;
+
 private:
-  typedef std::map<std::string, float> NVMap;
+  friend class ProtocolDecoder;
+  typedef std::map<std::string, int> IDMap;
 
   void set_value(const std::string &name, float value);
+  void set_value(int id, float value);
+  void set_text(int id, const char *text);
+  int add_key(const std::string &name);
+  bool send(const uint8_t *data, size_t len);
 
   void reader_thread();
   void wfb_reader_thread();
@@ -33,12 +71,22 @@ private:
 
   int m_recv_sock;
   int m_status_recv_sock;
-  NVMap m_values;
-  uint8_t m_sysid;
-  uint8_t m_compid;
+  mutable std::mutex m_mutex;
+  IDMap m_key_ids;
+  std::vector<float> m_values;
+  std::vector<bool> m_valid;
+  std::vector<std::string> m_texts;
+  std::vector<bool> m_changed;
+  std::vector<int> m_changed_keys;
+  std::function<void()> m_change_cb;
+  // The MAVLink decoder registers its request callbacks with the parameter cache when it's
+  // constructed, so the cache has to be constructed first.
+  ParamCache m_params;
+  ProtocolDetector m_decoders;
   double m_last_telemetry_packet_time;
+  uint32_t m_sender_ip;
+  uint16_t m_sender_port;
   bool m_sender_valid;
-  bool m_rec_bat_status;
   bool m_connected;
   std::shared_ptr<std::thread> m_receive_thread;
   std::shared_ptr<std::thread> m_stats_thread;
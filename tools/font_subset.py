@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+"""Generate the OSD fonts with only the characters that the OSD draws.
+
+The characters are collected from the sources:
+  - the text and characters that the labels are formatted with in lvgl_osd.cc
+  - the flight mode tables (g_*_mode_strings) of the protocol decoders, the name of an unknown
+    mode (UNKNOWN_MODE_PREFIX) and the upper case names that CRSF sends as text
+  - the label text of the built in layout in osd_layout.cc ({up} and {down} are symbols)
+  - the glyph atlas characters (GLYPH_ATLAS_CHARS) in numeric_label.hh
+  - digits, sign and decimal point, which every number needs
+
+and each size is converted with lv_font_conv into osd_font_<size>.c, an LVGL font that only
+has those glyphs.
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+
+# The LVGL symbols that the layout text can refer to (LV_SYMBOL_UP and LV_SYMBOL_DOWN)
+SYMBOLS = {"{up}": 0xF077, "{down}": 0xF078}
+
+NUMBERS = "0123456789+-. "
+
+# Betaflight and iNav send the CRSF flight mode as text, e.g. "ACRO", "ANGL" or "!FS!"
+CRSF_MODE_CHARS = "ABCDEFGHIJKLMNOPQRSTUVWXYZ!"
+
+C_STRING = r'"((?:[^"\\]|\\.)*)"'
+
+
+def unescape(s):
+    return s.encode("latin-1").decode("unicode_escape")
+
+
+def read(path):
+    with open(path, encoding="utf-8") as f:
+        return f.read()
+
+
+def mode_chars(paths):
+    """The mode names of the decoders."""
+    chars = set(CRSF_MODE_CHARS)
+    for path in paths:
+        src = read(path)
+        for table in re.finditer(r"g_\w*mode_strings\[\]\s*=\s*\{(.*?)\};", src, re.S):
+            for s in re.finditer(C_STRING, table.group(1)):
+                chars.update(unescape(s.group(1)))
+        m = re.search(r"#define\s+UNKNOWN_MODE_PREFIX\s+" + C_STRING, src)
+        if m:
+            chars.update(unescape(m.group(1)))
+    return chars
+
+
+def osd_chars(path):
+    """The literals that the labels are built from."""
+    src = read(path)
+    chars = set()
+    for s in re.finditer(r"\.str\(" + C_STRING + r"\)", src):
+        chars.update(unescape(s.group(1)))
+    for c in re.finditer(r"'([^'\\])'", src):
+        chars.add(c.group(1))
+    return chars
+
+
+def layout_chars(path):
+    """The label text of the layout, and the symbols that it uses."""
+    chars = set()
+    symbols = set()
+    for text in re.finditer(r"^text\s*=\s*(.*)$", read(path), re.M):
+        text = text.group(1).strip()
+        for name, code in SYMBOLS.items():
+            if name in text:
+                symbols.add(code)
+                text = text.replace(name, "")
+        chars.update(text)
+    return chars, symbols
+
+
+def atlas_chars(path):
+    m = re.search(r"#define\s+GLYPH_ATLAS_CHARS\s+" + C_STRING, read(path))
+    return set(unescape(m.group(1))) if m else set()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--lv-font-conv", default="lv_font_conv", help="the lv_font_conv command")
+    parser.add_argument("--font", required=True, help="the text font (TTF or WOFF)")
+    parser.add_argument("--symbol-font", help="the font of the LVGL symbols")
+    parser.add_argument("--osd", required=True, help="lvgl_osd.cc")
+    parser.add_argument("--layout", required=True, help="osd_layout.cc")
+    parser.add_argument("--decoders", nargs="+", default=[],
+                        help="the protocol decoder sources (and protocol_decoder.hh)")
+    parser.add_argument("--atlas", required=True, help="numeric_label.hh")
+    parser.add_argument("--extra", default="", help="more characters to include (e.g. for the "
+                        "text in a layout file)")
+    parser.add_argument("--bpp", type=int, default=4)
+    parser.add_argument("--output-dir", required=True)
+    parser.add_argument("sizes", type=int, nargs="+")
+    args = parser.parse_args()
+
+    chars = (set(NUMBERS) | osd_chars(args.osd) | mode_chars(args.decoders) |
+             atlas_chars(args.atlas) | set(args.extra))
+    text, symbols = layout_chars(args.layout)
+    chars |= text
+    chars = "".join(sorted(c for c in chars if c.isprintable()))
+    print("OSD font characters: %r (and %d symbols)" % (chars, len(symbols)))
+
+    for size in args.sizes:
+        name = "osd_font_%d" % size
+        cmd = [args.lv_font_conv, "--no-compress", "--no-prefilter", "--bpp", str(args.bpp),
+               "--size", str(size), "--format", "lvgl", "--lv-include", "lvgl/lvgl.h",
+               "--font", args.font, "--symbols", chars]
+        if symbols and args.symbol_font:
+            cmd += ["--font", args.symbol_font,
+                    "--range", ",".join("0x%X" % code for code in sorted(symbols))]
+        cmd += ["--lv-font-name", name, "-o", os.path.join(args.output_dir, name + ".c")]
+        if subprocess.call(cmd) != 0:
+            sys.exit("lv_font_conv failed for %s" % name)
+
+
+if __name__ == "__main__":
+    main()